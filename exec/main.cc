@@ -85,6 +85,9 @@ int main(int argc, const char **argv) {
         logging::warn("No table is selected");
     }
 
+    // Checkpoints run in the background from here on
+    driver.start_flusher();
+
     int ret = 0;
 
     if (!(*command).empty()) {
@@ -154,6 +154,7 @@ class InsertStmt;
 class SelectStmt;
 class UpdateStmt;
 class DeleteStmt;
+class CreateIndexStmt;
 
 class Stmt {
 public:
@@ -162,6 +163,7 @@ public:
         SelectStmtKind,
         UpdateStmtKind,
         DeleteStmtKind,
+        CreateIndexStmtKind,
         StmtKindCount
     };
 
@@ -262,6 +264,26 @@ public:
     const Expr *cond;
 };
 
+/// create_index_stmt
+///     ::= CREATE INDEX ON identifier "(" identifier ")"
+///         [ USING identifier ]
+///         ;
+class CreateIndexStmt final : public Stmt {
+public:
+    CreateIndexStmt(const IdentifierExpr *table,
+                    const IdentifierExpr *column,
+                    const IdentifierExpr *method,
+                    size_t B,
+                    size_t E) :
+        Stmt(Stmt::StmtKind::CreateIndexStmtKind, B, E), tb_name(table), column(column),
+        method(method) {}
+
+    const IdentifierExpr *tb_name;
+    const IdentifierExpr *column;
+    // `USING <method>`, nullptr for the default ordered index
+    const IdentifierExpr *method;
+};
+
 class ASTContext {
     friend class Parser;
 
@@ -315,6 +337,9 @@ public:
             case Stmt::StmtKind::DeleteStmtKind:
                 derived_this->visitDelete(static_cast<const DeleteStmt *>(S));
                 break;
+            case Stmt::StmtKind::CreateIndexStmtKind:
+                derived_this->visitCreateIndex(static_cast<const CreateIndexStmt *>(S));
+                break;
             default: std::abort();
         }
     }
@@ -363,6 +388,10 @@ protected:
         return true;
     }
 
+    bool visitCreateIndex(const CreateIndexStmt *S) {
+        return true;
+    }
+
     bool visitBinary(const BinaryExpr *E) {
         return true;
     }
@@ -187,6 +187,24 @@ public:
         return false;
     }
 
+    bool visitCreateIndex(const CreateIndexStmt *S) {
+        print_prefix();
+        os << utils::StyledText("CreateIndexStmt").cyan().bold() << "\n";
+        {
+            BranchGuard g(branch_stack, false);
+            visit(S->tb_name);
+        }
+        {
+            BranchGuard g(branch_stack, S->method == nullptr);
+            visit(S->column);
+        }
+        if (S->method) {
+            BranchGuard g(branch_stack, true);
+            visit(S->method);
+        }
+        return false;
+    }
+
     // ---------- Expr ----------
 
     bool visitBinary(const BinaryExpr *E) {
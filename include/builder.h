@@ -7,264 +7,229 @@
 
 namespace gpamgr {
 namespace {
-enum class CmpOp { Eq, Ne, Lt, Le, Gt, Ge, Like };
-constexpr double EPS = 1e-6;
-#define abs(n) ((n) > 0 ? (n) : -(n))
-#define float_eq(a, b) (abs(a - b) < EPS)
+// Compiles expressions over the columns of one table into an `ExprProgram`. Registers are
+// handed out like a stack, an operand compiled into `reg` may use the registers after it.
+class ExprCompiler {
+    using FieldType = Table::FieldType;
+    using BinaryOp = BinaryExpr::BinaryOp;
+    using Op = ExprProgram::Op;
 
-std::expected<bool, std::string> compare_value(const Table::Value &lhs,
-                                               const Table::Value &rhs,
-                                               CmpOp op) {
-    using FT = Table::FieldType;
+    const Table &tb;
+    ExprProgram prog;
+    // Jumps of earlier conjuncts that skip to the end of the program
+    std::vector<size_t> exits;
 
-    // LIKE: only string
-    if (op == CmpOp::Like) {
-        if (lhs.type != FT::STRING || rhs.type != FT::STRING) {
-            return std::unexpected("`LIKE` can only be used on string");
-        }
-        return utils::strlike(*lhs.as_string(), *rhs.as_string());
+    void emit(Op op, uint8_t dst, uint8_t a = 0, uint8_t b = 0, uint32_t imm = 0) {
+        prog.code.push_back({.op = op, .dst = dst, .a = a, .b = b, .imm = imm});
     }
 
-    // numeric comparison: INT / FLOAT
-    auto is_numeric = [](FT t) {
-        return t == FT::INT || t == FT::FLOAT;
-    };
+    uint32_t add_const(Value v) {
+        prog.consts.push_back(std::move(v));
+        return uint32_t(prog.consts.size() - 1);
+    }
 
-    if (is_numeric(lhs.type) && is_numeric(rhs.type)) {
-        double x = (lhs.type == FT::INT) ? static_cast<double>(*lhs.as_int()) : *lhs.as_double();
-        double y = (rhs.type == FT::INT) ? static_cast<double>(*rhs.as_int()) : *rhs.as_double();
+    static bool is_numeric(FieldType ty) {
+        return ty == FieldType::INT || ty == FieldType::FLOAT;
+    }
 
-        switch (op) {
-            case CmpOp::Eq: return float_eq(x, y);
-            case CmpOp::Ne: return !float_eq(x, y);
-            case CmpOp::Lt: return x < y;
-            case CmpOp::Le: return x <= y;
-            case CmpOp::Gt: return x > y;
-            case CmpOp::Ge: return x >= y;
-            default: break;
+    // Bring two numeric operands to one type, INT is widened when the other side is FLOAT
+    FieldType unify(FieldType lhs, uint8_t lreg, FieldType rhs, uint8_t rreg) {
+        if (lhs == rhs) {
+            return lhs;
         }
+        emit(Op::IntToFloat,
+             lhs == FieldType::INT ? lreg : rreg,
+             lhs == FieldType::INT ? lreg : rreg);
+        return FieldType::FLOAT;
     }
 
-    // string comparison (non-LIKE)
-    if (lhs.type == FT::STRING && rhs.type == FT::STRING) {
-        auto &x = *lhs.as_string();
-        auto &y = *rhs.as_string();
-        switch (op) {
-            case CmpOp::Eq: return x == y;
-            case CmpOp::Ne: return x != y;
-            case CmpOp::Lt: return x < y;
-            case CmpOp::Le: return x <= y;
-            case CmpOp::Gt: return x > y;
-            case CmpOp::Ge: return x >= y;
-            default: break;
+    std::expected<FieldType, std::string> value(const Expr *E, uint8_t reg) {
+        using ExprKind = Expr::ExprKind;
+        if (reg + 2 > ExprProgram::MAX_REGS) {
+            return std::unexpected("Expression is too deeply nested");
         }
-    }
+        switch (E->get_kind()) {
+            case ExprKind::IdentifierExprKind: {
+                auto *id = static_cast<const IdentifierExpr *>(E);
+                auto idx = tb.field_index(id->name);
+                if (!idx)
+                    return std::unexpected("Unknown column: " + std::string(id->name));
+
+                auto ty = tb.get_schema()[*idx].type;
+                auto op = ty == FieldType::INT     ? Op::ColI
+                          : ty == FieldType::FLOAT ? Op::ColF
+                                                   : Op::ColS;
+                emit(op, reg, 0, 0, uint32_t(*idx));
+                return ty;
+            }
 
-    return std::unexpected("Type mismatch in comparison");
-}
+            case ExprKind::IntLiteralKind: {
+                auto *lit = static_cast<const IntegerLiteral *>(E);
+                emit(Op::ConstI, reg, 0, 0, add_const(Value(lit->value)));
+                return FieldType::INT;
+            }
 
-std::expected<Value, std::string> apply_arith(BinaryExpr::BinaryOp op,
-                                              const Value &lhs,
-                                              const Value &rhs) {
-    using FieldType = Table::FieldType;
-    using BinaryOp = BinaryExpr::BinaryOp;
-    if (lhs.type == FieldType::STRING || rhs.type == FieldType::STRING) {
-        return std::unexpected("Arithmetic on string is not supported");
-    }
+            case ExprKind::FloatLiteralKind: {
+                auto *lit = static_cast<const FloatLiteral *>(E);
+                emit(Op::ConstF, reg, 0, 0, add_const(Value(lit->value)));
+                return FieldType::FLOAT;
+            }
 
-    bool is_float = (lhs.type == FieldType::FLOAT || rhs.type == FieldType::FLOAT);
+            case ExprKind::StringLiteralKind: {
+                auto *lit = static_cast<const StringLiteral *>(E);
+                emit(Op::ConstS, reg, 0, 0, add_const(Value(std::string_view(lit->value))));
+                return FieldType::STRING;
+            }
 
-    if (is_float) {
-        double x = (lhs.type == FieldType::FLOAT) ? *lhs.as_double() : double(*lhs.as_int());
-        double y = (rhs.type == FieldType::FLOAT) ? *rhs.as_double() : double(*rhs.as_int());
+            case ExprKind::BinaryExprKind: {
+                auto *bin = static_cast<const BinaryExpr *>(E);
+                static constexpr Op int_ops[] = {Op::AddI, Op::SubI, Op::MulI, Op::DivI};
+                static constexpr Op float_ops[] = {Op::AddF, Op::SubF, Op::MulF, Op::DivF};
+                if (bin->op < BinaryOp::Add) {
+                    return std::unexpected("Expression not evaluatable to value");
+                }
 
-        switch (op) {
-            case BinaryOp::Add: return Value(x + y);
-            case BinaryOp::Sub: return Value(x - y);
-            case BinaryOp::Mul: return Value(x * y);
-            case BinaryOp::Div:
-                if (y == 0) {
-                    return std::unexpected("Division by zero");
+                auto lhs = value(bin->lhs, reg);
+                if (!lhs) {
+                    return lhs;
                 }
-                return Value(x / y);
-            default: return std::unexpected("Invalid arithmetic operator");
-        }
-    } else {
-        int64_t x = *lhs.as_int();
-        int64_t y = *rhs.as_int();
+                auto rhs = value(bin->rhs, reg + 1);
+                if (!rhs) {
+                    return rhs;
+                }
+                if (*lhs == FieldType::STRING || *rhs == FieldType::STRING) {
+                    return std::unexpected("Arithmetic on string is not supported");
+                }
+                auto ty = unify(*lhs, reg, *rhs, reg + 1);
+                auto i = size_t(bin->op) - size_t(BinaryOp::Add);
+                emit(ty == FieldType::INT ? int_ops[i] : float_ops[i], reg, reg, reg + 1);
+                return ty;
+            }
 
-        switch (op) {
-            case BinaryOp::Add: return Value(x + y);
-            case BinaryOp::Sub: return Value(x - y);
-            case BinaryOp::Mul: return Value(x * y);
-            case BinaryOp::Div:
-                if (y == 0) {
-                    return std::unexpected("Division by zero");
+            case ExprKind::UnaryExprKind: {
+                using UnaryOp = UnaryExpr::UnaryOp;
+                auto *un = static_cast<const UnaryExpr *>(E);
+                auto rhs = value(un->rhs, reg);
+                if (!rhs) {
+                    return rhs;
+                }
+                if (*rhs == FieldType::STRING) {
+                    return std::unexpected("Cannot Calcutate value for `STRING`");
+                }
+                if (un->op == UnaryOp::Sub) {
+                    emit(*rhs == FieldType::INT ? Op::NegI : Op::NegF, reg, reg);
                 }
-                return Value(x / y);
-            default: return std::unexpected("Invalid arithmetic operator");
+                return *rhs;
+            }
+
+            default: return std::unexpected("Expression not evaluatable to value");
         }
     }
-}
 
-std::expected<ValueExpr, std::string> build_value(const Expr *E, const Table &tb) {
-    using ExprKind = Expr::ExprKind;
-    switch (E->get_kind()) {
-        case ExprKind::IdentifierExprKind: {
-            auto *id = static_cast<const IdentifierExpr *>(E);
-            auto idx = tb.field_index(id->name);
-            if (!idx)
-                return std::unexpected("Unknown column: " + std::string(id->name));
-
-            return ValueExpr{[col = *idx](const RowView &rv) { return rv.cols[col]; }};
+    // Leaves the boolean outcome of `E` in `reg`
+    std::expected<void, std::string> predicate(const Expr *E, uint8_t reg) {
+        if (!E->isa(Expr::ExprKind::BinaryExprKind)) {
+            return std::unexpected("Invalid WHERE expression");
         }
+        auto *bin = static_cast<const BinaryExpr *>(E);
 
-        case ExprKind::IntLiteralKind: {
-            auto *lit = static_cast<const IntegerLiteral *>(E);
-            Table::Value v(lit->value);
-            return ValueExpr{[v](const RowView &) { return v; }};
+        // AND / OR, the right side is skipped once the left side decides
+        if (bin->op == BinaryOp::And || bin->op == BinaryOp::Or) {
+            if (auto ret = predicate(bin->lhs, reg); !ret) {
+                return ret;
+            }
+            auto jump = prog.code.size();
+            emit(bin->op == BinaryOp::And ? Op::JumpIfFalse : Op::JumpIfTrue, 0, reg);
+            if (auto ret = predicate(bin->rhs, reg); !ret) {
+                return ret;
+            }
+            prog.code[jump].imm = uint32_t(prog.code.size());
+            return {};
         }
 
-        case ExprKind::FloatLiteralKind: {
-            auto *lit = static_cast<const FloatLiteral *>(E);
-            Table::Value v(lit->value);
-            return ValueExpr{[v](const RowView &) { return v; }};
+        // comparison, opcodes in the order of `BinaryOp::Eq` .. `BinaryOp::Ge`
+        static constexpr Op int_ops[] = {Op::EqI, Op::NeI, Op::LtI, Op::LeI, Op::GtI, Op::GeI};
+        static constexpr Op float_ops[] = {Op::EqF, Op::NeF, Op::LtF, Op::LeF, Op::GtF, Op::GeF};
+        static constexpr Op str_ops[] = {Op::EqS, Op::NeS, Op::LtS, Op::LeS, Op::GtS, Op::GeS};
+        if (bin->op < BinaryOp::Eq || bin->op > BinaryOp::Like) {
+            return std::unexpected("Invalid binary operator in WHERE");
         }
-
-        case ExprKind::StringLiteralKind: {
-            auto *lit = static_cast<const StringLiteral *>(E);
-            Table::Value v(std::string(lit->value));
-            return ValueExpr{[v](const RowView &) { return v; }};
+        auto lhs = value(bin->lhs, reg);
+        if (!lhs) {
+            return std::unexpected(std::move(lhs.error()));
+        }
+        auto rhs = value(bin->rhs, reg + 1);
+        if (!rhs) {
+            return std::unexpected(std::move(rhs.error()));
         }
 
-        case ExprKind::BinaryExprKind: {
-            auto *bin = static_cast<const BinaryExpr *>(E);
-
-            auto lhs = build_value(bin->lhs, tb);
-            auto rhs = build_value(bin->rhs, tb);
-            if (!lhs || !rhs) {
-                return std::unexpected(std::move(lhs ? rhs.error() : lhs.error()));
+        if (bin->op == BinaryOp::Like) {
+            if (*lhs != FieldType::STRING || *rhs != FieldType::STRING) {
+                return std::unexpected("`LIKE` can only be used on string");
             }
-
-            return ValueExpr{[l = *lhs, r = *rhs, op = bin->op](
-                                 const RowView &rv) -> std::expected<Value, std::string> {
-                auto lret = l(rv);
-                auto rret = r(rv);
-                if (!lret || !rret) {
-                    return std::unexpected(std::move(rret ? lret.error() : rret.error()));
-                }
-                auto res = apply_arith(op, *lret, *rret);
-                if (!res) {
-                    return std::unexpected(std::move(res.error()));
-                }
-                return *res;
-            }};
+            emit(Op::Like, reg, reg, reg + 1);
+            return {};
         }
-
-        case ExprKind::UnaryExprKind: {
-            using UnaryOp = UnaryExpr::UnaryOp;
-            auto *un = static_cast<const UnaryExpr *>(E);
-            auto rhs = build_value(un->rhs, tb);
-            if (!rhs) {
-                return std::unexpected(std::move(rhs.error()));
-            }
-            return ValueExpr(
-                [r = *rhs, op = un->op](const RowView &rv) -> std::expected<Value, std::string> {
-                    auto rret = r(rv);
-                    if (!rret) {
-                        return std::unexpected(std::move(rret.error()));
-                    }
-                    auto rval = rret.value();
-                    if (rval.is(Table::FieldType::STRING)) {
-                        return std::unexpected("Cannot Calcutate value for `STRING`");
-                    } else if (rval.is(Table::FieldType::FLOAT)) {
-                        int64_t val = std::get<int64_t>(rval.inner);
-                        switch (op) {
-                            case UnaryOp::Add: {
-                                return rval;
-                            }
-                            case UnaryOp::Sub: {
-                                return Value(int64_t(-val));
-                            }
-                        }
-                    } else {
-                        double val = std::get<double>(rval.inner);
-                        switch (op) {
-                            case UnaryOp::Add: {
-                                return rval;
-                            }
-                            case UnaryOp::Sub: {
-                                return Value(int64_t(-val));
-                            }
-                        }
-                    }
-                    std::abort();
-                });
+        auto i = size_t(bin->op) - size_t(BinaryOp::Eq);
+        if (*lhs == FieldType::STRING && *rhs == FieldType::STRING) {
+            emit(str_ops[i], reg, reg, reg + 1);
+            return {};
         }
-
-        default: return std::unexpected("Expression not evaluatable to value");
-    }
-}
-
-std::expected<Predicate, std::string> build_predicate(const Expr *expr, const Table &tb) {
-    using BinaryOp = BinaryExpr::BinaryOp;
-    using ExprKind = Expr::ExprKind;
-    if (!expr) {
-        return Predicate{[](const RowView &) { return true; }};
+        if (!is_numeric(*lhs) || !is_numeric(*rhs)) {
+            return std::unexpected("Type mismatch in comparison");
+        }
+        auto ty = unify(*lhs, reg, *rhs, reg + 1);
+        emit(ty == FieldType::INT ? int_ops[i] : float_ops[i], reg, reg, reg + 1);
+        return {};
     }
 
-    if (expr->get_kind() == ExprKind::BinaryExprKind) {
-        auto *bin = static_cast<const BinaryExpr *>(expr);
-
-        // AND / OR
-        if (bin->op == BinaryOp::And || bin->op == BinaryOp::Or) {
-            auto lhs = build_predicate(bin->lhs, tb);
-            auto rhs = build_predicate(bin->rhs, tb);
-            if (!lhs || !rhs) {
-                return std::unexpected(lhs ? rhs.error() : lhs.error());
-            }
+public:
+    explicit ExprCompiler(const Table &tb) : tb(tb) {}
 
-            if (bin->op == BinaryOp::And) {
-                return Predicate{
-                    [l = *lhs, r = *rhs](const RowView &rv) { return l(rv) && r(rv); }};
-            } else {
-                return Predicate{
-                    [l = *lhs, r = *rhs](const RowView &rv) { return l(rv) || r(rv); }};
-            }
+    // AND `E` into the predicate, every conjunct leaves its outcome in register 0
+    std::expected<void, std::string> add_conjunct(const Expr *E) {
+        if (!prog.code.empty()) {
+            exits.push_back(prog.code.size());
+            emit(Op::JumpIfFalse, 0, 0);
         }
+        return predicate(E, 0);
+    }
 
-        // comparison
-        auto lhs = build_value(bin->lhs, tb);
-        auto rhs = build_value(bin->rhs, tb);
-        if (!lhs || !rhs) {
-            return std::unexpected(lhs ? rhs.error() : lhs.error());
+    std::expected<void, std::string> set_value(const Expr *E) {
+        auto ty = value(E, 0);
+        if (!ty) {
+            return std::unexpected(std::move(ty.error()));
         }
+        prog.result_type = *ty;
+        return {};
+    }
 
-        CmpOp cop;
-        switch (bin->op) {
-            case BinaryOp::Eq: cop = CmpOp::Eq; break;
-            case BinaryOp::Ne: cop = CmpOp::Ne; break;
-            case BinaryOp::Lt: cop = CmpOp::Lt; break;
-            case BinaryOp::Le: cop = CmpOp::Le; break;
-            case BinaryOp::Gt: cop = CmpOp::Gt; break;
-            case BinaryOp::Ge: cop = CmpOp::Ge; break;
-            case BinaryOp::Like: cop = CmpOp::Like; break;
-            default: return std::unexpected("Invalid binary operator in WHERE");
+    ExprProgram finish() {
+        for (auto at: exits) {
+            prog.code[at].imm = uint32_t(prog.code.size());
         }
+        exits.clear();
+        return std::move(prog);
+    }
+};
 
-        return Predicate{[l = *lhs, r = *rhs, cop](const RowView &rv) {
-            auto lret = l(rv);
-            auto rret = r(rv);
-            if (!lret || !rret) {
-                std::cout << (lret ? rret.error() : lret.error()) << '\n';
-                return false;
-            }
-            auto res = compare_value(*lret, *rret, cop);
-            return res && *res;
-        }};
+std::expected<ExprProgram, std::string> build_value(const Expr *E, const Table &tb) {
+    ExprCompiler comp(tb);
+    if (auto ret = comp.set_value(E); !ret) {
+        return std::unexpected(std::move(ret.error()));
     }
+    return comp.finish();
+}
 
-    return std::unexpected("Invalid WHERE expression");
+std::expected<ExprProgram, std::string> build_predicate(const Expr *E, const Table &tb) {
+    ExprCompiler comp(tb);
+    if (!E) {
+        return comp.finish();
+    }
+    if (auto ret = comp.add_conjunct(E); !ret) {
+        return std::unexpected(std::move(ret.error()));
+    }
+    return comp.finish();
 }
 
 using ValComparator = std::function<bool(const Value &, const Value &)>;
@@ -315,18 +280,18 @@ RowComparator build_comparator(std::vector<OrderByItem> obc) {
     auto value_cmp = [](const Value &a, const Value &b) -> int {
         switch (a.type) {
             case Table::FieldType::INT: {
-                auto x = std::get<int64_t>(a.inner);
-                auto y = std::get<int64_t>(b.inner);
+                auto x = *a.as_int();
+                auto y = *b.as_int();
                 return (x > y) - (x < y);
             }
             case Table::FieldType::FLOAT: {
-                auto x = std::get<double>(a.inner);
-                auto y = std::get<double>(b.inner);
+                auto x = *a.as_double();
+                auto y = *b.as_double();
                 return (x > y) - (x < y);
             }
             case Table::FieldType::STRING: {
-                auto &x = std::get<std::string>(a.inner);
-                auto &y = std::get<std::string>(b.inner);
+                auto x = *a.as_string();
+                auto y = *b.as_string();
                 if (x < y) {
                     return -1;
                 }
@@ -357,6 +322,437 @@ RowComparator build_comparator(std::vector<OrderByItem> obc) {
     };
 }
 
+std::optional<Value> literal_value(const Expr *E) {
+    using ExprKind = Expr::ExprKind;
+    switch (E->get_kind()) {
+        case ExprKind::IntLiteralKind: return Value(static_cast<const IntegerLiteral *>(E)->value);
+        case ExprKind::FloatLiteralKind: return Value(static_cast<const FloatLiteral *>(E)->value);
+        case ExprKind::StringLiteralKind:
+            return Value(static_cast<const StringLiteral *>(E)->value);
+        case ExprKind::UnaryExprKind: {
+            auto *un = static_cast<const UnaryExpr *>(E);
+            auto v = literal_value(un->rhs);
+            if (!v || v->is(FieldType::STRING) || un->op == UnaryExpr::UnaryOp::Add) {
+                return v;
+            }
+            return v->is(FieldType::INT) ? Value(int64_t(-*v->as_int())) : Value(-*v->as_double());
+        }
+        default: return std::nullopt;
+    }
+}
+
+void tighten_lo(std::optional<IndexBound> &lo, IndexBound b) {
+    if (!lo) {
+        lo = std::move(b);
+        return;
+    }
+    int c = b.key.compare(lo->key);
+    if (c > 0 || (c == 0 && !b.inclusive)) {
+        lo = std::move(b);
+    }
+}
+
+void tighten_hi(std::optional<IndexBound> &hi, IndexBound b) {
+    if (!hi) {
+        hi = std::move(b);
+        return;
+    }
+    int c = b.key.compare(hi->key);
+    if (c < 0 || (c == 0 && !b.inclusive)) {
+        hi = std::move(b);
+    }
+}
+
+// Range of the strings starting with `prefix`: [prefix, next) where `next` bumps the last
+// byte below 0xff and drops the rest, no upper bound when there is none
+std::pair<IndexBound, std::optional<IndexBound>> prefix_bounds(std::string_view prefix) {
+    std::string next(prefix);
+    while (!next.empty() && uint8_t(next.back()) == 0xff) {
+        next.pop_back();
+    }
+    if (next.empty()) {
+        return {IndexBound{Value(prefix), true}, std::nullopt};
+    }
+    next.back() = char(uint8_t(next.back()) + 1);
+    return {IndexBound{Value(prefix), true}, IndexBound{Value(next), false}};
+}
+
+IndexRange &range_of(std::vector<IndexRange> &out, size_t col) {
+    auto it = std::ranges::find_if(out, [&](auto &r) { return r.col == col; });
+    if (it == out.end()) {
+        out.push_back(IndexRange{.col = col});
+        it = out.end() - 1;
+    }
+    return *it;
+}
+
+// Columns `collect_index_ranges` gathers bounds on
+using RangeColumn = bool (*)(const Table &, size_t);
+
+bool has_ordered_index(const Table &tb, size_t col) {
+    return tb.ordered_index(col) != nullptr;
+}
+
+bool has_zone_map(const Table &tb, size_t col) {
+    return tb.get_schema()[col].type != FieldType::STRING;
+}
+
+// `col op literal` conjuncts of `E` on the `usable` columns, and `col LIKE 'abc%'` through
+// the range of its literal prefix. OR and anything else is left to the filter, which also
+// rechecks the whole LIKE pattern.
+void collect_index_ranges(const Expr *E,
+                          const Table &tb,
+                          std::vector<IndexRange> &out,
+                          RangeColumn usable = has_ordered_index) {
+    using BinaryOp = BinaryExpr::BinaryOp;
+    if (!E || !E->isa(Expr::ExprKind::BinaryExprKind)) {
+        return;
+    }
+    auto *bin = static_cast<const BinaryExpr *>(E);
+    if (bin->op == BinaryOp::And) {
+        collect_index_ranges(bin->lhs, tb, out, usable);
+        collect_index_ranges(bin->rhs, tb, out, usable);
+        return;
+    }
+
+    if (bin->op == BinaryOp::Like) {
+        if (!bin->lhs->isa(Expr::ExprKind::IdentifierExprKind) ||
+            !bin->rhs->isa(Expr::ExprKind::StringLiteralKind)) {
+            return;
+        }
+        auto col = tb.field_index(static_cast<const IdentifierExpr *>(bin->lhs)->name);
+        if (!col || !usable(tb, *col) || tb.get_schema()[*col].type != FieldType::STRING) {
+            return;
+        }
+        auto pattern = static_cast<const StringLiteral *>(bin->rhs)->value;
+        auto prefix = pattern.substr(0, pattern.find_first_of("%_\\"));
+        if (prefix.empty()) {
+            return;
+        }
+        auto &range = range_of(out, *col);
+        if (prefix.size() == pattern.size()) {
+            // No wildcard, LIKE is plain equality
+            tighten_lo(range.lo, {Value(prefix), true});
+            tighten_hi(range.hi, {Value(prefix), true});
+            return;
+        }
+        auto [lo, hi] = prefix_bounds(prefix);
+        tighten_lo(range.lo, std::move(lo));
+        if (hi) {
+            tighten_hi(range.hi, std::move(*hi));
+        }
+        return;
+    }
+
+    auto op = bin->op;
+    const Expr *col_expr = bin->lhs;
+    auto lit = literal_value(bin->rhs);
+    if (!lit) {
+        // literal on the left, mirror the operator
+        col_expr = bin->rhs;
+        lit = literal_value(bin->lhs);
+        switch (op) {
+            case BinaryOp::Lt: op = BinaryOp::Gt; break;
+            case BinaryOp::Le: op = BinaryOp::Ge; break;
+            case BinaryOp::Gt: op = BinaryOp::Lt; break;
+            case BinaryOp::Ge: op = BinaryOp::Le; break;
+            default: break;
+        }
+    }
+    bool bounds = op == BinaryOp::Eq || op == BinaryOp::Lt || op == BinaryOp::Le ||
+                  op == BinaryOp::Gt || op == BinaryOp::Ge;
+    if (!bounds || !lit || !col_expr->isa(Expr::ExprKind::IdentifierExprKind)) {
+        return;
+    }
+    auto col = tb.field_index(static_cast<const IdentifierExpr *>(col_expr)->name);
+    if (!col || !usable(tb, *col)) {
+        return;
+    }
+    // Mixed string/number comparisons never match, leave them to the filter
+    bool col_is_str = tb.get_schema()[*col].type == FieldType::STRING;
+    if (col_is_str != lit->is(FieldType::STRING)) {
+        return;
+    }
+
+    auto it = &range_of(out, *col);
+    switch (op) {
+        case BinaryOp::Eq:
+            if (col_is_str) {
+                tighten_lo(it->lo, {*lit, true});
+                tighten_hi(it->hi, {*lit, true});
+            } else {
+                // Numbers within `ExprProgram::EPS` compare equal
+                double x = lit->is(FieldType::INT) ? double(*lit->as_int()) : *lit->as_double();
+                tighten_lo(it->lo, {Value(x - ExprProgram::EPS), true});
+                tighten_hi(it->hi, {Value(x + ExprProgram::EPS), true});
+            }
+            break;
+        case BinaryOp::Lt: tighten_hi(it->hi, {*lit, false}); break;
+        case BinaryOp::Le: tighten_hi(it->hi, {*lit, true}); break;
+        case BinaryOp::Gt: tighten_lo(it->lo, {*lit, false}); break;
+        case BinaryOp::Ge: tighten_lo(it->lo, {*lit, true}); break;
+        default: std::abort();
+    }
+}
+
+// First `col = literal` conjunct of `E` on a hash indexed column. Only exact INT/INT and
+// STRING/STRING pairs qualify, anything that goes through the EPS comparison cannot be hashed.
+std::optional<std::pair<size_t, Value>> find_hash_key(const Expr *E, const Table &tb) {
+    using BinaryOp = BinaryExpr::BinaryOp;
+    if (!E || !E->isa(Expr::ExprKind::BinaryExprKind)) {
+        return std::nullopt;
+    }
+    auto *bin = static_cast<const BinaryExpr *>(E);
+    if (bin->op == BinaryOp::And) {
+        if (auto key = find_hash_key(bin->lhs, tb)) {
+            return key;
+        }
+        return find_hash_key(bin->rhs, tb);
+    }
+    if (bin->op != BinaryOp::Eq) {
+        return std::nullopt;
+    }
+    const Expr *col_expr = bin->lhs;
+    auto lit = literal_value(bin->rhs);
+    if (!lit) {
+        col_expr = bin->rhs;
+        lit = literal_value(bin->lhs);
+    }
+    if (!lit || !col_expr->isa(Expr::ExprKind::IdentifierExprKind)) {
+        return std::nullopt;
+    }
+    auto col = tb.field_index(static_cast<const IdentifierExpr *>(col_expr)->name);
+    if (!col || !tb.hash_index(*col) || !lit->is(tb.get_schema()[*col].type)) {
+        return std::nullopt;
+    }
+    return std::pair{*col, std::move(*lit)};
+}
+
+// Top level AND operands of `E`
+void collect_conjuncts(const Expr *E, std::vector<const Expr *> &out) {
+    if (!E) {
+        return;
+    }
+    if (E->isa(Expr::ExprKind::BinaryExprKind)) {
+        auto *bin = static_cast<const BinaryExpr *>(E);
+        if (bin->op == BinaryExpr::BinaryOp::And) {
+            collect_conjuncts(bin->lhs, out);
+            collect_conjuncts(bin->rhs, out);
+            return;
+        }
+    }
+    out.push_back(E);
+}
+
+// `col = 'lit'`, `col != 'lit'` or `col LIKE 'pattern'` on a dictionary encoded column
+std::optional<DictFilter> dict_filter_of(const Expr *E, const Table &tb) {
+    using BinaryOp = BinaryExpr::BinaryOp;
+    if (!E->isa(Expr::ExprKind::BinaryExprKind)) {
+        return std::nullopt;
+    }
+    auto *bin = static_cast<const BinaryExpr *>(E);
+    if (bin->op != BinaryOp::Eq && bin->op != BinaryOp::Ne && bin->op != BinaryOp::Like) {
+        return std::nullopt;
+    }
+    const Expr *col_expr = bin->lhs;
+    const Expr *lit_expr = bin->rhs;
+    if (bin->op != BinaryOp::Like && !col_expr->isa(Expr::ExprKind::IdentifierExprKind)) {
+        std::swap(col_expr, lit_expr);
+    }
+    if (!col_expr->isa(Expr::ExprKind::IdentifierExprKind) ||
+        !lit_expr->isa(Expr::ExprKind::StringLiteralKind)) {
+        return std::nullopt;
+    }
+    auto &name = static_cast<const IdentifierExpr *>(col_expr)->name;
+    auto col = tb.field_index(name);
+    if (!col || !tb.get_schema()[*col].dict) {
+        return std::nullopt;
+    }
+    std::string lit(static_cast<const StringLiteral *>(lit_expr)->value);
+    DictFilter f{.col = *col};
+    switch (bin->op) {
+        case BinaryOp::Eq:
+            f.text = std::format("{} = '{}'", name, lit);
+            f.match = [lit](std::string_view s) { return s == lit; };
+            break;
+        case BinaryOp::Ne:
+            f.text = std::format("{} != '{}'", name, lit);
+            f.match = [lit](std::string_view s) { return s != lit; };
+            break;
+        default:
+            f.text = std::format("{} like '{}'", name, lit);
+            f.match = [lit](std::string_view s) { return utils::strlike(s, lit); };
+            break;
+    }
+    return f;
+}
+
+std::string literal_text(const Value &v) {
+    switch (v.type) {
+        case FieldType::INT: return std::format("{}", *v.as_int());
+        case FieldType::FLOAT: return std::format("{}", *v.as_double());
+        case FieldType::STRING: return std::format("'{}'", *v.as_string());
+    }
+    std::abort();
+}
+
+// Operator of a comparison with its operands swapped
+CmpOp mirror(CmpOp op) {
+    switch (op) {
+        case CmpOp::Lt: return CmpOp::Gt;
+        case CmpOp::Le: return CmpOp::Ge;
+        case CmpOp::Gt: return CmpOp::Lt;
+        case CmpOp::Ge: return CmpOp::Le;
+        default: return op;
+    }
+}
+
+constexpr const char *cmp_text[] = {"=", "!=", "<", "<=", ">", ">="};
+
+// Numeric `col op literal` comparisons joined by AND / OR, tested with bitmaps
+std::optional<BitmapFilter> bitmap_filter_of(const Expr *E, const Table &tb) {
+    using BinaryOp = BinaryExpr::BinaryOp;
+    using ExprKind = Expr::ExprKind;
+    if (!E->isa(ExprKind::BinaryExprKind)) {
+        return std::nullopt;
+    }
+    auto *bin = static_cast<const BinaryExpr *>(E);
+    if (bin->op == BinaryOp::And || bin->op == BinaryOp::Or) {
+        auto lhs = bitmap_filter_of(bin->lhs, tb);
+        auto rhs = lhs ? bitmap_filter_of(bin->rhs, tb) : std::nullopt;
+        if (!rhs) {
+            return std::nullopt;
+        }
+        BitmapFilter f{.kind = bin->op == BinaryOp::And ? BitmapFilter::Kind::And
+                                                        : BitmapFilter::Kind::Or};
+        f.text = std::format("({} {} {})",
+                             lhs->text,
+                             bin->op == BinaryOp::And ? "and" : "or",
+                             rhs->text);
+        f.operands.push_back(std::move(*lhs));
+        f.operands.push_back(std::move(*rhs));
+        return f;
+    }
+    if (bin->op < BinaryOp::Eq || bin->op > BinaryOp::Ge) {
+        return std::nullopt;
+    }
+    auto op = CmpOp(size_t(bin->op) - size_t(BinaryOp::Eq));
+    const Expr *col_expr = bin->lhs;
+    auto lit = literal_value(bin->rhs);
+    if (!lit) {
+        col_expr = bin->rhs;
+        lit = literal_value(bin->lhs);
+        op = mirror(op);
+    }
+    if (!lit || lit->is(FieldType::STRING) || !col_expr->isa(ExprKind::IdentifierExprKind)) {
+        return std::nullopt;
+    }
+    auto &name = static_cast<const IdentifierExpr *>(col_expr)->name;
+    auto col = tb.field_index(name);
+    if (!col || tb.get_schema()[*col].type == FieldType::STRING) {
+        return std::nullopt;
+    }
+    BitmapFilter f{.col = *col, .op = op};
+    f.int_col = tb.get_schema()[*col].type == FieldType::INT;
+    f.int_cmp = f.int_col && lit->is(FieldType::INT);
+    if (f.int_cmp) {
+        f.int_lit = *lit->as_int();
+    } else {
+        f.double_lit = lit->is(FieldType::INT) ? double(*lit->as_int()) : *lit->as_double();
+    }
+    f.text = std::format("{} {} {}", name, cmp_text[size_t(op)], literal_text(*lit));
+    return f;
+}
+
+// `col op literal`, `literal op col` or `col op col` comparison with a typed kernel. Mixed
+// string/number comparisons are left to `ExprCompiler`, which reports them.
+std::optional<CompareKernel> compare_kernel_of(const Expr *E, const Table &tb) {
+    using BinaryOp = BinaryExpr::BinaryOp;
+    using ExprKind = Expr::ExprKind;
+    if (!E->isa(ExprKind::BinaryExprKind)) {
+        return std::nullopt;
+    }
+    auto *bin = static_cast<const BinaryExpr *>(E);
+    if (bin->op < BinaryOp::Eq || bin->op > BinaryOp::Ge) {
+        return std::nullopt;
+    }
+    auto op = CmpOp(size_t(bin->op) - size_t(BinaryOp::Eq));
+    const Expr *lhs = bin->lhs;
+    const Expr *rhs = bin->rhs;
+    if (!lhs->isa(ExprKind::IdentifierExprKind)) {
+        // literal on the left, mirror the operator
+        std::swap(lhs, rhs);
+        op = mirror(op);
+    }
+    if (!lhs->isa(ExprKind::IdentifierExprKind)) {
+        return std::nullopt;
+    }
+    auto &lname = static_cast<const IdentifierExpr *>(lhs)->name;
+    auto lcol = tb.field_index(lname);
+    if (!lcol) {
+        return std::nullopt;
+    }
+    auto lty = tb.get_schema()[*lcol].type;
+
+    CompareKernel k{.lhs = *lcol};
+    if (rhs->isa(ExprKind::IdentifierExprKind)) {
+        auto &rname = static_cast<const IdentifierExpr *>(rhs)->name;
+        auto rcol = tb.field_index(rname);
+        if (!rcol) {
+            return std::nullopt;
+        }
+        k.fn = CompareKernel::pick<true>(op, lty, tb.get_schema()[*rcol].type);
+        k.rhs = *rcol;
+        k.rhs_is_col = true;
+        k.text = std::format("{} {} {}", lname, cmp_text[size_t(op)], rname);
+    } else if (auto lit = literal_value(rhs)) {
+        k.fn = CompareKernel::pick<false>(op, lty, lit->type);
+        k.text = std::format("{} {} {}", lname, cmp_text[size_t(op)], literal_text(*lit));
+        k.lit = std::move(*lit);
+    }
+    if (!k.fn) {
+        return std::nullopt;
+    }
+    return k;
+}
+
+// Trigram lookup for a LIKE conjunct of `E`
+struct TrigramProbe {
+    size_t col;
+    std::string pattern;
+    std::vector<Table::TrigramIndex::Gram> grams;
+};
+
+// First `col LIKE 'pattern'` conjunct of `E` on a trigram indexed column whose pattern has
+// at least one literal run of 3 bytes
+std::optional<TrigramProbe> find_trigram_probe(const Expr *E, const Table &tb) {
+    using BinaryOp = BinaryExpr::BinaryOp;
+    if (!E || !E->isa(Expr::ExprKind::BinaryExprKind)) {
+        return std::nullopt;
+    }
+    auto *bin = static_cast<const BinaryExpr *>(E);
+    if (bin->op == BinaryOp::And) {
+        if (auto probe = find_trigram_probe(bin->lhs, tb)) {
+            return probe;
+        }
+        return find_trigram_probe(bin->rhs, tb);
+    }
+    if (bin->op != BinaryOp::Like || !bin->lhs->isa(Expr::ExprKind::IdentifierExprKind) ||
+        !bin->rhs->isa(Expr::ExprKind::StringLiteralKind)) {
+        return std::nullopt;
+    }
+    auto col = tb.field_index(static_cast<const IdentifierExpr *>(bin->lhs)->name);
+    if (!col || !tb.trigram_index(*col)) {
+        return std::nullopt;
+    }
+    std::string pattern(static_cast<const StringLiteral *>(bin->rhs)->value);
+    auto grams = Table::TrigramIndex::pattern_grams(pattern);
+    if (grams.empty()) {
+        return std::nullopt;
+    }
+    return TrigramProbe{*col, std::move(pattern), std::move(grams)};
+}
+
 }  // namespace
 
 class PlanBuilder : public ASTVisitor<PlanBuilder> {
@@ -439,7 +835,14 @@ public:
 
         curr_tbl = it->second;
 
-        current = ctx.make_plan<TableScanPlan>(it->second);
+        // A SELECT behind a write of the same batch has to see that write
+        const bool pinned = ctx.snapshot_reads && !ctx.has_writes;
+        TableScanPlan *full_scan = nullptr;
+        if (pinned) {
+            current = ctx.make_plan<SnapshotScanPlan>(it->first, curr_tbl->snapshot());
+        } else {
+            current = full_scan = ctx.make_plan<TableScanPlan>(it->second);
+        }
 
         // 2. WHERE
         where_expr = S->cond;
@@ -447,6 +850,8 @@ public:
         // 3. Parse SELECT LIST
         std::vector<ProjectItem> project_items{};
         std::vector<AggregateItem> agg_items{};
+        std::vector<std::string> project_names{};
+        std::vector<std::string> agg_names{};
         for (auto *expr: S->select_list) {
             using EK = Expr::ExprKind;
 
@@ -463,12 +868,15 @@ public:
                     .kind = ProjectItem::Col,
                     .col = *idx,
                 });
+                project_names.emplace_back(id->name);
                 continue;
             }
 
             if (expr->isa(EK::CallExprKind)) {
                 auto *call = static_cast<const CallExpr *>(expr);
                 has_aggregate = true;
+                auto [name_b, name_e] = call->src_range();
+                agg_names.emplace_back(src.substr(name_b, name_e - name_b));
 
                 AggKind kind;
                 if (call->callee->name == "avg")
@@ -553,15 +961,101 @@ public:
             }
         }
 
-        // 5. WHERE -> FilterPlan
-        if (where_expr) {
-            auto pred = build_predicate(where_expr, *curr_tbl);
-            if (!pred.has_value()) {
-                auto [b, e] = where_expr->src_range();
-                diags.emplace_back(emit_error(pred.error(), b, e));
-                return false;
+        // 5. Access path: a hash lookup when WHERE pins a hash indexed column, otherwise an
+        //    index range scan when it bounds an indexed column, which also serves a single
+        //    key ORDER BY on the same column, otherwise trigram candidates for a LIKE.
+        //    Indexes follow the live table, a snapshot is always scanned.
+        auto hash_key = pinned ? std::nullopt : find_hash_key(where_expr, *curr_tbl);
+        auto trigram = pinned ? std::nullopt : find_trigram_probe(where_expr, *curr_tbl);
+        std::vector<IndexRange> ranges;
+        if (!pinned) {
+            collect_index_ranges(where_expr, *curr_tbl, ranges);
+        }
+        std::optional<size_t> sort_col;
+        bool sort_asc = true;
+        if (S->sort && S->sort->keys.size() == 1 && !has_aggregate && !pinned) {
+            sort_col = curr_tbl->field_index(S->sort->keys[0].column);
+            sort_asc = S->sort->keys[0].asc;
+            if (sort_col && !curr_tbl->ordered_index(*sort_col)) {
+                sort_col.reset();
+            }
+        }
+        bool sorted_by_index = false;
+        if (hash_key) {
+            current = ctx.make_plan<HashLookupPlan>(curr_tbl,
+                                                    hash_key->first,
+                                                    std::move(hash_key->second));
+        } else if (!ranges.empty()) {
+            auto it = std::ranges::find_if(ranges, [&](auto &r) { return r.col == sort_col; });
+            auto &range = it != ranges.end() ? *it : ranges.front();
+            sorted_by_index = range.col == sort_col;
+            current = ctx.make_plan<IndexScanPlan>(curr_tbl,
+                                                   range.col,
+                                                   std::move(range.lo),
+                                                   std::move(range.hi),
+                                                   sorted_by_index && !sort_asc);
+        } else if (trigram) {
+            current = ctx.make_plan<TrigramScanPlan>(curr_tbl,
+                                                     trigram->col,
+                                                     std::move(trigram->pattern),
+                                                     std::move(trigram->grams));
+        } else if (sort_col) {
+            sorted_by_index = true;
+            current = ctx.make_plan<IndexScanPlan>(curr_tbl,
+                                                   *sort_col,
+                                                   std::nullopt,
+                                                   std::nullopt,
+                                                   !sort_asc);
+        }
+
+        // 5b. Full scans test string conjuncts on dictionary columns by code, these are
+        //     settled by the scan and dropped from the filter
+        std::vector<const Expr *> conjuncts;
+        collect_conjuncts(where_expr, conjuncts);
+        if (current->scan_source()) {
+            std::vector<DictFilter> dict_filters;
+            std::erase_if(conjuncts, [&](const Expr *E) {
+                auto f = dict_filter_of(E, *curr_tbl);
+                if (f) {
+                    dict_filters.push_back(std::move(*f));
+                }
+                return f.has_value();
+            });
+            if (!dict_filters.empty()) {
+                current = ctx.make_plan<DictScanPlan>(curr_tbl, std::move(dict_filters));
+            }
+        }
+
+        // 5c. A plain full scan skips the blocks whose zone maps rule out a numeric bound,
+        //     the filter still checks every row it reads
+        if (current == full_scan && full_scan) {
+            std::vector<IndexRange> zone_ranges;
+            collect_index_ranges(where_expr, *curr_tbl, zone_ranges, has_zone_map);
+            full_scan->set_zone_ranges(std::move(zone_ranges));
+        }
+
+        // 6. WHERE -> FilterPlan
+        //    Numeric comparisons against literals are tested on whole batches with bitmaps,
+        //    other plain comparisons get a kernel typed for their columns, the rest is
+        //    compiled into one program
+        if (!conjuncts.empty()) {
+            std::vector<BitmapFilter> bitmaps;
+            std::vector<CompareKernel> kernels;
+            ExprCompiler comp(*curr_tbl);
+            for (auto *E: conjuncts) {
+                if (auto f = bitmap_filter_of(E, *curr_tbl)) {
+                    bitmaps.push_back(std::move(*f));
+                } else if (auto k = compare_kernel_of(E, *curr_tbl)) {
+                    kernels.push_back(std::move(*k));
+                } else if (auto ret = comp.add_conjunct(E); !ret) {
+                    auto [b, e] = E->src_range();
+                    diags.emplace_back(emit_error(ret.error(), b, e));
+                    return false;
+                }
             }
-            auto *filter = ctx.make_plan<FilterPlan>(std::move(*pred));
+            auto *filter = ctx.make_plan<FilterPlan>(std::move(bitmaps),
+                                                     std::move(kernels),
+                                                     comp.finish());
             filter->child.push_back(current);
             current = filter;
         }
@@ -573,7 +1067,7 @@ public:
         }
 
         // 9. ORDER BY
-        if (S->sort) {
+        if (S->sort && !sorted_by_index) {
             auto items = parse_orderby_clause(*S->sort);
             if (!items.has_value()) {
                 diags.emplace_back(std::move(items.error()));
@@ -592,6 +1086,7 @@ public:
                 index.resize(N);
                 for (size_t i = 0; i < N; ++i) {
                     index[i] = {.kind = ProjectItem::Col, .col = i};
+                    project_names.push_back(curr_tbl->get_schema()[i].name);
                 }
             } else {
                 index = project_items;
@@ -600,12 +1095,14 @@ public:
             proj->child.push_back(current);
             current = proj;
         }
+        ctx.output_columns = has_aggregate ? std::move(agg_names) : std::move(project_names);
 
         // 9. Output
         return false;
     }
 
     bool visitInsert(const InsertStmt *S) {
+        ctx.has_writes = true;
         auto it = ctx.tb_view.find(S->tb_name->name);
         if (it == ctx.tb_view.end()) {
             auto [B, E] = S->tb_name->src_range();
@@ -685,6 +1182,7 @@ public:
     }
 
     bool visitUpdate(const UpdateStmt *S) {
+        ctx.has_writes = true;
         // Find table
         auto it = ctx.tb_view.find(S->tb_name->name);
         if (it == ctx.tb_view.end()) {
@@ -696,9 +1194,7 @@ public:
         Table *tbl = it->second;
 
         // WHERE predicate
-        Predicate pred = [](const RowView &) {
-            return true;
-        };
+        Predicate pred;
         if (S->cond) {
             auto p = build_predicate(S->cond, *tbl);
             if (!p) {
@@ -737,7 +1233,44 @@ public:
         return true;
     }
 
+    bool visitCreateIndex(const CreateIndexStmt *S) {
+        ctx.has_writes = true;
+        auto it = ctx.tb_view.find(S->tb_name->name);
+        if (it == ctx.tb_view.end()) {
+            auto [B, E] = S->tb_name->src_range();
+            diags.emplace_back(emit_error("unknown table", B, E));
+            return false;
+        }
+
+        Table *tbl = it->second;
+        auto idx = tbl->field_index(S->column->name);
+        if (!idx) {
+            auto [B, E] = S->column->src_range();
+            diags.emplace_back(emit_error("unknown column", B, E));
+            return false;
+        }
+
+        auto kind = Table::IndexKind::Ordered;
+        if (S->method) {
+            auto m = S->method->name;
+            if (m == "hash") {
+                kind = Table::IndexKind::Hash;
+            } else if (m == "trigram") {
+                kind = Table::IndexKind::Trigram;
+            } else if (m != "ordered" && m != "btree") {
+                auto [B, E] = S->method->src_range();
+                diags.emplace_back(emit_error("unknown index method", B, E));
+                return false;
+            }
+        }
+
+        logging::debug("Emit CreateIndexPlan");
+        current = ctx.make_plan<CreateIndexPlan>(tbl, *idx, kind);
+        return true;
+    }
+
     bool visitDelete(const DeleteStmt *S) {
+        ctx.has_writes = true;
         // 1. Find table
         logging::debug("Visit DeleteStmt");
         auto it = ctx.tb_view.find(S->tb_name->name);
@@ -750,9 +1283,7 @@ public:
         Table *tbl = it->second;
 
         // 2. Build WHERE predicate
-        Predicate pred = [](const RowView &) {
-            return true;
-        };
+        Predicate pred;
         if (S->cond) {
             auto p = build_predicate(S->cond, *tbl);
             if (!p) {
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "table.h"
+#include "misc.h"
+
+#include <memory>
+#include <string>
+#include <fstream>
+#include <optional>
+#include <vector>
+#include <expected>
+#include <string_view>
+
+namespace gpamgr::bulk {
+
+// Parse CSV text into cells laid out row after row, typed by the schema of `tb`.
+// The text is split at record boundaries and parsed on up to `--import-threads` workers.
+// A first line holding the field names is skipped. Fields may be quoted with `"`, a quote
+// inside is written as `""`, quoted fields may span lines.
+std::expected<std::vector<Table::Value>, std::string> parse_csv(const Table &tb,
+                                                                 std::string_view text);
+
+// Same as `parse_csv` on the content of file `path`
+std::expected<std::vector<Table::Value>, std::string> read_csv(const Table &tb,
+                                                               std::string_view path);
+
+enum class ExportFormat { CSV, TSV, JSONL };
+
+std::optional<ExportFormat> export_format_of(std::string_view name);
+
+// Formats rows as plain text into large blocks handed to a writer thread. CSV and TSV files
+// start with a line of column names, JSONL rows are objects keyed by them.
+class Exporter {
+    ExportFormat format;
+    std::vector<std::string> columns;
+    std::ofstream ofs;
+    utils::BlockWriter out;
+    size_t rows = 0;
+
+    Exporter(std::string_view path, ExportFormat format, std::vector<std::string> columns);
+
+    void put_string(std::string &buf, std::string_view s) const;
+    void put_value(std::string &buf, const Table::Value &v) const;
+
+public:
+    static std::expected<std::unique_ptr<Exporter>, std::string>
+        open(std::string_view path, ExportFormat format, std::vector<std::string> columns);
+
+    void write_row(std::span<const Table::Value> cells);
+
+    // Flush the file, returns the number of rows written
+    std::expected<size_t, std::string> finish();
+};
+
+}  // namespace gpamgr::bulk
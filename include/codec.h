@@ -0,0 +1,41 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Lightweight encodings for the columns of packed table files. Every encoder appends to a
+// byte string and every decoder returns the number of bytes it consumed, or nullopt when
+// the input is truncated or corrupted. Decoding is made of plain loops without branches on
+// the data, so they vectorize and load time stays close to a copy.
+namespace gpamgr::codec {
+
+// Integers are stored in blocks of `BLOCK` values. A block keeps either the offsets of its
+// values from their minimum (frame of reference), or the offsets of the differences between
+// consecutive values from the smallest difference, whichever packs into fewer bits. Sorted
+// columns such as rowids and primary keys take the second form and often need 0-2 bits.
+constexpr size_t BLOCK = 1024;
+
+void put_ints(std::string &out, std::span<const int64_t> values);
+std::optional<size_t> get_ints(std::string_view in, std::span<int64_t> out);
+
+// Doubles with at most `MAX_DECIMALS` fraction digits are scaled to integers and stored like
+// `put_ints`, a column with any other value is stored as raw doubles
+constexpr unsigned MAX_DECIMALS = 4;
+
+void put_doubles(std::string &out, std::span<const double> values);
+std::optional<size_t> get_doubles(std::string_view in, std::span<double> out);
+
+// Front coding, every string keeps the length of the prefix it shares with the previous one
+// and its remaining bytes. Decodes into the offsets, lengths and heap of a plain column.
+void put_strings(std::string &out, std::span<const std::string_view> values);
+std::optional<size_t> get_strings(std::string_view in,
+                                  size_t n,
+                                  std::vector<uint64_t> &offsets,
+                                  std::vector<uint32_t> &lengths,
+                                  std::string &heap);
+
+}  // namespace gpamgr::codec
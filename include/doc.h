@@ -32,6 +32,8 @@ A table consists of:
 - A schema (column name + type)
 - A set of rows stored in memory
 - Optional indexes on selected columns
+- The range of each INT and FLOAT column per block of 1024 rows,
+  a scan skips the blocks a WHERE bound rules out
 
 Supported column types:
 - INT      : signed integer
@@ -66,6 +68,10 @@ Examples:
   FROM student_scores
   WHERE math >= 60;
 
+With `--snapshot-reads` a SELECT scans a pinned version of the
+table instead of its indexes. Writes made by other sessions
+while it runs are not seen and do not wait for it.
+
 ------------------------------------------------------------
 
 3.2 WHERE Clause
@@ -151,6 +157,32 @@ Example:
 
 ------------------------------------------------------------
 
+4.4 CREATE INDEX
+------------------------------------------------------------
+Syntax:
+
+  CREATE INDEX ON table_name (column) [USING method];
+
+Builds an index on the column, `method` is one of:
+
+  ordered  (default) SELECT uses it for range predicates
+           (=, <, <=, >, >=) against literals, for LIKE
+           patterns with a literal prefix such as 'Zhang%',
+           and for ORDER BY on that single column.
+  hash     SELECT uses it for `column = literal`. Only INT and
+           STRING columns can be hashed.
+  trigram  SELECT uses it for `column LIKE 'pattern'` when the
+           pattern has 3 or more characters between wildcards,
+           e.g. '%wei%'. Only STRING columns.
+
+Example:
+
+  CREATE INDEX ON student_scores (math);
+  CREATE INDEX ON student_scores (name) USING hash;
+  CREATE INDEX ON student_scores (name) USING trigram;
+
+------------------------------------------------------------
+
 5. Literals
 ------------------------------------------------------------
 
@@ -198,13 +230,23 @@ Each plan node:
 - Reads and writes intermediate results via ExecContext
 - Is executed sequentially
 
+Rows flow between plan nodes in batches of up to 1024. A filter does not
+copy the rows it keeps, it narrows the selection vector of the batch.
+Numeric comparisons against literals (e.g. physics < 60), and AND / OR
+of them, are tested on a whole batch with SIMD kernels (AVX2 or SSE4.2
+when the CPU has them) that produce bitmaps. AVG, MIN, MAX and COUNT on
+the same column are computed together in one pass by SIMD reductions.
+
 ------------------------------------------------------------
 
 7. Error Handling
 ------------------------------------------------------------
 - Lexical errors are detected during tokenization
 - Syntax errors are reported during parsing
-- Execution errors are reported at runtime
+- Type errors in expressions (e.g. comparing a STRING with a number)
+  are reported when the statement is planned
+- Execution errors (e.g. division by zero) are reported at runtime
+  and stop the statement
 
 Error messages include precise source positions when possible.
 
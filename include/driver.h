@@ -3,9 +3,13 @@
 #include "table.h"
 
 #include <map>
+#include <mutex>
+#include <chrono>
 #include <string>
 #include <memory>
+#include <thread>
 #include <string_view>
+#include <condition_variable>
 
 namespace gpamgr {
 
@@ -14,6 +18,8 @@ class ScriptDriver {
 
     Table *curr_tbl = nullptr;
     std::map<std::string, std::unique_ptr<Table>> tb_pool;
+    // Dropped tables whose checkpoint is still being written by the flusher
+    std::vector<std::unique_ptr<Table>> retired;
 
 public:
     enum class CommandStat : short {
@@ -60,13 +66,66 @@ public:
 
     void debug_dump();
 
+    struct FlushState {
+        bool running = false;
+        size_t rounds = 0;
+        size_t appends = 0;
+        size_t checkpoints = 0;
+        size_t failures = 0;
+        std::string last_error;
+        // Table whose image is being written right now
+        std::string busy;
+        std::chrono::steady_clock::time_point last_flush{};
+    };
+
+    // Checkpoint dirty tables on a background thread, following `--flush-every`,
+    // `--flush-interval-ms` and `--flush-memory-mb`. While it runs tables must only be
+    // touched through `do_command`.
+    void start_flusher();
+    void stop_flusher();
+    // Flush every table, handed to the flusher when it runs
+    void flush_tables();
+    FlushState flush_state();
+
+    // Compact table `name`, every table when it is empty. Returns the slots reclaimed.
+    std::expected<size_t, std::string> vacuum(std::string_view name = {});
+    // Recompute the column statistics of table `name`, every table when it is empty.
+    // Returns the number of tables analyzed.
+    std::expected<size_t, std::string> analyze(std::string_view name = {});
+
+    // Append the rows of CSV file `path` to table `name`, the current table when it is empty.
+    // Either every row is inserted or none. Returns the number of rows.
+    std::expected<size_t, std::string> import_csv(std::string_view path,
+                                                  std::string_view name = {});
+    // Write the rows of `sql`, the whole current table when it is empty, to `path` as
+    // `csv`, `tsv` or `jsonl`. Returns the number of rows.
+    std::expected<size_t, std::string>
+        export_rows(std::string_view format, std::string_view path, std::string_view sql = {});
+
     ~ScriptDriver();
 
 private:
+    // Held by `do_command` and by the flusher except while it writes an image
+    std::mutex tb_mutex;
+    std::condition_variable flush_cv;
+    std::thread flusher;
+    bool flusher_stop = false;
+    bool flush_requested = false;
+    size_t stmts_since_flush = 0;
+    FlushState flush_stat;
+
+    void flusher_loop();
+    void flush_round(std::unique_lock<std::mutex> &lock);
+    void note_command();
+    // Compact the tables past `--vacuum-dead-percent`, run between commands
+    void auto_vacuum();
+
+    // `lock` holds `tb_mutex`, a read-only batch on snapshots releases it early
+    CommandRet dispatch(std::string_view cmd, std::unique_lock<std::mutex> &lock);
     // // For batch execution, unused now
     // void flush_sql();
     CommandRet handle_pseudo(std::string_view);
-    CommandRet handle_sql(std::string_view);
+    CommandRet handle_sql(std::string_view, std::unique_lock<std::mutex> &lock);
 };
 
 using CommandStat = ScriptDriver::CommandStat;
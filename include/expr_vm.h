@@ -0,0 +1,129 @@
+#pragma once
+
+#include "table.h"
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <expected>
+#include <string_view>
+
+// Register based bytecode for WHERE, SET and select expressions. Column types are known when
+// a statement is planned, so the compiler picks a typed opcode for every node (`AddI`,
+// `LtF`, `Like`, ...) and reports type errors before anything runs. The interpreter is one
+// switch over a flat instruction array, registers are plain unions on the stack and nothing
+// is allocated while a row is evaluated.
+namespace gpamgr {
+
+struct ExprProgram {
+    using Value = Table::Value;
+    using FieldType = Table::FieldType;
+
+    // Numbers closer than this compare equal, integers compare exactly
+    static constexpr double EPS = 1e-6;
+    static constexpr size_t MAX_REGS = 32;
+
+    enum class Op : uint8_t {
+        // dst <- cell `imm` of the row
+        ColI,
+        ColF,
+        ColS,
+        // dst <- consts[imm]
+        ConstI,
+        ConstF,
+        ConstS,
+        // dst <- double(a)
+        IntToFloat,
+        // dst <- a op b
+        AddI,
+        SubI,
+        MulI,
+        DivI,
+        AddF,
+        SubF,
+        MulF,
+        DivF,
+        // dst <- -a
+        NegI,
+        NegF,
+        // dst <- a cmp b, a boolean
+        EqI,
+        NeI,
+        LtI,
+        LeI,
+        GtI,
+        GeI,
+        EqF,
+        NeF,
+        LtF,
+        LeF,
+        GtF,
+        GeF,
+        EqS,
+        NeS,
+        LtS,
+        LeS,
+        GtS,
+        GeS,
+        Like,
+        // Continue at `imm` when the boolean `a` is false / true, AND and OR short circuit
+        JumpIfFalse,
+        JumpIfTrue,
+    };
+
+    // Runtime failures are codes, the message is built once by whoever reports it
+    enum class Error : uint8_t {
+        None,
+        DivisionByZero,
+    };
+
+    struct Insn {
+        Op op;
+        uint8_t dst = 0;
+        uint8_t a = 0;
+        uint8_t b = 0;
+        uint32_t imm = 0;
+    };
+
+    union Reg {
+        int64_t i;
+        double d;
+        bool b;
+        struct {
+            const char *data;
+            size_t size;
+        } s;
+    };
+
+    std::vector<Insn> code;
+    std::vector<Value> consts;
+    // Register and type of the result, a predicate leaves a boolean in `result`
+    uint8_t result = 0;
+    FieldType result_type = FieldType::INT;
+
+    // A program without instructions is the predicate that accepts every row
+    bool empty() const {
+        return code.empty();
+    }
+
+    // Evaluate a predicate, a failure rejects the row and is written to `err`
+    bool test(std::span<const Value> cols, Error &err) const {
+        if (code.empty()) {
+            return true;
+        }
+        Reg regs[MAX_REGS];
+        err = run(cols, regs);
+        return err == Error::None && regs[result].b;
+    }
+
+    // Evaluate a value expression into a new cell
+    std::expected<Value, Error> value(std::span<const Value> cols) const;
+
+    static std::string_view error_message(Error err);
+
+private:
+    Error run(std::span<const Value> cols, Reg *regs) const;
+};
+
+}  // namespace gpamgr
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <iostream>
 #include <sstream>
 #include <cassert>
 #include <format>
+#include <functional>
+#include <memory>
+#include <expected>
+#include <string_view>
+#include <condition_variable>
 
 namespace utils {
 class StyledText {
@@ -162,6 +170,119 @@ private:
 };
 
 bool strlike(std::string_view s, std::string_view p);
+
+// Read-only view of a whole file, backed by `mmap` so pages are only read when touched
+class MappedFile {
+    const char *base = nullptr;
+    size_t length = 0;
+    // Fallback copy on platforms without `mmap`
+    std::string buffer;
+
+    MappedFile() = default;
+
+public:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator= (const MappedFile &) = delete;
+    ~MappedFile();
+
+    static std::expected<std::shared_ptr<const MappedFile>, std::string>
+        open(std::string_view path);
+    // Bytes already in memory, such as a decoded file
+    static std::shared_ptr<const MappedFile> from_buffer(std::string bytes);
+
+    const char *data() const {
+        return base;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+// Reads a stream in large blocks on a background thread, so decoding what is buffered overlaps
+// with reading the rest. The stream must not be used elsewhere until the reader is destroyed.
+class BlockReader {
+    static constexpr size_t READ_AHEAD = 2;
+
+    std::istream &is;
+    size_t block_size;
+    std::string buf;
+    size_t pos = 0;
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::string> ready;
+    bool eof = false;
+    bool stop = false;
+    std::thread worker;
+
+    void read_loop();
+
+public:
+    explicit BlockReader(std::istream &is, size_t block_size = 1 << 20);
+    BlockReader(const BlockReader &) = delete;
+    BlockReader &operator= (const BlockReader &) = delete;
+    ~BlockReader();
+
+    // Bytes buffered and not consumed yet
+    std::string_view data() const {
+        return std::string_view(buf).substr(pos);
+    }
+
+    void consume(size_t n) {
+        pos += n;
+    }
+
+    // Append the next block to `data()`, false once the stream is exhausted
+    bool fill();
+};
+
+// Counterpart of `BlockReader`, blocks filled by the caller are written on a background thread
+// while the next one is formatted
+class BlockWriter {
+    static constexpr size_t WRITE_BEHIND = 2;
+
+    std::ostream &os;
+    size_t block_size;
+    std::string buf;
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::string> pending;
+    bool done = false;
+    std::thread worker;
+
+    void write_loop();
+    void hand_off();
+
+public:
+    explicit BlockWriter(std::ostream &os, size_t block_size = 1 << 20);
+    BlockWriter(const BlockWriter &) = delete;
+    BlockWriter &operator= (const BlockWriter &) = delete;
+    ~BlockWriter();
+
+    // Bytes appended here are written once `commit` finds a full block
+    std::string &buffer() {
+        return buf;
+    }
+
+    void commit() {
+        if (buf.size() >= block_size) {
+            hand_off();
+        }
+    }
+
+    // Write what is left and wait for the writer, false when the stream failed
+    bool finish();
+};
+
+// Flush `tmp` to disk and atomically move it over `path`, a crash leaves either the old or the
+// new file in place
+std::expected<void, std::string> replace_file(std::string_view tmp, std::string_view path);
+
+// Stream the file through `fill` into `path` + ".tmp" then `replace_file` it over `path`
+std::expected<void, std::string> write_file_durable(std::string_view path,
+                                                   std::function<void(std::ostream &)> fill);
 }  // namespace utils
 
 // Support `std::format("{}", StyledText("ciallo"));`
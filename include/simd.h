@@ -0,0 +1,96 @@
+#pragma once
+
+#include "expr_vm.h"
+
+#include <span>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace gpamgr {
+
+enum class CmpOp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+// Scalar reference of every comparison, doubles within `ExprProgram::EPS` are equal
+template <CmpOp op, typename T>
+inline bool compare_as(T x, T y) {
+    if constexpr (op == CmpOp::Eq || op == CmpOp::Ne) {
+        bool eq;
+        if constexpr (std::is_floating_point_v<T>) {
+            eq = std::abs(x - y) < ExprProgram::EPS;
+        } else {
+            eq = x == y;
+        }
+        return op == CmpOp::Eq ? eq : !eq;
+    } else if constexpr (op == CmpOp::Lt) {
+        return x < y;
+    } else if constexpr (op == CmpOp::Le) {
+        return x <= y;
+    } else if constexpr (op == CmpOp::Gt) {
+        return x > y;
+    } else {
+        return x >= y;
+    }
+}
+
+// Comparison and reduction kernels over contiguous numbers. Comparisons produce a bitmap, bit
+// `i % 64` of word `i / 64` is set when value `i` passes, bits past the last value of the
+// last word are clear. The widest instruction set the CPU supports is picked when the program
+// starts, x86-64 builds with GCC or Clang have AVX2 and SSE4.2 versions, every build has the
+// scalar one.
+namespace simd {
+
+enum class Isa : uint8_t { Scalar, SSE42, AVX2 };
+
+Isa best_isa();
+std::string_view isa_name(Isa isa);
+
+inline size_t bitmap_words(size_t n) {
+    return (n + 63) / 64;
+}
+
+void compare(std::span<const double> in, CmpOp op, double c, uint64_t *bits, Isa isa = best_isa());
+void compare(std::span<const int64_t> in,
+             CmpOp op,
+             int64_t c,
+             uint64_t *bits,
+             Isa isa = best_isa());
+
+// Running sum, minimum, maximum and count of the values folded by `reduce`, one pass feeds
+// AVG, MIN, MAX and COUNT of a column at once
+struct Totals {
+    double sum = 0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    size_t count = 0;
+};
+
+// Fold every value of `in` into `t`, or with `bits` only the values whose bit is set. The
+// kernels keep several partial sums and extremes and merge them at the end. Integers are
+// summed exactly in int64 for every `REDUCE_BLOCK` values, which holds while |value| < 2^53.
+constexpr size_t REDUCE_BLOCK = 1024;
+
+void reduce(std::span<const double> in, Totals &t, Isa isa = best_isa());
+void reduce(std::span<const double> in, const uint64_t *bits, Totals &t, Isa isa = best_isa());
+void reduce(std::span<const int64_t> in, Totals &t, Isa isa = best_isa());
+void reduce(std::span<const int64_t> in,
+            const uint64_t *bits,
+            Totals &t,
+            Isa isa = best_isa());
+
+inline void and_bits(uint64_t *dst, const uint64_t *src, size_t words) {
+    for (size_t i = 0; i < words; ++i) {
+        dst[i] &= src[i];
+    }
+}
+
+inline void or_bits(uint64_t *dst, const uint64_t *src, size_t words) {
+    for (size_t i = 0; i < words; ++i) {
+        dst[i] |= src[i];
+    }
+}
+
+}  // namespace simd
+}  // namespace gpamgr
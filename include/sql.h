@@ -7,6 +7,7 @@
 ///      |  insert_stmt
 ///      |  update_stmt
 ///      |  delete_stmt
+///      |  create_index_stmt
 ///      ;
 ///
 /// select_stmt
@@ -32,6 +33,11 @@
 ///         [ WHERE condition ]
 ///         ;
 ///
+/// create_index_stmt
+///     ::= CREATE INDEX ON identifier "(" identifier ")"
+///         [ USING identifier ]
+///         ;
+///
 /// select_list
 ///     ::= "*" | identifier ("," identifier)* ;
 ///
@@ -94,6 +100,10 @@ enum class TokenType : uint8_t {
     tk_desc,
     tk_and,
     tk_or,
+    tk_create,
+    tk_index,
+    tk_on,
+    tk_using,
 
     // id && literals
     tk_identifier,
@@ -8,7 +8,11 @@
 #include <sstream>
 #include <iomanip>
 #include <vector>
-#include <variant>
+#include <new>
+#include <bit>
+#include <memory>
+#include <cstring>
+#include <optional>
 #include <cstdint>
 #include <expected>
 #include <ostream>
@@ -16,6 +20,7 @@
 #include <unordered_map>
 #include <string_view>
 #include <functional>
+#include <algorithm>
 
 namespace gpamgr {
 using RowId = uint64_t;
@@ -38,16 +43,23 @@ public:
         }
     }
 
-    struct SchemaDesc {
-        std::vector<Field> fields;
-    };
-
-    enum class FieldType : int {
+    enum class FieldType : uint8_t {
         INT,
         STRING,
         FLOAT,
     };
 
+    // Physical layout of the table cells, chosen once when the table is created
+    enum class StorageMode : int {
+        ROW,
+        COLUMN,
+    };
+
+    struct SchemaDesc {
+        std::vector<Field> fields;
+        StorageMode storage = StorageMode::ROW;
+    };
+
     static auto field_ty_as_string(FieldType ty) {
         switch (ty) {
             case FieldType::STRING: return "STRING";
@@ -57,62 +69,164 @@ public:
         }
     }
 
+    static auto storage_mode_as_string(StorageMode mode) {
+        switch (mode) {
+            case StorageMode::ROW: return "ROW";
+            case StorageMode::COLUMN: return "COLUMN";
+            default: std::abort();
+        }
+    }
+
     struct Field {
         std::string name;
         FieldType type;
         // size_t col;
         bool is_primary = false;
+        // Has an ordered index
+        bool indexed = false;
+        // Has a hash index
+        bool hashed = false;
+        // Has a trigram index
+        bool trigram = false;
+        // STRING column of a COLUMN table stored as dictionary codes
+        bool dict = false;
+
+        bool has_index() const {
+            return indexed || hashed || trigram;
+        }
     };
 
+    // Compact 16-byte cell: 15 payload bytes followed by the `type` tag.
+    // INT/FLOAT live in the first word, STRING keeps up to `INLINE_CAP` bytes inline and
+    // spills longer strings to the heap. `raw[INLINE_CAP]` tells the two apart: it holds
+    // `INLINE_CAP - size` for inline strings and `HEAP_MARK` for heap strings.
     struct Value {
-        std::variant<int64_t, double, std::string> inner;
-        FieldType type;
-        Value() = default;
+    private:
+        static constexpr size_t INLINE_CAP = 14;
+        static constexpr uint8_t HEAP_MARK = 0xff;
 
-        explicit Value(int64_t v) : inner(v), type(FieldType::INT) {}
+        alignas(8) unsigned char raw[INLINE_CAP + 1];
 
-        explicit Value(double v) : inner(v), type(FieldType::FLOAT) {}
+    public:
+        FieldType type = FieldType::INT;
+
+        Value() {
+            std::construct_at(reinterpret_cast<int64_t *>(raw), 0);
+        }
 
-        explicit Value(std::string v) : inner(std::move(v)), type(FieldType::STRING) {}
+        explicit Value(int64_t v) : type(FieldType::INT) {
+            std::construct_at(reinterpret_cast<int64_t *>(raw), v);
+        }
+
+        explicit Value(double v) : type(FieldType::FLOAT) {
+            std::construct_at(reinterpret_cast<double *>(raw), v);
+        }
+
+        explicit Value(std::string_view v) : type(FieldType::STRING) {
+            set_string(v);
+        }
+
+        explicit Value(const char *v) : Value(std::string_view(v)) {}
+
+        Value(const Value &other) : type(other.type) {
+            if (other.on_heap()) {
+                set_string(*other.as_string());
+            } else {
+                std::memcpy(raw, other.raw, sizeof(raw));
+            }
+        }
+
+        Value(Value &&other) noexcept : type(other.type) {
+            std::memcpy(raw, other.raw, sizeof(raw));
+            other.reset();
+        }
+
+        Value &operator= (const Value &other) {
+            if (this != &other) {
+                Value tmp(other);
+                *this = std::move(tmp);
+            }
+            return *this;
+        }
+
+        Value &operator= (Value &&other) noexcept {
+            if (this != &other) {
+                release();
+                type = other.type;
+                std::memcpy(raw, other.raw, sizeof(raw));
+                other.reset();
+            }
+            return *this;
+        }
 
-        explicit Value(const char *v) : inner(std::string(v)), type(FieldType::STRING) {}
+        ~Value() {
+            release();
+        }
 
         const int64_t *as_int() const {
-            return std::get_if<int64_t>(&inner);
+            if (type != FieldType::INT) {
+                return nullptr;
+            }
+            return std::launder(reinterpret_cast<const int64_t *>(raw));
         }
 
         const double *as_double() const {
-            return std::get_if<double>(&inner);
+            if (type != FieldType::FLOAT) {
+                return nullptr;
+            }
+            return std::launder(reinterpret_cast<const double *>(raw));
         }
 
-        const std::string *as_string() const {
-            return std::get_if<std::string>(&inner);
+        std::optional<std::string_view> as_string() const {
+            if (type != FieldType::STRING) {
+                return std::nullopt;
+            }
+            if (on_heap()) {
+                return std::string_view(heap_data(), heap_size());
+            }
+            return std::string_view(reinterpret_cast<const char *>(raw),
+                                    INLINE_CAP - raw[INLINE_CAP]);
         }
 
+        // Numeric cells only, strings are read through `sget<std::string_view>()`
         template <typename T>
         std::optional<std::reference_wrapper<T>> get() {
-            if (auto *p = std::get_if<T>(&inner)) {
-                return std::ref(*p);
+            static_assert(std::is_same_v<T, int64_t> || std::is_same_v<T, double>);
+            if (auto *p = sget_ptr<T>()) {
+                return std::ref(*const_cast<T *>(p));
             }
             return std::nullopt;
         }
 
         template <typename T>
-        std::optional<std::reference_wrapper<const T>> sget() const {
-            if (auto *p = std::get_if<T>(&inner)) {
-                return std::cref(*p);
+        auto sget() const {
+            if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+                return as_string();
+            } else {
+                using Ret = std::optional<std::reference_wrapper<const T>>;
+                if (auto *p = sget_ptr<T>()) {
+                    return Ret(std::cref(*p));
+                }
+                return Ret(std::nullopt);
+            }
+        }
+
+        // Payload of a cell whose type is already known, from the schema for instance.
+        // Numbers are read without looking at the tag.
+        template <typename T>
+        T load() const {
+            if constexpr (std::is_same_v<T, std::string_view>) {
+                return *as_string();
+            } else {
+                static_assert(std::is_same_v<T, int64_t> || std::is_same_v<T, double>);
+                T x;
+                std::memcpy(&x, raw, sizeof(T));
+                return x;
             }
-            return std::nullopt;
         }
 
         bool is(FieldType ty) const {
             return type == ty;
-            // switch (ty) {
-            //     case FieldType::FLOAT: return nullptr != std::get_if<double>(&inner);
-            //     case FieldType::INT: return nullptr != std::get_if<int64_t>(&inner);
-            //     case FieldType::STRING: return nullptr != std::get_if<std::string>(&inner);
-            //     default: std::abort();
-            // }
         }
 
         bool operator== (FieldType ty) const {
@@ -120,59 +234,86 @@ public:
         }
 
         bool operator== (const Value &other) const {
-            return inner == other.inner;
+            if (type != other.type) {
+                return false;
+            }
+            switch (type) {
+                case FieldType::INT: return *as_int() == *other.as_int();
+                case FieldType::FLOAT: return *as_double() == *other.as_double();
+                case FieldType::STRING: return *as_string() == *other.as_string();
+            }
+            return false;
+        }
+
+        // Three-way order, numbers compare by value across INT/FLOAT and sort before strings
+        int compare(const Value &other) const {
+            if (type == FieldType::STRING || other.type == FieldType::STRING) {
+                if (type != other.type) {
+                    return type == FieldType::STRING ? 1 : -1;
+                }
+                auto c = as_string()->compare(*other.as_string());
+                return (c > 0) - (c < 0);
+            }
+            if (type == FieldType::INT && other.type == FieldType::INT) {
+                auto x = *as_int(), y = *other.as_int();
+                return (x > y) - (x < y);
+            }
+            double x = type == FieldType::INT ? double(*as_int()) : *as_double();
+            double y = other.type == FieldType::INT ? double(*other.as_int()) : *other.as_double();
+            return (x > y) - (x < y);
+        }
+
+        size_t hash() const noexcept {
+            switch (type) {
+                case FieldType::INT: return std::hash<int64_t>{}(*as_int());
+                case FieldType::FLOAT: return std::hash<double>{}(*as_double());
+                case FieldType::STRING: return std::hash<std::string_view>{}(*as_string());
+            }
+            return 0;
         }
 
         static Value from_binary(FieldType type, std::istream &is) {
-            Value v;
             switch (type) {
                 case FieldType::INT: {
                     int64_t x;
                     is.read(reinterpret_cast<char *>(&x), sizeof(x));
-                    logging::trace("Read INT value `{}`", x);
-                    v.inner = x;
-                    v.type = FieldType::INT;
-                    break;
+                    return Value(x);
                 }
                 case FieldType::FLOAT: {
                     double d;
                     is.read(reinterpret_cast<char *>(&d), sizeof(d));
-                    logging::trace("Read FLOAT value `{}`", d);
-                    v.inner = d;
-                    v.type = FieldType::FLOAT;
-                    break;
+                    return Value(d);
                 }
                 case FieldType::STRING: {
                     uint32_t len;
                     is.read(reinterpret_cast<char *>(&len), sizeof(len));
                     std::string s(len, '\0');
                     is.read(s.data(), len);
-                    logging::trace("Read STRING value `{}`", s);
-                    v.inner = std::move(s);
-                    v.type = FieldType::STRING;
-                    break;
+                    return Value(std::string_view(s));
                 }
             }
-            return v;
+            return Value();
         }
 
         void dump_binary(std::ostream &os) const {
-            std::visit(
-                [&](auto &&v) {
-                    using T = std::decay_t<decltype(v)>;
-                    if constexpr (std::is_same_v<T, std::string>) {
-                        uint32_t len = v.size();
-                        os.write(reinterpret_cast<const char *>(&len), sizeof(len));
-                        os.write(v.data(), len);
-                    } else {
-                        os.write(reinterpret_cast<const char *>(&v), sizeof(v));
-                    }
-                },
-                inner);
+            switch (type) {
+                case FieldType::INT:
+                    os.write(reinterpret_cast<const char *>(as_int()), sizeof(int64_t));
+                    break;
+                case FieldType::FLOAT:
+                    os.write(reinterpret_cast<const char *>(as_double()), sizeof(double));
+                    break;
+                case FieldType::STRING: {
+                    auto s = *as_string();
+                    uint32_t len = s.size();
+                    os.write(reinterpret_cast<const char *>(&len), sizeof(len));
+                    os.write(s.data(), len);
+                    break;
+                }
+            }
         }
 
         static std::expected<Value, std::string> from_text(FieldType type, std::string_view sv) {
-            Value v;
             auto ss = std::stringstream(std::string(sv));
 
             switch (type) {
@@ -181,77 +322,471 @@ public:
                     if (!(ss >> x)) {
                         return std::unexpected("Invalid Int");
                     }
-                    v.inner = x;
-                    v.type = FieldType::INT;
-                    break;
+                    return Value(x);
                 }
                 case FieldType::FLOAT: {
                     uint64_t bits;
                     if (!(ss >> bits)) {
                         return std::unexpected("Invalid Float");
                     }
-                    v.inner = std::bit_cast<double>(bits);
-                    v.type = FieldType::FLOAT;
-                    break;
+                    return Value(std::bit_cast<double>(bits));
                 }
                 case FieldType::STRING: {
                     std::string s;
                     if (!(ss >> std::quoted(s))) {
                         return std::unexpected("Invalid String");
                     }
-                    v.inner = std::move(s);
-                    v.type = FieldType::STRING;
-                    break;
+                    return Value(std::string_view(s));
                 }
             }
-            return v;
+            return std::unexpected("Invalid type");
         }
 
         void dump_text(std::ostream &os) const {
             switch (type) {
-                case FieldType::INT: os << std::get<int64_t>(inner); break;
+                case FieldType::INT: os << *as_int(); break;
                 case FieldType::FLOAT: {
-                    uint64_t bits = std::bit_cast<uint64_t>(std::get<double>(inner));
+                    uint64_t bits = std::bit_cast<uint64_t>(*as_double());
                     os << bits;
                     break;
                 }
-                case FieldType::STRING: os << std::quoted(std::get<std::string>(inner)); break;
+                case FieldType::STRING: os << std::quoted(*as_string()); break;
             }
         }
 
         void display(std::ostream &os) const {
-            std::visit(
-                [&](auto &&v) {
-                    using T = std::decay_t<decltype(v)>;
-                    if constexpr (std::is_same_v<T, std::string>) {
-                        os << utils::StyledText(v).green();
-                    } else {
-                        os << utils::StyledText::format("{}", v).green();
-                    }
-                },
-                inner);
+            switch (type) {
+                case FieldType::INT: os << utils::StyledText::format("{}", *as_int()).green(); break;
+                case FieldType::FLOAT:
+                    os << utils::StyledText::format("{}", *as_double()).green();
+                    break;
+                case FieldType::STRING: os << utils::StyledText(*as_string()).green(); break;
+            }
+        }
+
+    private:
+        bool on_heap() const {
+            return type == FieldType::STRING && raw[INLINE_CAP] == HEAP_MARK;
+        }
+
+        const char *heap_data() const {
+            return *std::launder(reinterpret_cast<char *const *>(raw));
+        }
+
+        uint32_t heap_size() const {
+            uint32_t size;
+            std::memcpy(&size, raw + sizeof(char *), sizeof(size));
+            return size;
+        }
+
+        template <typename T>
+        const T *sget_ptr() const {
+            if constexpr (std::is_same_v<T, int64_t>) {
+                return as_int();
+            } else if constexpr (std::is_same_v<T, double>) {
+                return as_double();
+            } else {
+                static_assert(!sizeof(T), "Value only stores int64_t, double and strings");
+            }
+        }
+
+        void set_string(std::string_view v) {
+            if (v.size() <= INLINE_CAP) {
+                std::memcpy(raw, v.data(), v.size());
+                raw[INLINE_CAP] = static_cast<unsigned char>(INLINE_CAP - v.size());
+                return;
+            }
+            char *p = new char[v.size()];
+            std::memcpy(p, v.data(), v.size());
+            std::construct_at(reinterpret_cast<char **>(raw), p);
+            uint32_t size = v.size();
+            std::memcpy(raw + sizeof(char *), &size, sizeof(size));
+            raw[INLINE_CAP] = HEAP_MARK;
+        }
+
+        void release() {
+            if (on_heap()) {
+                delete[] heap_data();
+            }
+        }
+
+        void reset() {
+            type = FieldType::INT;
+            std::construct_at(reinterpret_cast<int64_t *>(raw), 0);
         }
     };
 
     struct Row {
+        // Also the insertion sequence number, rowids are never reused
         RowId id;
-        RowId next;
-        RowId prev;
+        // Empty in COLUMN mode, cells live in `Table::columns`
         std::vector<Value> content;
         bool expired;
     };
 
-    static Table create_in_memory(SchemaDesc schema) {
-        Table t(":memory:");
-        t.schema = std::move(schema.fields);
+    // One field of a COLUMN mode table, slot `i` is aligned with `rows[i]`
+    struct Column {
+        FieldType type;
+        // Dictionary encoded STRING: slot `i` holds `codes[i]` and entry `c` of the dictionary
+        // is `heap[offsets[c], offsets[c + 1])`. Entries are append only, `lengths` stays empty.
+        bool dict = false;
+        std::vector<int64_t> ints;
+        std::vector<double> floats;
+        // STRING: bytes of slot `i` are `heap[offsets[i], offsets[i] + lengths[i])`
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> lengths;
+        std::string heap;
+        std::vector<uint32_t> codes;
+        // Dictionary entry -> code, filled by `encode`
+        std::unordered_map<std::string, uint32_t> dict_codes;
+
+        // Arrays of a column still read in place from a mapped v2 file, the vectors above
+        // stay empty until `materialize()` copies them out
+        struct Mapped {
+            std::span<const int64_t> ints;
+            std::span<const double> floats;
+            std::span<const uint64_t> offsets;
+            std::span<const uint32_t> lengths;
+            std::string_view heap;
+            std::span<const uint32_t> codes;
+        };
+        std::optional<Mapped> mapped;
+
+        explicit Column(FieldType ty, bool dict = false) : type(ty), dict(dict) {
+            if (dict) {
+                offsets.push_back(0);
+            }
+        }
+
+        size_t size() const;
+        void reserve(size_t n);
+        void push_back(const Value &v);
+        void set(size_t slot, const Value &v);
+        Value get(size_t slot) const;
+        void materialize();
+
+        std::span<const int64_t> int_data() const {
+            return mapped ? mapped->ints : std::span<const int64_t>(ints);
+        }
+
+        std::span<const double> float_data() const {
+            return mapped ? mapped->floats : std::span<const double>(floats);
+        }
+
+        std::span<const uint32_t> code_data() const {
+            return mapped ? mapped->codes : std::span<const uint32_t>(codes);
+        }
+
+        size_t dict_size() const {
+            return (mapped ? mapped->offsets.size() : offsets.size()) - 1;
+        }
+
+        std::string_view dict_entry(uint32_t code) const {
+            auto off = mapped ? mapped->offsets : std::span<const uint64_t>(offsets);
+            std::string_view h = mapped ? mapped->heap : std::string_view(heap);
+            return h.substr(off[code], off[code + 1] - off[code]);
+        }
+
+        // Code of `s`, added to the dictionary when it is new
+        uint32_t encode(std::string_view s);
+
+        std::string_view str(size_t slot) const {
+            if (dict) {
+                return dict_entry(code_data()[slot]);
+            }
+            if (mapped) {
+                return mapped->heap.substr(mapped->offsets[slot], mapped->lengths[slot]);
+            }
+            return std::string_view(heap).substr(offsets[slot], lengths[slot]);
+        }
+    };
 
-        for (size_t i = 0; i < t.schema.size(); ++i) {
-            if (t.schema[i].is_primary) {
-                t.primary_field = i;
-                break;
+    // rowid -> slot in `rows`. RowIds are handed out densely by `next_rowid`, so this is a
+    // two-level radix array over the rowid bits instead of a hash map: a lookup is two loads,
+    // and a page is released once every row in it has been erased.
+    class RowDirectory {
+        static constexpr size_t PAGE_BITS = 12;
+        static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+        // `slots` is empty while the page is released
+        struct Page {
+            std::vector<size_t> slots;
+            size_t live = 0;
+        };
+
+        std::vector<Page> pages;
+        size_t count = 0;
+
+    public:
+        static constexpr size_t npos = SIZE_MAX;
+
+        size_t find(RowId id) const {
+            auto p = id >> PAGE_BITS;
+            if (p >= pages.size() || pages[p].slots.empty()) {
+                return npos;
             }
+            return pages[p].slots[id & (PAGE_SIZE - 1)];
         }
 
+        bool contains(RowId id) const {
+            return find(id) != npos;
+        }
+
+        void set(RowId id, size_t slot);
+        void erase(RowId id);
+        void clear();
+
+        size_t size() const {
+            return count;
+        }
+
+        size_t page_count() const;
+        size_t memory_bytes() const;
+
+        // Visit live `(rowid, slot)` pairs in ascending rowid, i.e. insertion order
+        template <typename F>
+        void for_each(F &&f) const {
+            for (size_t p = 0; p < pages.size(); ++p) {
+                auto &slots = pages[p].slots;
+                for (size_t i = 0; i < slots.size(); ++i) {
+                    if (slots[i] != npos) {
+                        f(RowId((p << PAGE_BITS) | i), slots[i]);
+                    }
+                }
+            }
+        }
+    };
+
+    // Ordered secondary index on one column, a B+tree over (key, rowid) pairs so duplicate
+    // keys stay distinct. Nodes live in one pool addressed by index and leaves are chained
+    // both ways for range scans. Erase never merges nodes, underfull leaves are skipped.
+    struct OrderedIndex {
+        static constexpr size_t FANOUT = 64;
+        static constexpr uint32_t NIL = UINT32_MAX;
+
+        struct Entry {
+            Value key;
+            RowId id;
+        };
+
+        // Bound of a range scan, `inclusive` keeps keys equal to `key`
+        struct Bound {
+            Value key;
+            bool inclusive = true;
+        };
+
+        explicit OrderedIndex(size_t col) : col(col) {}
+
+        size_t column() const {
+            return col;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        size_t node_count() const {
+            return nodes.size();
+        }
+
+        void insert(const Value &key, RowId id);
+        void erase(const Value &key, RowId id);
+        void clear();
+
+        // Visit entries with `lo <= key <= hi` in key order, descending when `desc`.
+        // `f(const Value &, RowId)` returns false to stop early.
+        template <typename F>
+        void scan(const std::optional<Bound> &lo,
+                  const std::optional<Bound> &hi,
+                  bool desc,
+                  F &&f) const {
+            if (count == 0) {
+                return;
+            }
+            auto below_hi = [&](const Value &k) {
+                if (!hi) {
+                    return true;
+                }
+                int c = k.compare(hi->key);
+                return c < 0 || (c == 0 && hi->inclusive);
+            };
+            auto above_lo = [&](const Value &k) {
+                if (!lo) {
+                    return true;
+                }
+                int c = k.compare(lo->key);
+                return c > 0 || (c == 0 && lo->inclusive);
+            };
+            if (!desc) {
+                auto [leaf, pos] = lo ? seek(Entry{lo->key, lo->inclusive ? 0 : UINT64_MAX},
+                                             !lo->inclusive)
+                                      : std::pair{first_leaf(), size_t(0)};
+                for (; leaf != NIL; leaf = nodes[leaf].next, pos = 0) {
+                    auto &keys = nodes[leaf].keys;
+                    for (; pos < keys.size(); ++pos) {
+                        if (!below_hi(keys[pos].key) || !f(keys[pos].key, keys[pos].id)) {
+                            return;
+                        }
+                    }
+                }
+                return;
+            }
+            // Start right after the upper bound and walk back
+            auto [leaf, pos] = hi ? seek(Entry{hi->key, hi->inclusive ? UINT64_MAX : 0},
+                                         hi->inclusive)
+                                  : std::pair{NIL, size_t(0)};
+            if (!hi) {
+                leaf = last_leaf();
+                pos = nodes[leaf].keys.size();
+            }
+            while (leaf != NIL) {
+                auto &keys = nodes[leaf].keys;
+                while (pos > 0) {
+                    --pos;
+                    if (!above_lo(keys[pos].key) || !f(keys[pos].key, keys[pos].id)) {
+                        return;
+                    }
+                }
+                leaf = nodes[leaf].prev;
+                pos = leaf == NIL ? 0 : nodes[leaf].keys.size();
+            }
+        }
+
+    private:
+        struct Node {
+            bool leaf = true;
+            // Leaves hold the entries, inner nodes the separators: `children[i]` covers
+            // entries below `keys[i]` and `children[i + 1]` the ones from `keys[i]` on
+            std::vector<Entry> keys;
+            std::vector<uint32_t> children;
+            uint32_t prev = NIL;
+            uint32_t next = NIL;
+        };
+
+        size_t col;
+        std::vector<Node> nodes;
+        uint32_t root = NIL;
+        size_t count = 0;
+
+        static bool less(const Entry &a, const Entry &b) {
+            int c = a.key.compare(b.key);
+            return c < 0 || (c == 0 && a.id < b.id);
+        }
+
+        // Leaf and position of the first entry not below `e` (above `e` when `after`), the
+        // position may be one past the end of the leaf
+        std::pair<uint32_t, size_t> seek(const Entry &e, bool after) const;
+        uint32_t first_leaf() const;
+        uint32_t last_leaf() const;
+        // Returns the separator and new right sibling when `n` had to split
+        std::optional<std::pair<Entry, uint32_t>> insert_into(uint32_t n, const Entry &e);
+    };
+
+    // Hash secondary index on one column for equality lookups. Every (key, rowid) pair takes
+    // its own slot in a linear-probing table that keeps only the key hash, so duplicate keys
+    // need no chains. Lookups return rowids by hash and the caller rechecks the key.
+    struct HashIndex {
+        explicit HashIndex(size_t col) : col(col) {}
+
+        size_t column() const {
+            return col;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        size_t capacity() const {
+            return slots.size();
+        }
+
+        void insert(const Value &key, RowId id);
+        void erase(const Value &key, RowId id);
+        void clear();
+
+        // 64-bit hash of `key` with well mixed bits
+        static uint64_t hash_of(const Value &key);
+
+        // Visit the rowids whose key hashes like `key`, `f(RowId)` returns false to stop early
+        template <typename F>
+        void find(const Value &key, F &&f) const {
+            if (count == 0) {
+                return;
+            }
+            uint64_t h = hash_of(key);
+            size_t mask = slots.size() - 1;
+            for (size_t i = h & mask;; i = (i + 1) & mask) {
+                auto &s = slots[i];
+                if (s.id == EMPTY) {
+                    return;
+                }
+                if (s.id != TOMBSTONE && s.hash == h && !f(s.id)) {
+                    return;
+                }
+            }
+        }
+
+    private:
+        // Rowids start at 1, so 0 marks a never used slot
+        static constexpr RowId EMPTY = 0;
+        static constexpr RowId TOMBSTONE = UINT64_MAX;
+
+        struct Slot {
+            uint64_t hash = 0;
+            RowId id = EMPTY;
+        };
+
+        size_t col;
+        std::vector<Slot> slots;
+        size_t count = 0;
+        size_t tombstones = 0;
+
+        void rehash(size_t cap);
+    };
+
+    // Trigram index on a STRING column for LIKE patterns. Every distinct 3-byte substring of
+    // a cell maps to the ascending rowids containing it. Trigrams are case sensitive like
+    // `utils::strlike`, and candidates still have to be checked against the pattern.
+    struct TrigramIndex {
+        using Gram = uint32_t;
+
+        explicit TrigramIndex(size_t col) : col(col) {}
+
+        size_t column() const {
+            return col;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        size_t gram_count() const {
+            return postings.size();
+        }
+
+        void insert(const Value &key, RowId id);
+        void erase(const Value &key, RowId id);
+        void clear();
+
+        // Trigrams every match of the LIKE `pattern` must contain, taken from the literal runs
+        // between wildcards. Empty when the pattern has no run of 3 bytes.
+        static std::vector<Gram> pattern_grams(std::string_view pattern);
+
+        // Ascending rowids whose cell holds all of `grams`, which must not be empty
+        std::vector<RowId> candidates(std::span<const Gram> grams) const;
+
+    private:
+        size_t col;
+        std::unordered_map<Gram, std::vector<RowId>> postings;
+        size_t count = 0;
+
+        // Distinct trigrams of `s`, sorted
+        static std::vector<Gram> grams_of(std::string_view s);
+    };
+
+    static Table create_in_memory(SchemaDesc schema) {
+        Table t(":memory:");
+        t.init_schema(std::move(schema));
         return t;
     }
 
@@ -274,16 +809,72 @@ public:
     // Apis
     std::expected<Row *, std::string> find_by_id(const RowId id);
     std::expected<Row *, std::string> find_by_pk(const Value &);
-    void scan(std::function<void(const Table::Row &)> cb) const;
+    // Physical walks `rows` in slot order, Insertion follows ascending rowids
+    enum class ScanOrder {
+        Physical,
+        Insertion,
+    };
+    void scan(std::function<void(const Table::Row &)> cb,
+              ScanOrder order = ScanOrder::Physical) const;
+
+    // Copy of the live rows of `SNAPSHOT_CHUNK` consecutive slots
+    struct SnapshotChunk {
+        std::vector<Row> rows;
+    };
+
+    // Immutable version of the rows that readers can scan while the table keeps changing.
+    // Two versions share every chunk whose slots were not written in between.
+    class Snapshot {
+        friend class Table;
+        std::vector<std::shared_ptr<const SnapshotChunk>> chunks;
+        size_t row_count = 0;
+
+    public:
+        size_t size() const {
+            return row_count;
+        }
+
+        template <typename F>
+        void scan(F &&f) const {
+            for (auto &chunk: chunks) {
+                for (auto &row: chunk->rows) {
+                    f(row);
+                }
+            }
+        }
+
+        // Number of chunks this version shares with `other`
+        size_t shared_chunks(const Snapshot &other) const {
+            size_t n = 0;
+            for (size_t c = 0; c < std::min(chunks.size(), other.chunks.size()); ++c) {
+                n += chunks[c] == other.chunks[c];
+            }
+            return n;
+        }
+    };
+
+    // Publish the current rows, only the chunks written since the last snapshot are copied
+    std::shared_ptr<const Snapshot> snapshot();
+    // Physical scan that asks `keep(slot)` before a row is loaded
+    void scan_slots(std::function<bool(size_t)> keep,
+                    std::function<void(const Table::Row &)> cb) const;
+    // Edits made in place cannot be logged, the next flush rewrites the whole file
     void scan_mut(std::function<void(Row &)> cb);
     enum class ScanAction {
         Keep,
         Delete,
         Stop,
     };
+    // `cb` must not modify the row, changes go through `erase_row`/`update`. Rows answered
+    // with `Delete` are erased once the scan ends.
     void scan_struct(std::function<ScanAction(Row &)> cb);
     std::expected<RowId, std::string> insert(std::span<const Value> values);
+    // Append `cells.size() / field_count()` rows stored back to back. Primary keys are checked
+    // for the whole batch first, nothing is inserted on error. The batch is not logged, the
+    // next flush rewrites the file.
+    std::expected<size_t, std::string> insert_batch(std::span<const Value> cells);
     std::expected<void, std::string> erase_row(RowId id);
+    std::expected<void, std::string> update(RowId id, size_t col, Value value);
 
     std::string_view get_file_path() {
         return file_on_disk;
@@ -294,24 +885,102 @@ public:
     }
 
     const auto rows_physical_size() const {
-        return rows.size();
+        return mapping ? mapped_ids.size() : rows.size();
+    }
+
+    StorageMode storage_mode() const {
+        return storage;
+    }
+
+    // Only valid in COLUMN mode or while the table is mapped
+    const Column &column(size_t col) const {
+        return columns[col];
+    }
+
+    // Opened from a v2 file and not written since, cells are read from the mapping
+    bool is_mapped() const {
+        return mapping != nullptr;
+    }
+
+    // Packed files store their columns through `codec` and are decoded into memory at load
+    // instead of being mapped in place. Tables loaded from one stay packed, the others are
+    // packed with `--compress-tables`. Takes effect on the next rewrite of the file.
+    bool is_packed() const {
+        return packed;
+    }
+
+    void set_packed(bool on) {
+        packed = on;
+        dirty = true;
+        wal_base_valid = false;
+    }
+
+    bool slot_alive(size_t slot) const {
+        if (mapping) {
+            return true;
+        }
+        return (live_bits[slot / 64] >> (slot % 64)) & 1;
+    }
+
+    size_t dead_slots() const {
+        return free_slots.size();
+    }
+
+    // Bit `slot % 64` of word `slot / 64` is set for live slots, empty for mapped tables,
+    // whose slots are all live
+    std::span<const uint64_t> live_bitmap() const {
+        if (mapping) {
+            return {};
+        }
+        return live_bits;
+    }
+
+    // Repack live rows into the front slots in scan order and release the dead ones,
+    // returns the number of slots reclaimed. Must not run inside a scan.
+    size_t vacuum();
+
+    // Dead slots passed `--vacuum-dead-percent` of the table
+    bool needs_vacuum() const;
+
+    const RowDirectory &rowid_directory() const {
+        return rowid_index;
     }
 
     bool is_dirty() const {
         return dirty;
     }
 
-    void flush() {
-        logging::trace("Flushing `{}`", file_on_disk);
-        if (!dirty) {
-            return;
-        }
-        write_back_binary();
-        dirty = false;
+    // Appends the changes made since the last flush to the write-ahead log, or rewrites the
+    // whole file when the log has no valid base or grew past `--wal-checkpoint-kb`
+    void flush();
+
+    // Rewrite the table file and drop the write-ahead log
+    void checkpoint();
+
+    // The next flush has to rewrite the whole file
+    bool needs_checkpoint() const;
+
+    bool checkpoint_running() const {
+        return checkpoint_busy;
+    }
+
+    // Bytes in the on-disk log plus records not flushed yet
+    size_t wal_size() const {
+        return wal_bytes + wal_pending.size();
+    }
+
+    // Records held in memory until the next flush
+    size_t pending_log_bytes() const {
+        return wal_pending.size();
+    }
+
+    std::string wal_path() const {
+        return file_on_disk + ".wal";
     }
 
     void dump_schema() const;
     void dump_schema(std::ostream &os) const;
+    void dump_stats(std::ostream &os) const;
     void dump_row(RowId id) const;
     void dump_row(std::ostream &os, RowId id) const;
     void dump_row(std::stringstream &os, RowId id) const;
@@ -361,25 +1030,180 @@ public:
         return row.content[col];
     }
 
+    // Cells of the row in `slot`, in COLUMN mode they are materialized into
+    // `cursor` and stay valid until the next lookup
+    const std::vector<Value> &values_at(size_t slot) const;
+
     std::expected<void, std::string> validate_row(std::span<const Value> values) const;
 
+    enum class IndexKind {
+        Ordered,
+        Hash,
+        Trigram,
+    };
+
+    static auto index_kind_as_string(IndexKind kind) {
+        switch (kind) {
+            case IndexKind::Ordered: return "ORDERED";
+            case IndexKind::Hash: return "HASH";
+            case IndexKind::Trigram: return "TRIGRAM";
+            default: std::abort();
+        }
+    }
+
+    // Build an index on `col`, it is kept up to date by insert/erase_row/update and
+    // recorded in the table file. Hash indexes only take INT and STRING columns, FLOAT
+    // equality is approximate and cannot be hashed. Trigram indexes only take STRING columns.
+    std::expected<void, std::string> create_index(size_t col,
+                                                  IndexKind kind = IndexKind::Ordered);
+
+    const OrderedIndex *ordered_index(size_t col) const {
+        ensure_indexes();
+        for (auto &idx: ordered_indexes) {
+            if (idx.column() == col) {
+                return &idx;
+            }
+        }
+        return nullptr;
+    }
+
+    const HashIndex *hash_index(size_t col) const {
+        ensure_indexes();
+        for (auto &idx: hash_indexes) {
+            if (idx.column() == col) {
+                return &idx;
+            }
+        }
+        return nullptr;
+    }
+
+    const TrigramIndex *trigram_index(size_t col) const {
+        ensure_indexes();
+        for (auto &idx: trigram_indexes) {
+            if (idx.column() == col) {
+                return &idx;
+            }
+        }
+        return nullptr;
+    }
+
+    static constexpr size_t ZONE_ROWS = 1024;
+
+    // Range of a numeric column over `ZONE_ROWS` consecutive slots. Inserts and updates
+    // widen it, only a rebuild narrows it, so it may overstate the values of its block.
+    struct Zone {
+        Value lo;
+        Value hi;
+        bool empty = true;
+
+        void widen(const Value &v) {
+            if (empty) {
+                lo = v;
+                hi = v;
+                empty = false;
+            } else if (v.compare(lo) < 0) {
+                lo = v;
+            } else if (v.compare(hi) > 0) {
+                hi = v;
+            }
+        }
+    };
+
+    // Zones of column `col` by slot block, none for STRING columns
+    std::span<const Zone> zone_map(size_t col) const {
+        if (col >= zone_maps.size()) {
+            return {};
+        }
+        return zone_maps[col];
+    }
+
+    static constexpr size_t HISTOGRAM_BUCKETS = 32;
+
+    // Distribution of one column when it was last analyzed, `rows` against `alive_rows()`
+    // tells how stale it is
+    struct ColumnStats {
+        uint64_t rows = 0;
+        // HyperLogLog estimate of the number of distinct values
+        uint64_t distinct = 0;
+        Value min;
+        Value max;
+        // Upper bound of each equi-depth bucket, a bucket holds `rows / bounds.size()` rows
+        std::vector<Value> bounds;
+
+        // Estimated share of the rows whose value is at most `v`
+        double fraction_at_most(const Value &v) const;
+    };
+
+    // Statistics of column `col`, nullptr until the table is analyzed. They are kept in the
+    // table file as of the last analyze, a table loaded from a file without them is
+    // analyzed on the first call.
+    const ColumnStats *column_stats(size_t col) const {
+        if (stats_pending) {
+            collect_stats();
+        }
+        return col < stats.size() ? &stats[col] : nullptr;
+    }
+
+    // Recompute the statistics of every column, they are kept in the table file
+    void analyze();
+
+    // Cells of row `id`, nullptr when it does not exist. Same lifetime as `values_at`.
+    const std::vector<Value> *row_values(RowId id) const;
+
+    // Contents of a table file: schema, statistics and the rows of a pinned snapshot. `write`
+    // never touches the table, so it may run on another thread without the table's lock.
+    class Image {
+        friend class Table;
+        std::vector<Field> schema;
+        StorageMode storage = StorageMode::ROW;
+        bool pack = false;
+        RowId next_rowid = 1;
+        uint64_t generation = 0;
+        std::vector<ColumnStats> stats;
+        std::shared_ptr<const Snapshot> rows;
+
+    public:
+        std::expected<void, std::string> write(std::string_view path) const;
+    };
+
+    // Checkpoint split for a writer on another thread: `begin_checkpoint` pins the image, only
+    // the snapshot chunks written since the last snapshot are copied, and `finish_checkpoint`
+    // reports whether the image reached `file_on_disk`. Changes made in between stay pending
+    // and go to the fresh log afterwards.
+    Image begin_checkpoint();
+    void finish_checkpoint(bool ok);
+
 private:
     std::vector<Row> rows;
     std::vector<size_t> free_slots;
+    // Bit `i` is set while `rows[i]` holds a live row
+    std::vector<uint64_t> live_bits;
     std::vector<Field> schema;
+    StorageMode storage = StorageMode::ROW;
+    std::vector<Column> columns;
+
+    // Scratch row handed out by lookups in COLUMN mode
+    mutable Row cursor{};
+
+    static constexpr size_t SNAPSHOT_CHUNK = 4096;
+    // Chunks of the last snapshot, a chunk is dropped once one of its slots is written
+    std::vector<std::shared_ptr<const SnapshotChunk>> snapshot_chunks;
+    std::shared_ptr<const Snapshot> last_snapshot;
+
+    // Backing file of a table opened from a v2 file, every column has a `Column::mapped`
+    // view and `mapped_ids` holds the rowid of each slot in ascending order. `rows`, the
+    // liveness bitmap and the rowid directory stay empty until `materialize()`.
+    std::shared_ptr<const utils::MappedFile> mapping;
+    std::span<const RowId> mapped_ids;
 
     uint64_t primary_field;
 
-    RowId head = 0;
-    RowId tail = 0;
     uint64_t alive_count = 0;
     RowId next_rowid = 1;
 
     struct ValueHash {
         size_t operator() (const Table::Value &v) const noexcept {
-            return std::visit(
-                [](const auto &x) { return std::hash<std::decay_t<decltype(x)>>{}(x); },
-                v.inner);
+            return v.hash();
         }
     };
 
@@ -387,7 +1211,20 @@ private:
     mutable std::unordered_map<Value, RowId, ValueHash> primary_index;
 
     // rowid -> real index in rows
-    mutable std::unordered_map<RowId, size_t> rowid_index;
+    mutable RowDirectory rowid_index;
+
+    // Secondary indexes from `create_index`. A mapped table leaves them empty at load and
+    // fills them on first use, see `ensure_indexes`.
+    mutable std::vector<OrderedIndex> ordered_indexes;
+    mutable std::vector<HashIndex> hash_indexes;
+    mutable std::vector<TrigramIndex> trigram_indexes;
+    mutable bool indexes_ready = true;
+    // Per column, see `Zone`
+    std::vector<std::vector<Zone>> zone_maps;
+    // One per column once analyzed, empty before. `stats_pending` defers the analyze of a
+    // table loaded without statistics to the first `column_stats()`.
+    mutable std::vector<ColumnStats> stats;
+    mutable bool stats_pending = false;
 
     std::string file_on_disk;
 
@@ -396,15 +1233,97 @@ private:
     // enum Filetype { BIN, TXT } ft;
 
     bool dirty = false;
-    void write_back_binary();
-    void write_back_binary(std::ofstream &ofs);
+    bool packed = false;
+    std::expected<void, std::string> write_back_binary();
+    void write_back_binary(std::ostream &os);
+    // Row sources of `write_image`, the live table and a pinned snapshot
+    struct LiveRows;
+    struct PinnedRows;
+    // `Image` of the table without rows
+    Image image_header() const;
+    template <typename Rows>
+    static void write_image(std::ostream &os, const Image &h, const Rows &src);
+
+    // Write-ahead log, a header with the checkpoint generation of the table file it applies
+    // to, then records `len (u32) | op (u8) | rowid (u64) | payload` where `len` covers
+    // everything after itself, a torn tail fails the length check on replay. Insert carries
+    // all cells, Update a column index (u32) and one cell, Erase nothing.
+    enum class WalOp : uint8_t {
+        Insert = 1,
+        Erase,
+        Update,
+    };
+    // Records produced since the last flush
+    std::string wal_pending;
+    // Size of the log file on disk, 0 before its header is written
+    size_t wal_bytes = 0;
+    // Bumped by every rewrite of the table file, a log of another generation is stale
+    uint64_t generation = 0;
+    // The table file matches the state the log starts from
+    bool wal_base_valid = false;
+    bool wal_replaying = false;
+    // An image from `begin_checkpoint` is being written, the log must not be touched
+    bool checkpoint_busy = false;
+
+    void wal_record(WalOp op, RowId id, std::span<const Value> cells, uint32_t col = 0);
+    std::expected<void, std::string> wal_apply(std::string_view rec);
+    std::expected<void, std::string> replay_wal();
 
     std::expected<void, std::string> parse_from_file();
     std::expected<void, std::string> parse_from_file(std::ifstream &ifs);
+    std::expected<void, std::string> parse_mapped(std::shared_ptr<const utils::MappedFile> file);
+
+    // Copy a mapped table into `rows`/`columns` before it is modified
+    void materialize();
+    // Mapped tables build the primary index on the first key lookup
+    void ensure_primary_index() const;
+    // and the secondary indexes on the first index lookup or write
+    void ensure_indexes() const;
+    size_t slot_of(RowId id) const;
+
+    void mark_live(size_t slot);
+    void mark_dead(size_t slot);
+    // Slot `slot` changed, the next snapshot copies its chunk again
+    void touch_slot(size_t slot);
+    void drop_snapshot_chunks();
+
+    // Visit live slots in physical order, `f` returns false to stop early
+    template <typename F>
+    void for_each_live(F &&f) const {
+        for (size_t w = 0; w < live_bits.size(); ++w) {
+            uint64_t bits = live_bits[w];
+            while (bits) {
+                size_t slot = w * 64 + std::countr_zero(bits);
+                bits &= bits - 1;
+                if (!f(slot)) {
+                    return;
+                }
+            }
+        }
+    }
 
-    void rebuild_links();
+    void init_schema(SchemaDesc desc);
+    // Empty secondary indexes for the columns flagged in `schema`
+    void reset_indexes();
+    // Fill the secondary indexes of every `Field::has_index()` column from the rows
+    void rebuild_indexes();
+    // Keep the secondary indexes on `col` in step with a cell change
+    void index_cell(size_t col, const Value &v, RowId id);
+    void unindex_cell(size_t col, const Value &v, RowId id);
+    // Widen the zone of `slot` on numeric column `col`
+    void zone_cell(size_t slot, size_t col, const Value &v);
+    void rebuild_zone_maps();
+    // `analyze()` without marking the table dirty
+    void collect_stats() const;
+    // Statistics of a column from all of its live values, sorts `values`
+    static ColumnStats stats_of(std::vector<Value> &values);
+    void load_row(size_t slot, Row &out) const;
+    void store_row(size_t slot, std::span<const Value> values);
+    Value cell_at(size_t slot, size_t col) const;
 };
 
+static_assert(sizeof(Table::Value) == 16);
+
 using TableView = std::unordered_map<std::string_view, Table *>;
 
 }  // namespace gpamgr
@@ -2,7 +2,10 @@
 
 #include "table.h"
 #include "misc.h"
+#include "simd.h"
+#include "expr_vm.h"
 
+#include <bit>
 #include <memory>
 #include <string>
 #include <expected>
@@ -29,48 +32,138 @@ struct RowView {
     }
 };
 
-using ValueExpr = std::function<std::expected<Value, std::string>(const RowView &)>;
-
 using RowConsumer = std::function<void(RowView)>;
 
+// Rows handed from one operator to the next, `sel` lists the positions still selected.
+// A filter only shrinks `sel`, the rows themselves stay where the scan put them.
+struct RowBatch {
+    static constexpr size_t CAPACITY = 1024;
+
+    std::vector<RowView> rows;
+    std::vector<uint32_t> sel;
+
+    RowBatch() {
+        rows.reserve(CAPACITY);
+        sel.reserve(CAPACITY);
+    }
+
+    size_t size() const {
+        return sel.size();
+    }
+
+    bool full() const {
+        return rows.size() >= CAPACITY;
+    }
+
+    const RowView &operator[] (size_t i) const {
+        return rows[sel[i]];
+    }
+
+    void push(RowView rv) {
+        sel.push_back(rows.size());
+        rows.push_back(std::move(rv));
+    }
+
+    void clear() {
+        rows.clear();
+        sel.clear();
+    }
+};
+
 class ExecContext {
 public:
     using Consumer = std::function<void(RowView)>;
+    using BatchConsumer = std::function<void(RowBatch &)>;
 
 private:
+    // Shared by every context derived through `with_consumer`, so a failure anywhere in
+    // the pipeline stops all of it
+    struct Status {
+        bool failed = false;
+        std::string error;
+    };
+
     Consumer consumer;
-    bool failed = false;
-    std::string error;
+    BatchConsumer batch_consumer;
+    std::shared_ptr<Status> status = std::make_shared<Status>();
+    // Rows passed to `emit` while a batch consumer is set
+    RowBatch pending;
 
 public:
     ExecContext() = default;
 
     explicit ExecContext(Consumer c) : consumer(std::move(c)) {}
 
+    explicit ExecContext(BatchConsumer c) : batch_consumer(std::move(c)) {}
+
     void emit(RowView rv) {
-        if (!failed && consumer) {
+        if (status->failed) {
+            return;
+        }
+        if (batch_consumer) {
+            pending.push(std::move(rv));
+            if (pending.full()) {
+                flush();
+            }
+        } else if (consumer) {
             consumer(std::move(rv));
         }
     }
 
+    // Hand on the selected rows of `batch`, one by one to a row consumer
+    void emit_batch(RowBatch &batch) {
+        if (status->failed || batch.sel.empty()) {
+            return;
+        }
+        if (batch_consumer) {
+            flush();
+            batch_consumer(batch);
+            return;
+        }
+        if (consumer) {
+            for (auto i: batch.sel) {
+                consumer(batch.rows[i]);
+                if (status->failed) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Hand on the rows buffered by `emit`
+    void flush() {
+        if (!pending.rows.empty() && !status->failed && batch_consumer) {
+            batch_consumer(pending);
+        }
+        pending.clear();
+    }
+
     void fail(std::string msg) {
-        if (!failed) {
-            failed = true;
-            error = std::move(msg);
+        if (!status->failed) {
+            status->failed = true;
+            status->error = std::move(msg);
         }
     }
 
     [[nodiscard]] bool has_failed() const {
-        return failed;
+        return status->failed;
     }
 
     [[nodiscard]] std::string_view error_msg() const {
-        return error;
+        return status->error;
     }
 
     [[nodiscard]] ExecContext with_consumer(Consumer c) const {
-        ExecContext next = *this;
+        ExecContext next;
         next.consumer = std::move(c);
+        next.status = status;
+        return next;
+    }
+
+    [[nodiscard]] ExecContext with_batch_consumer(BatchConsumer c) const {
+        ExecContext next;
+        next.batch_consumer = std::move(c);
+        next.status = status;
         return next;
     }
 };
@@ -88,6 +181,20 @@ public:
 
     virtual void dump(std::ostream &os, bool color) const = 0;
 
+    // Table read by this node when it is a bare full scan
+    virtual const Table *scan_source() const {
+        return nullptr;
+    }
+
+protected:
+    // Run the first child and hand its rows to `f` in batches
+    void pull(const ExecContext &ctx, ExecContext::BatchConsumer f) const {
+        auto next = ctx.with_batch_consumer(std::move(f));
+        child[0]->execute(next);
+        next.flush();
+    }
+
+public:
     void explain(std::ostream &os, bool color, int indent = 0) const {
         // indent
         for (int i = 0; i < indent; ++i) {
@@ -108,45 +215,577 @@ public:
     }
 };
 
+using IndexBound = Table::OrderedIndex::Bound;
+
+// Bounds on one column collected from the WHERE conjuncts
+struct IndexRange {
+    size_t col;
+    std::optional<IndexBound> lo;
+    std::optional<IndexBound> hi;
+};
+
 class TableScanPlan final : public PlanNode {
     const Table *table;
+    // Blocks whose zone misses one of these ranges hold no matching row
+    std::vector<IndexRange> zone_ranges;
+
+    static bool overlaps(const Table::Zone &z, const IndexRange &r) {
+        if (z.empty) {
+            return false;
+        }
+        if (r.lo) {
+            int c = z.hi.compare(r.lo->key);
+            if (c < 0 || (c == 0 && !r.lo->inclusive)) {
+                return false;
+            }
+        }
+        if (r.hi) {
+            int c = z.lo.compare(r.hi->key);
+            if (c > 0 || (c == 0 && !r.hi->inclusive)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether each block of `Table::ZONE_ROWS` slots may hold a matching row
+    std::vector<bool> blocks_to_scan() const {
+        std::vector<bool> keep;
+        for (auto &r: zone_ranges) {
+            auto zones = table->zone_map(r.col);
+            keep.resize(std::max(keep.size(), zones.size()), true);
+            for (size_t b = 0; b < zones.size(); ++b) {
+                if (!overlaps(zones[b], r)) {
+                    keep[b] = false;
+                }
+            }
+        }
+        return keep;
+    }
 
 public:
     explicit TableScanPlan(const Table *t) : table(t) {}
 
+    void set_zone_ranges(std::vector<IndexRange> ranges) {
+        zone_ranges = std::move(ranges);
+    }
+
     void execute(ExecContext &ctx) const override {
-        table->scan([&](const Table::Row &row) {
+        // Rows of COLUMN and mapped tables are materialized into a scratch buffer, they are
+        // copied into one block of cells per batch that the views share
+        const bool scratch = table->storage_mode() == Table::StorageMode::COLUMN ||
+                             table->is_mapped();
+        const size_t width = table->field_count();
+        RowBatch batch;
+        std::shared_ptr<std::vector<Value>> cells;
+        auto emit = [&](const Table::Row &row) {
+            if (ctx.has_failed()) {
+                return;
+            }
             RowView rv{.table = table,
                        .row_id = row.id,
                        .cols = std::span<const Value>(row.content)};
+            if (scratch) {
+                if (!cells) {
+                    cells = std::make_shared<std::vector<Value>>();
+                    cells->reserve(RowBatch::CAPACITY * width);
+                }
+                auto at = cells->size();
+                cells->insert(cells->end(), row.content.begin(), row.content.end());
+                rv.cols = std::span<const Value>(cells->data() + at, width);
+                rv.owner = cells;
+            }
+            batch.push(std::move(rv));
+            if (batch.full()) {
+                ctx.emit_batch(batch);
+                batch.clear();
+                cells.reset();
+            }
+        };
+        scan(emit);
+        ctx.emit_batch(batch);
+    }
+
+    void dump(std::ostream &os, bool) const override {
+        os << "TableScan(" << table->get_name();
+        for (size_t i = 0; i < zone_ranges.size(); ++i) {
+            os << (i == 0 ? ", zones on " : ", ") << table->get_schema()[zone_ranges[i].col].name;
+        }
+        os << ")\n";
+    }
+
+    const Table *scan_source() const override {
+        return table;
+    }
+
+private:
+    template <typename F>
+    void scan(F &&emit) const {
+        if (zone_ranges.empty()) {
+            table->scan(emit);
+            return;
+        }
+        auto keep = blocks_to_scan();
+        logging::debug("Zone maps of `{}` skip {} of {} blocks",
+                       table->get_name(),
+                       std::ranges::count(keep, false),
+                       keep.size());
+        table->scan_slots(
+            [&](size_t slot) {
+                auto b = slot / Table::ZONE_ROWS;
+                return b >= keep.size() || keep[b];
+            },
+            emit);
+    }
+};
+
+// Full scan of a pinned table version. Rows stay valid for the life of the plan, whatever
+// writers do to the table meanwhile.
+class SnapshotScanPlan final : public PlanNode {
+    std::string name;
+    std::shared_ptr<const Table::Snapshot> snap;
+
+public:
+    SnapshotScanPlan(std::string_view name, std::shared_ptr<const Table::Snapshot> snap) :
+        name(name), snap(std::move(snap)) {}
+
+    void execute(ExecContext &ctx) const override {
+        snap->scan([&](const Table::Row &row) {
+            RowView rv{.table = nullptr,
+                       .row_id = row.id,
+                       .cols = std::span<const Value>(row.content)};
             ctx.emit(rv);
         });
     }
 
     void dump(std::ostream &os, bool) const override {
-        os << "TableScan(" << table->get_name() << ")\n";
+        os << "SnapshotScan(" << name << ", " << snap->size() << " rows)\n";
+    }
+};
+
+// String test on one dictionary encoded column, run once per dictionary entry
+struct DictFilter {
+    size_t col;
+    std::function<bool(std::string_view)> match;
+    // For `dump`, e.g. "major = 'CS'"
+    std::string text;
+};
+
+// Full scan of a COLUMN table that drops rows by their dictionary codes before loading
+// them. Every filter is resolved into a per-code table when the plan runs.
+class DictScanPlan final : public PlanNode {
+    const Table *table;
+    std::vector<DictFilter> filters;
+
+public:
+    DictScanPlan(const Table *t, std::vector<DictFilter> filters) :
+        table(t), filters(std::move(filters)) {}
+
+    void execute(ExecContext &ctx) const override {
+        std::vector<std::vector<uint8_t>> keep(filters.size());
+        std::vector<std::span<const uint32_t>> codes(filters.size());
+        for (size_t i = 0; i < filters.size(); ++i) {
+            auto &col = table->column(filters[i].col);
+            keep[i].resize(col.dict_size());
+            for (uint32_t c = 0; c < keep[i].size(); ++c) {
+                keep[i][c] = filters[i].match(col.dict_entry(c));
+            }
+            codes[i] = col.code_data();
+        }
+        table->scan_slots(
+            [&](size_t slot) {
+                for (size_t i = 0; i < keep.size(); ++i) {
+                    if (!keep[i][codes[i][slot]]) {
+                        return false;
+                    }
+                }
+                return !ctx.has_failed();
+            },
+            [&](const Table::Row &row) {
+                auto owned = std::make_shared<std::vector<Value>>(row.content);
+                RowView rv{.table = table,
+                           .row_id = row.id,
+                           .cols = std::span<const Value>(*owned),
+                           .owner = owned};
+                ctx.emit(rv);
+            });
+    }
+
+    void dump(std::ostream &os, bool) const override {
+        os << "DictScan(" << table->get_name();
+        for (size_t i = 0; i < filters.size(); ++i) {
+            os << (i ? " and " : ", ") << filters[i].text;
+        }
+        os << ")\n";
+    }
+};
+
+// Rows in the key order of the ordered index on `col`, limited to `[lo, hi]`
+class IndexScanPlan final : public PlanNode {
+    using Bound = Table::OrderedIndex::Bound;
+
+    const Table *table;
+    size_t col;
+    std::optional<Bound> lo;
+    std::optional<Bound> hi;
+    bool desc;
+
+public:
+    IndexScanPlan(const Table *t,
+                  size_t col,
+                  std::optional<Bound> lo,
+                  std::optional<Bound> hi,
+                  bool desc) : table(t), col(col), lo(std::move(lo)), hi(std::move(hi)), desc(desc) {}
+
+    void execute(ExecContext &ctx) const override {
+        auto *idx = table->ordered_index(col);
+        if (!idx) {
+            ctx.fail(std::format("No index on column `{}`", table->get_schema()[col].name));
+            return;
+        }
+        const bool scratch = table->storage_mode() == Table::StorageMode::COLUMN ||
+                             table->is_mapped();
+        idx->scan(lo, hi, desc, [&](const Value &, RowId id) {
+            auto *cells = table->row_values(id);
+            if (!cells) {
+                return true;
+            }
+            RowView rv{.table = table, .row_id = id, .cols = std::span<const Value>(*cells)};
+            if (scratch) {
+                auto owned = std::make_shared<std::vector<Value>>(*cells);
+                rv.cols = std::span<const Value>(*owned);
+                rv.owner = owned;
+            }
+            ctx.emit(rv);
+            return !ctx.has_failed();
+        });
+    }
+
+    void dump(std::ostream &os, bool) const override {
+        os << "IndexScan(" << table->get_name() << '.' << table->get_schema()[col].name << ' ';
+        if (lo) {
+            os << (lo->inclusive ? '[' : '(');
+            lo->key.display(os);
+        } else {
+            os << "(-inf";
+        }
+        os << ", ";
+        if (hi) {
+            hi->key.display(os);
+            os << (hi->inclusive ? ']' : ')');
+        } else {
+            os << "+inf)";
+        }
+        os << (desc ? " desc" : " asc") << ")\n";
+    }
+};
+
+// Rows whose `col` hashes like `key`, in rowid order. Hash collisions pass through, the
+// FilterPlan on top rechecks the key.
+class HashLookupPlan final : public PlanNode {
+    const Table *table;
+    size_t col;
+    Value key;
+
+public:
+    HashLookupPlan(const Table *t, size_t col, Value key) : table(t), col(col), key(std::move(key)) {}
+
+    void execute(ExecContext &ctx) const override {
+        auto *idx = table->hash_index(col);
+        if (!idx) {
+            ctx.fail(std::format("No hash index on column `{}`", table->get_schema()[col].name));
+            return;
+        }
+        std::vector<RowId> ids;
+        idx->find(key, [&](RowId id) {
+            ids.push_back(id);
+            return true;
+        });
+        std::ranges::sort(ids);
+        const bool scratch = table->storage_mode() == Table::StorageMode::COLUMN ||
+                             table->is_mapped();
+        for (auto id: ids) {
+            auto *cells = table->row_values(id);
+            if (!cells) {
+                continue;
+            }
+            RowView rv{.table = table, .row_id = id, .cols = std::span<const Value>(*cells)};
+            if (scratch) {
+                auto owned = std::make_shared<std::vector<Value>>(*cells);
+                rv.cols = std::span<const Value>(*owned);
+                rv.owner = owned;
+            }
+            ctx.emit(rv);
+            if (ctx.has_failed()) {
+                return;
+            }
+        }
+    }
+
+    void dump(std::ostream &os, bool) const override {
+        os << "HashLookup(" << table->get_name() << '.' << table->get_schema()[col].name << " = ";
+        key.display(os);
+        os << ")\n";
     }
 };
 
-using Predicate = std::function<bool(const RowView &)>;
+// Rows holding every trigram of a LIKE pattern, in rowid order. The FilterPlan on top
+// runs the pattern itself.
+class TrigramScanPlan final : public PlanNode {
+    using Gram = Table::TrigramIndex::Gram;
+
+    const Table *table;
+    size_t col;
+    std::string pattern;
+    std::vector<Gram> grams;
+
+public:
+    TrigramScanPlan(const Table *t, size_t col, std::string pattern, std::vector<Gram> grams) :
+        table(t), col(col), pattern(std::move(pattern)), grams(std::move(grams)) {}
+
+    void execute(ExecContext &ctx) const override {
+        auto *idx = table->trigram_index(col);
+        if (!idx) {
+            ctx.fail(std::format("No trigram index on column `{}`", table->get_schema()[col].name));
+            return;
+        }
+        const bool scratch = table->storage_mode() == Table::StorageMode::COLUMN ||
+                             table->is_mapped();
+        for (auto id: idx->candidates(grams)) {
+            auto *cells = table->row_values(id);
+            if (!cells) {
+                continue;
+            }
+            RowView rv{.table = table, .row_id = id, .cols = std::span<const Value>(*cells)};
+            if (scratch) {
+                auto owned = std::make_shared<std::vector<Value>>(*cells);
+                rv.cols = std::span<const Value>(*owned);
+                rv.owner = owned;
+            }
+            ctx.emit(rv);
+            if (ctx.has_failed()) {
+                return;
+            }
+        }
+    }
+
+    void dump(std::ostream &os, bool) const override {
+        os << "TrigramScan(" << table->get_name() << '.' << table->get_schema()[col].name
+           << " like '" << pattern << "', " << grams.size() << " trigrams)\n";
+    }
+};
+
+// A program that leaves a boolean, the empty one accepts every row
+using Predicate = ExprProgram;
+
+// A `col op literal` or `col op col` conjunct. The builder picks an instance of
+// `compare_kernel` for the column types and the operator, so the loop over a batch reads
+// raw payloads and has no branch on either.
+struct CompareKernel {
+    // Keep the rows of `sel[0..n)` that pass, returns how many are left
+    using Fn = size_t (*)(const CompareKernel &, const RowBatch &, uint32_t *sel, size_t n);
+
+    Fn fn = nullptr;
+    size_t lhs = 0;
+    // Right column, or the literal when `rhs_is_col` is false
+    size_t rhs = 0;
+    Value lit;
+    bool rhs_is_col = false;
+    // For `dump`
+    std::string text;
+
+    void apply(RowBatch &batch) const {
+        batch.sel.resize(fn(*this, batch, batch.sel.data(), batch.sel.size()));
+    }
+
+    // `T` is the type both sides are compared as, `L` and `R` are the column types
+    template <CmpOp op, typename T, typename L, typename R, bool COLUMNS>
+    static size_t compare_kernel(const CompareKernel &k,
+                                 const RowBatch &batch,
+                                 uint32_t *sel,
+                                 size_t n) {
+        size_t out = 0;
+        if constexpr (COLUMNS) {
+            for (size_t i = 0; i < n; ++i) {
+                auto &row = batch.rows[sel[i]];
+                sel[out] = sel[i];
+                out += compare_as<op, T>(T(row[k.lhs].load<L>()), T(row[k.rhs].load<R>()));
+            }
+        } else {
+            const T y = T(k.lit.load<R>());
+            for (size_t i = 0; i < n; ++i) {
+                sel[out] = sel[i];
+                out += compare_as<op, T>(T(batch.rows[sel[i]][k.lhs].load<L>()), y);
+            }
+        }
+        return out;
+    }
+
+    template <typename T, typename L, typename R, bool COLUMNS>
+    static Fn pick(CmpOp op) {
+        switch (op) {
+            case CmpOp::Eq: return compare_kernel<CmpOp::Eq, T, L, R, COLUMNS>;
+            case CmpOp::Ne: return compare_kernel<CmpOp::Ne, T, L, R, COLUMNS>;
+            case CmpOp::Lt: return compare_kernel<CmpOp::Lt, T, L, R, COLUMNS>;
+            case CmpOp::Le: return compare_kernel<CmpOp::Le, T, L, R, COLUMNS>;
+            case CmpOp::Gt: return compare_kernel<CmpOp::Gt, T, L, R, COLUMNS>;
+            case CmpOp::Ge: return compare_kernel<CmpOp::Ge, T, L, R, COLUMNS>;
+        }
+        std::abort();
+    }
+
+    // INT is widened to double next to a FLOAT, strings only compare with strings
+    template <bool COLUMNS>
+    static Fn pick(CmpOp op, Table::FieldType l, Table::FieldType r) {
+        using FT = Table::FieldType;
+        if (l == FT::STRING || r == FT::STRING) {
+            if (l != r) {
+                return nullptr;
+            }
+            using S = std::string_view;
+            return pick<S, S, S, COLUMNS>(op);
+        }
+        if (l == FT::INT && r == FT::INT) {
+            return pick<int64_t, int64_t, int64_t, COLUMNS>(op);
+        }
+        if (l == FT::INT) {
+            return pick<double, int64_t, double, COLUMNS>(op);
+        }
+        if (r == FT::INT) {
+            return pick<double, double, int64_t, COLUMNS>(op);
+        }
+        return pick<double, double, double, COLUMNS>(op);
+    }
+};
+
+// A numeric `col op literal` comparison, or an AND / OR of them, tested on a whole batch at
+// once. The column is gathered into a contiguous buffer, compared by a `simd::compare`
+// kernel and the bitmaps of the operands are combined word by word.
+struct BitmapFilter {
+    enum class Kind : uint8_t { Compare, And, Or };
+
+    // Gathered cells of one batch
+    struct Scratch {
+        std::vector<int64_t> ints = std::vector<int64_t>(RowBatch::CAPACITY);
+        std::vector<double> doubles = std::vector<double>(RowBatch::CAPACITY);
+    };
+
+    static constexpr size_t WORDS = RowBatch::CAPACITY / 64;
+
+    Kind kind = Kind::Compare;
+    // Compare: INT columns against INT literals compare as int64, anything else as double
+    size_t col = 0;
+    CmpOp op = CmpOp::Eq;
+    bool int_col = false;
+    bool int_cmp = false;
+    int64_t int_lit = 0;
+    double double_lit = 0;
+    // And / Or
+    std::vector<BitmapFilter> operands;
+    // For `dump`
+    std::string text;
+
+    // Bitmap of the rows of `batch` that pass, selected or not
+    void eval(const RowBatch &batch, Scratch &scratch, uint64_t *bits) const {
+        const size_t n = batch.rows.size();
+        if (kind != Kind::Compare) {
+            uint64_t other[WORDS];
+            operands[0].eval(batch, scratch, bits);
+            for (size_t i = 1; i < operands.size(); ++i) {
+                operands[i].eval(batch, scratch, other);
+                if (kind == Kind::And) {
+                    simd::and_bits(bits, other, simd::bitmap_words(n));
+                } else {
+                    simd::or_bits(bits, other, simd::bitmap_words(n));
+                }
+            }
+            return;
+        }
+        if (int_cmp) {
+            for (size_t i = 0; i < n; ++i) {
+                scratch.ints[i] = batch.rows[i][col].load<int64_t>();
+            }
+            simd::compare(std::span<const int64_t>(scratch.ints.data(), n), op, int_lit, bits);
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            auto &cell = batch.rows[i][col];
+            scratch.doubles[i] = int_col ? double(cell.load<int64_t>()) : cell.load<double>();
+        }
+        simd::compare(std::span<const double>(scratch.doubles.data(), n), op, double_lit, bits);
+    }
+};
 
 class FilterPlan final : public PlanNode {
+    // Bitmap filters run first, then the typed conjuncts, the rest of the condition is
+    // interpreted on what is left
+    std::vector<BitmapFilter> bitmaps;
+    std::vector<CompareKernel> kernels;
     Predicate pred;
 
+    void apply_bitmaps(RowBatch &batch, BitmapFilter::Scratch &scratch) const {
+        const size_t words = simd::bitmap_words(batch.rows.size());
+        uint64_t keep[BitmapFilter::WORDS] = {};
+        uint64_t bits[BitmapFilter::WORDS];
+        for (auto i: batch.sel) {
+            keep[i / 64] |= uint64_t(1) << (i % 64);
+        }
+        for (auto &f: bitmaps) {
+            f.eval(batch, scratch, bits);
+            simd::and_bits(keep, bits, words);
+        }
+        // `sel` is always ascending, rebuilding it from the bitmap keeps the order
+        batch.sel.clear();
+        for (size_t w = 0; w < words; ++w) {
+            for (auto m = keep[w]; m != 0; m &= m - 1) {
+                batch.sel.push_back(uint32_t(w * 64 + std::countr_zero(m)));
+            }
+        }
+    }
+
 public:
-    explicit FilterPlan(Predicate p) : pred(std::move(p)) {}
+    FilterPlan(std::vector<BitmapFilter> bitmaps,
+               std::vector<CompareKernel> kernels,
+               Predicate p) :
+        bitmaps(std::move(bitmaps)), kernels(std::move(kernels)), pred(std::move(p)) {}
 
     void execute(ExecContext &ctx) const override {
-        auto next = ctx.with_consumer([&](const RowView &rv) {
-            if (pred(rv)) {
-                ctx.emit(rv);
+        BitmapFilter::Scratch scratch;
+        pull(ctx, [&](RowBatch &batch) {
+            assert(batch.rows.size() <= RowBatch::CAPACITY);
+            if (!bitmaps.empty()) {
+                apply_bitmaps(batch, scratch);
             }
+            for (auto &k: kernels) {
+                k.apply(batch);
+            }
+            if (!pred.empty()) {
+                size_t n = 0;
+                auto err = ExprProgram::Error::None;
+                for (auto i: batch.sel) {
+                    if (pred.test(batch.rows[i].cols, err)) {
+                        batch.sel[n++] = i;
+                    } else if (err != ExprProgram::Error::None) {
+                        ctx.fail(std::string(ExprProgram::error_message(err)));
+                        return;
+                    }
+                }
+                batch.sel.resize(n);
+            }
+            ctx.emit_batch(batch);
         });
-        child[0]->execute(next);
     }
 
     void dump(std::ostream &os, bool) const override {
-        os << "Filter\n";
+        os << "Filter";
+        size_t i = 0;
+        for (auto &f: bitmaps) {
+            os << (i++ == 0 ? "(" : ", ") << f.text;
+        }
+        for (auto &k: kernels) {
+            os << (i++ == 0 ? "(" : ", ") << k.text;
+        }
+        os << (i == 0 ? "" : ")") << '\n';
     }
 };
 
@@ -157,16 +796,18 @@ public:
     explicit OutputPlan(std::ostream &os) : os(os) {}
 
     void execute(ExecContext &ctx) const override {
-        auto next = ctx.with_consumer([&](const RowView &rv) {
-            for (size_t i = 0; i < rv.size(); ++i) {
-                rv[i].display(os);
-                if (i + 1 < rv.size()) {
-                    os << "|";
+        pull(ctx, [&](RowBatch &batch) {
+            for (size_t r = 0; r < batch.size(); ++r) {
+                auto &rv = batch[r];
+                for (size_t i = 0; i < rv.size(); ++i) {
+                    rv[i].display(os);
+                    if (i + 1 < rv.size()) {
+                        os << "|";
+                    }
                 }
+                os << '\n';
             }
-            os << '\n';
         });
-        child[0]->execute(next);
     }
 
     void dump(std::ostream &os, bool) const override {
@@ -177,7 +818,6 @@ public:
 struct ProjectItem {
     enum ProjectionKind { Avg, Max, Min, Col } kind;
 
-    // ValueExpr expr;
     size_t col;
 };
 
@@ -188,21 +828,29 @@ public:
     explicit ProjectPlan(std::vector<ProjectItem> idx) : indices(std::move(idx)) {}
 
     void execute(ExecContext &ctx) const override {
-        auto next = ctx.with_consumer([&](const RowView &rv) {
+        const size_t width = indices.size();
+        RowBatch out;
+        pull(ctx, [&](RowBatch &batch) {
+            // One block of cells for the whole batch, shared by its views
             auto owned = std::make_shared<std::vector<Value>>();
-            owned->reserve(indices.size());
-            for (auto i: indices) {
-                owned->push_back(rv[i.col]);
-            }
-            RowView out{
-                .table = nullptr,
-                .row_id = rv.row_id,
-                .cols = std::span<const Value>(*owned),
-                .owner = owned,
-            };
-            ctx.emit(out);
+            owned->reserve(batch.size() * width);
+            for (size_t r = 0; r < batch.size(); ++r) {
+                auto &rv = batch[r];
+                for (auto i: indices) {
+                    owned->push_back(rv[i.col]);
+                }
+            }
+            out.clear();
+            for (size_t r = 0; r < batch.size(); ++r) {
+                out.push(RowView{
+                    .table = nullptr,
+                    .row_id = batch[r].row_id,
+                    .cols = std::span<const Value>(owned->data() + r * width, width),
+                    .owner = owned,
+                });
+            }
+            ctx.emit_batch(out);
         });
-        child[0]->execute(next);
     }
 
     void dump(std::ostream &os, bool) const override {
@@ -229,9 +877,29 @@ public:
     }
 };
 
+class CreateIndexPlan final : public PlanNode {
+    Table *table;
+    size_t col;
+    Table::IndexKind kind;
+
+public:
+    CreateIndexPlan(Table *tb, size_t col, Table::IndexKind kind) : table(tb), col(col), kind(kind) {}
+
+    void execute(ExecContext &ctx) const override {
+        if (auto ret = table->create_index(col, kind); !ret) {
+            ctx.fail(ret.error());
+        }
+    }
+
+    void dump(std::ostream &os, bool) const override {
+        os << "Create Index (" << table->get_name() << '.' << table->get_schema()[col].name
+           << ", " << Table::index_kind_as_string(kind) << ")\n";
+    }
+};
+
 struct UpdateItem {
     size_t col_idx;
-    std::function<std::expected<Value, std::string>(const RowView &)> expr;
+    ExprProgram expr;
 };
 
 class UpdatePlan final : public PlanNode {
@@ -255,14 +923,12 @@ public:
                 return Table::ScanAction::Stop;
             }
 
-            RowView rv{
-                .table = table,
-                .row_id = row.id,
-                .cols = row.content,  // read-only use
-            };
-
-            if (cond(rv)) {
+            auto err = ExprProgram::Error::None;
+            if (cond.test(row.content, err)) {
                 targets.push_back(row.id);
+            } else if (err != ExprProgram::Error::None) {
+                ctx.fail(std::string(ExprProgram::error_message(err)));
+                return Table::ScanAction::Stop;
             }
 
             return Table::ScanAction::Keep;
@@ -273,57 +939,54 @@ public:
         }
 
         // Phase2: apply diffs
+        std::vector<Value> cells;
+        cells.reserve(diffs.size());
         for (auto row_id: targets) {
             auto row_ = table->find_by_id(row_id);
             if (!row_) {
                 continue;
             }
-            Table::Row *row = *row_;
-
-            RowView rv{
-                .table = table,
-                .row_id = row->id,
-                .cols = row->content,
-            };
+            // Every item reads the row as it was before the statement, on ROW tables
+            // `find_by_id` hands out the live row that `update` writes to
+            const std::vector<Value> before = (*row_)->content;
 
             std::stringstream ss;
-            table->dump_row(ss, row->id);
+            table->dump_row(ss, row_id);
             logging::debug("Update row: {}", ss.str());
 
+            cells.clear();
             for (auto &d: diffs) {
-                auto val = d.expr(rv);
+                auto val = d.expr.value(before);
                 if (!val) {
-                    ctx.fail(val.error());
+                    ctx.fail(std::string(ExprProgram::error_message(val.error())));
                     return;
                 }
 
-                auto &dst = row->content[d.col_idx];
-                auto dst_ty = dst.type;
+                auto dst_ty = table->get_schema()[d.col_idx].type;
                 auto src_ty = val->type;
 
+                Value cell;
                 if (src_ty == dst_ty) {
-                    dst = std::move(*val);
-                    continue;
-                }
-
-                if (dst_ty == Table::FieldType::FLOAT && src_ty == Table::FieldType::INT) {
-
-                    double promoted = static_cast<double>(*val->as_int());
-                    dst = Table::Value{double(promoted)};
-                    continue;
+                    cell = std::move(*val);
+                } else if (dst_ty == Table::FieldType::FLOAT && src_ty == Table::FieldType::INT) {
+                    cell = Table::Value{static_cast<double>(*val->as_int())};
+                } else if (src_ty == Table::FieldType::FLOAT && dst_ty == Table::FieldType::INT) {
+                    cell = Table::Value{static_cast<int64_t>(*val->as_double())};
+                } else {
+                    ctx.fail(std::format("Type mismatch on column `{}` ({} <- {})",
+                                         table->get_schema()[d.col_idx].name,
+                                         Table::field_ty_as_string(dst_ty),
+                                         Table::field_ty_as_string(src_ty)));
+                    return;
                 }
+                cells.push_back(std::move(cell));
+            }
 
-                if (src_ty == Table::FieldType::FLOAT && dst_ty == Table::FieldType::INT) {
-
-                    int64_t promoted = static_cast<int64_t>(*val->as_double());
-                    dst = Table::Value{int64_t(promoted)};
-                    continue;
+            for (size_t i = 0; i < diffs.size(); ++i) {
+                if (auto ret = table->update(row_id, diffs[i].col_idx, std::move(cells[i])); !ret) {
+                    ctx.fail(ret.error());
+                    return;
                 }
-                ctx.fail(std::format("Type mismatch on column `{}` ({} <- {})",
-                                     table->get_schema()[d.col_idx].name,
-                                     Table::field_ty_as_string(dst_ty),
-                                     Table::field_ty_as_string(src_ty)));
-                return;
             }
         }
     }
@@ -348,17 +1011,15 @@ public:
                 return Table::ScanAction::Stop;
             }
 
-            RowView rv{
-                .table = table,
-                .row_id = row.id,
-                .cols = row.content,
-            };
-
-            if (cond(rv)) {
+            auto err = ExprProgram::Error::None;
+            if (cond.test(row.content, err)) {
                 std::stringstream ss;
                 table->dump_row(ss, row.id);
                 logging::debug("Will delete row: {}", ss.str());
                 return Table::ScanAction::Delete;
+            } else if (err != ExprProgram::Error::None) {
+                ctx.fail(std::string(ExprProgram::error_message(err)));
+                return Table::ScanAction::Stop;
             }
 
             return Table::ScanAction::Keep;
@@ -380,22 +1041,26 @@ public:
 
     void execute(ExecContext &ctx) const override {
         std::vector<RowView> rows;
-
-        auto collect = [&](const RowView &rv) {
-            rows.push_back(rv);
-        };
-
-        auto next = ctx.with_consumer(collect);
-
-        for (auto *c: child) {
-            c->execute(next);
+        pull(ctx, [&](RowBatch &batch) {
+            for (auto i: batch.sel) {
+                rows.push_back(std::move(batch.rows[i]));
+            }
+        });
+        if (ctx.has_failed()) {
+            return;
         }
 
         std::sort(rows.begin(), rows.end(), comp);
 
+        RowBatch out;
         for (auto &rv: rows) {
-            ctx.emit(rv);
+            out.push(std::move(rv));
+            if (out.full()) {
+                ctx.emit_batch(out);
+                out.clear();
+            }
         }
+        ctx.emit_batch(out);
     }
 
     void dump(std::ostream &os, bool) const override {
@@ -410,13 +1075,6 @@ enum AggKind {
     Cnt,
 };
 
-struct Acc {
-    AggKind kind;
-    double dval = 0;
-    int64_t ival = 0;
-    size_t count = 0;
-};
-
 struct AggregateItem {
     AggKind kind;
     size_t col;
@@ -424,66 +1082,120 @@ struct AggregateItem {
 
 class AggregatePlan final : public PlanNode {
     std::vector<AggregateItem> items;
+    // Columns read by AVG / MIN / MAX items, each is reduced once for all items on it
+    std::vector<size_t> columns;
+    // Index into `columns` of every item, unused for COUNT
+    std::vector<size_t> column_of;
+
+    template <typename T>
+    static void fold_column(std::span<const T> vals,
+                            std::span<const uint64_t> live,
+                            simd::Totals &t) {
+        if (live.empty()) {
+            simd::reduce(vals, t);
+            return;
+        }
+        simd::reduce(vals.first(std::min(vals.size(), live.size() * 64)), live.data(), t);
+    }
 
-public:
-    explicit AggregatePlan(std::vector<AggregateItem> items) : items(std::move(items)) {}
-
-    void execute(ExecContext &ctx) const override {
-        std::vector<Acc> accs;
-        accs.reserve(items.size());
+    // Full scan over a COLUMN mode or mapped table: reduce the typed arrays directly, the
+    // live slot bitmap masks out deleted rows
+    bool fold_columns(ExecContext &ctx,
+                      const Table &tb,
+                      std::vector<simd::Totals> &totals,
+                      size_t &rows) const {
+        rows = tb.alive_rows();
+        auto live = tb.dead_slots() != 0 ? tb.live_bitmap() : std::span<const uint64_t>();
+        for (size_t c = 0; c < columns.size(); ++c) {
+            auto &col = tb.column(columns[c]);
+            switch (col.type) {
+                case Table::FieldType::INT: fold_column(col.int_data(), live, totals[c]); break;
+                case Table::FieldType::FLOAT:
+                    fold_column(col.float_data(), live, totals[c]);
+                    break;
+                case Table::FieldType::STRING:
+                    ctx.fail("aggregate expects numeric column");
+                    return false;
+            }
+        }
+        return true;
+    }
 
-        for (auto &it: items) {
-            Acc a{};
-            a.kind = it.kind;
-            if (it.kind == AggKind::Min)
-                a.dval = std::numeric_limits<double>::max();
-            if (it.kind == AggKind::Max)
-                a.dval = std::numeric_limits<double>::lowest();
-            accs.push_back(a);
-        }
-
-        auto sub = ctx.with_consumer([&](const RowView &rv) {
-            for (size_t i = 0; i < items.size(); ++i) {
-                auto &it = items[i];
-                auto &a = accs[i];
-
-                if (it.kind != AggKind::Cnt) {
-                    auto *num = rv[it.col].as_double();
-                    auto *num_i = rv[it.col].as_int();
-                    if (!num && !num_i) {
+    // Gather each column of the selected rows of a batch and reduce it
+    void execute_rows(ExecContext &ctx, std::vector<simd::Totals> &totals, size_t &rows) const {
+        std::vector<int64_t> ints(RowBatch::CAPACITY);
+        std::vector<double> doubles(RowBatch::CAPACITY);
+        pull(ctx, [&](RowBatch &batch) {
+            const size_t n = batch.size();
+            rows += n;
+            for (size_t c = 0; n > 0 && c < columns.size(); ++c) {
+                const size_t col = columns[c];
+                switch (batch[0][col].type) {
+                    case Table::FieldType::INT:
+                        for (size_t i = 0; i < n; ++i) {
+                            ints[i] = batch[i][col].load<int64_t>();
+                        }
+                        simd::reduce(std::span<const int64_t>(ints.data(), n), totals[c]);
+                        break;
+                    case Table::FieldType::FLOAT:
+                        for (size_t i = 0; i < n; ++i) {
+                            doubles[i] = batch[i][col].load<double>();
+                        }
+                        simd::reduce(std::span<const double>(doubles.data(), n), totals[c]);
+                        break;
+                    case Table::FieldType::STRING:
                         ctx.fail("aggregate expects numeric column");
                         return;
-                    }
-                    double val = num ? *num : double(*num_i);
-                    switch (it.kind) {
-                        case AggKind::Avg:
-                            a.dval += val;
-                            a.count++;
-                            break;
-                        case AggKind::Min: a.dval = std::min(a.dval, val); break;
-                        case AggKind::Max: a.dval = std::max(a.dval, val); break;
-                        default: break;
-                    }
-                } else {
-                    a.count++;
                 }
             }
         });
+    }
+
+public:
+    explicit AggregatePlan(std::vector<AggregateItem> items) : items(std::move(items)) {
+        for (auto &it: this->items) {
+            if (it.kind == AggKind::Cnt) {
+                column_of.push_back(0);
+                continue;
+            }
+            auto pos = std::ranges::find(columns, it.col);
+            column_of.push_back(pos - columns.begin());
+            if (pos == columns.end()) {
+                columns.push_back(it.col);
+            }
+        }
+    }
 
-        child[0]->execute(sub);
+    void execute(ExecContext &ctx) const override {
+        std::vector<simd::Totals> totals(columns.size());
+        size_t rows = 0;
+
+        auto *src = child[0]->scan_source();
+        if (src && (src->storage_mode() == Table::StorageMode::COLUMN || src->is_mapped())) {
+            if (!fold_columns(ctx, *src, totals, rows)) {
+                return;
+            }
+        } else {
+            execute_rows(ctx, totals, rows);
+            if (ctx.has_failed()) {
+                return;
+            }
+        }
 
         auto owned = std::make_shared<std::vector<Value>>();
         owned->reserve(items.size());
 
         for (size_t i = 0; i < items.size(); ++i) {
-            auto &it = items[i];
-            auto &a = accs[i];
-
-            switch (it.kind) {
-                case AggKind::Avg: owned->emplace_back(a.count ? a.dval / a.count : 0.0); break;
-                case AggKind::Cnt: owned->emplace_back(int64_t(a.count)); break;
-                case AggKind::Min:
-                case AggKind::Max: owned->emplace_back(a.dval); break;
+            if (items[i].kind == AggKind::Cnt) {
+                owned->emplace_back(int64_t(rows));
+                continue;
+            }
+            auto &t = totals[column_of[i]];
+            switch (items[i].kind) {
+                case AggKind::Avg: owned->emplace_back(t.count ? t.sum / t.count : 0.0); break;
+                case AggKind::Min: owned->emplace_back(t.min); break;
+                case AggKind::Max: owned->emplace_back(t.max); break;
+                case AggKind::Cnt: break;
             }
         }
 
@@ -526,6 +1238,14 @@ class PlanBuildContext {
     // pool
     std::vector<std::unique_ptr<PlanNode>> pool;
 
+    // Column names of the rows emitted by the last SELECT
+    std::vector<std::string> output_columns;
+
+    // SELECTs scan a `Table::snapshot()` and skip the indexes
+    bool snapshot_reads = false;
+    // Set once a statement that changes a table is appended
+    bool has_writes = false;
+
 public:
     PlanBuildContext(Table &table, TableView tb_view) : tb(table), tb_view(std::move(tb_view)) {}
 
@@ -541,6 +1261,7 @@ public:
                 continue;
             }
             plan->execute(ctx);
+            ctx.flush();
             if (ctx.has_failed()) {
                 break;
             }
@@ -549,6 +1270,21 @@ public:
 
     void clear() {
         batch.clear();
+        output_columns.clear();
+        has_writes = false;
+    }
+
+    const std::vector<std::string> &columns() const {
+        return output_columns;
+    }
+
+    // Plan SELECTs on snapshots, a batch without writes can then run without the tables
+    void read_snapshots(bool on) {
+        snapshot_reads = on;
+    }
+
+    [[nodiscard]] bool read_only() const {
+        return !has_writes;
     }
 
     void explain(std::ostream &os, bool color);
@@ -0,0 +1,397 @@
+#include "bulk.h"
+
+#include "args.h"
+#include "log.h"
+#include "misc.h"
+
+#include <cmath>
+#include <thread>
+#include <charconv>
+#include <optional>
+#include <algorithm>
+
+namespace gpamgr::bulk {
+utils::opt<int> import_threads("import-threads",
+                               "Threads used by .import, 0 picks the core count",
+                               0);
+
+namespace {
+using Value = Table::Value;
+using FieldType = Table::FieldType;
+
+// Chunks smaller than this are not worth a thread
+constexpr size_t MIN_CHUNK = 1 << 20;
+
+struct Chunk {
+    std::string_view text;
+    std::vector<Value> cells;
+    // Line within the chunk, 1-based, and the message of the first bad line
+    std::optional<std::pair<size_t, std::string>> error;
+};
+
+template <typename T>
+std::expected<Value, std::string> parse_number(std::string_view text, FieldType ty) {
+    auto s = utils::trim(text);
+    T v{};
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (s.empty() || ec != std::errc{} || end != s.data() + s.size()) {
+        return std::unexpected(
+            std::format("`{}` is not a valid {}", text, Table::field_ty_as_string(ty)));
+    }
+    return Value{v};
+}
+
+std::expected<Value, std::string> parse_cell(std::string_view text, FieldType ty) {
+    switch (ty) {
+        case FieldType::INT: return parse_number<int64_t>(text, ty);
+        case FieldType::FLOAT: return parse_number<double>(text, ty);
+        default: return Value{text};
+    }
+}
+
+// Append the cells of `line` to `row`. Cells past the schema are kept as strings so that
+// `validate_row` reports the field count.
+std::expected<void, std::string> parse_line(std::string_view line,
+                                            std::span<const Table::Field> schema,
+                                            std::vector<Value> &row,
+                                            std::string &scratch) {
+    size_t pos = 0;
+    while (true) {
+        std::string_view text;
+        if (pos < line.size() && line[pos] == '"') {
+            scratch.clear();
+            size_t i = pos + 1;
+            bool closed = false;
+            while (i < line.size()) {
+                if (line[i] != '"') {
+                    scratch += line[i++];
+                } else if (i + 1 < line.size() && line[i + 1] == '"') {
+                    scratch += '"';
+                    i += 2;
+                } else {
+                    closed = true;
+                    ++i;
+                    break;
+                }
+            }
+            if (!closed) {
+                return std::unexpected<std::string>("Unterminated quoted field");
+            }
+            if (i < line.size() && line[i] != ',') {
+                return std::unexpected<std::string>("Unexpected text after a quoted field");
+            }
+            text = scratch;
+            pos = i;
+        } else {
+            auto comma = std::min(line.find(',', pos), line.size());
+            text = line.substr(pos, comma - pos);
+            pos = comma;
+        }
+
+        auto ty = row.size() < schema.size() ? schema[row.size()].type : FieldType::STRING;
+        auto cell = parse_cell(text, ty);
+        if (!cell) {
+            return std::unexpected(std::format("Field {}: {}", row.size() + 1, cell.error()));
+        }
+        row.push_back(std::move(*cell));
+        if (pos >= line.size()) {
+            return {};
+        }
+        ++pos;
+    }
+}
+
+// Offset of the first line break at or after `pos` that is outside quotes, or `text.size()`.
+// `quoted` is the quote state at `pos` and stays false once a break is found. A doubled
+// quote toggles twice, so counting quotes is enough.
+size_t record_end(std::string_view text, size_t pos, bool &quoted) {
+    while (pos < text.size()) {
+        auto nl = std::min(text.find('\n', pos), text.size());
+        auto quote = std::min(text.find('"', pos), text.size());
+        if (quote < nl) {
+            quoted = !quoted;
+            pos = quote + 1;
+        } else if (quoted) {
+            pos = nl + 1;
+        } else {
+            return nl;
+        }
+    }
+    return text.size();
+}
+
+// Split `text` at the end of the next record, quoted fields may hold line breaks. `text`
+// keeps the rest.
+std::string_view next_line(std::string_view &text) {
+    bool quoted = false;
+    auto end = record_end(text, 0, quoted);
+    auto nl = end < text.size() ? end : std::string_view::npos;
+    auto line = text.substr(0, nl);
+    text = nl == std::string_view::npos ? std::string_view{} : text.substr(nl + 1);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+void parse_chunk(const Table &tb, Chunk &chunk) {
+    auto &schema = tb.get_schema();
+    std::vector<Value> row;
+    std::string scratch;
+    auto rest = chunk.text;
+    for (size_t line_no = 1, next_no = 1; !rest.empty(); line_no = next_no) {
+        auto line = next_line(rest);
+        next_no += 1 + std::count(line.begin(), line.end(), '\n');
+        if (line.empty()) {
+            continue;
+        }
+        row.clear();
+        auto ret = parse_line(line, schema, row, scratch);
+        if (ret) {
+            ret = tb.validate_row(row);
+        }
+        if (!ret) {
+            chunk.error.emplace(line_no, std::move(ret.error()));
+            return;
+        }
+        std::move(row.begin(), row.end(), std::back_inserter(chunk.cells));
+    }
+}
+
+bool is_header(std::string_view line, std::span<const Table::Field> schema) {
+    size_t i = 0;
+    while (true) {
+        auto comma = std::min(line.find(','), line.size());
+        if (i >= schema.size() || utils::trim(line.substr(0, comma)) != schema[i].name) {
+            return false;
+        }
+        ++i;
+        if (comma == line.size()) {
+            return i == schema.size();
+        }
+        line.remove_prefix(comma + 1);
+    }
+}
+}  // namespace
+
+std::expected<std::vector<Value>, std::string> parse_csv(const Table &tb, std::string_view text) {
+    size_t skipped_lines = 0;
+    auto rest = text;
+    if (is_header(next_line(rest), tb.get_schema())) {
+        text = rest;
+        skipped_lines = 1;
+    }
+
+    size_t threads = *import_threads > 0 ? size_t(*import_threads)
+                                         : std::max(1u, std::thread::hardware_concurrency());
+    size_t count = std::clamp(text.size() / MIN_CHUNK, size_t(1), threads);
+
+    // Cut at the first record end past each even split point. The quote state is carried
+    // from the start of the chunk, a line break inside a quoted field never splits.
+    std::vector<Chunk> chunks(count);
+    size_t begin = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t end = text.size();
+        if (i + 1 < count) {
+            bool quoted = false;
+            const size_t split = std::max(begin, text.size() * (i + 1) / count);
+            for (size_t q = text.find('"', begin); q < split; q = text.find('"', q + 1)) {
+                quoted = !quoted;
+            }
+            end = record_end(text, split, quoted);
+            end += end < text.size();
+        }
+        chunks[i].text = text.substr(begin, end - begin);
+        begin = end;
+    }
+
+    if (count == 1) {
+        parse_chunk(tb, chunks[0]);
+    } else {
+        std::vector<std::thread> workers;
+        workers.reserve(count);
+        for (auto &chunk: chunks) {
+            workers.emplace_back([&tb, &chunk] { parse_chunk(tb, chunk); });
+        }
+        for (auto &w: workers) {
+            w.join();
+        }
+    }
+
+    size_t line_base = skipped_lines;
+    size_t total = 0;
+    for (auto &chunk: chunks) {
+        if (chunk.error) {
+            return std::unexpected(std::format("Line {}: {}",
+                                               line_base + chunk.error->first,
+                                               chunk.error->second));
+        }
+        line_base += std::count(chunk.text.begin(), chunk.text.end(), '\n');
+        total += chunk.cells.size();
+    }
+
+    if (count == 1) {
+        return std::move(chunks[0].cells);
+    }
+    std::vector<Value> cells;
+    cells.reserve(total);
+    for (auto &chunk: chunks) {
+        std::move(chunk.cells.begin(), chunk.cells.end(), std::back_inserter(cells));
+        chunk.cells = {};
+    }
+    logging::debug("Parsed {} cells on {} threads", cells.size(), count);
+    return cells;
+}
+
+std::expected<std::vector<Value>, std::string> read_csv(const Table &tb, std::string_view path) {
+    auto file = utils::MappedFile::open(path);
+    if (!file) {
+        return std::unexpected(file.error());
+    }
+    return parse_csv(tb, std::string_view((*file)->data(), (*file)->size()));
+}
+
+std::optional<ExportFormat> export_format_of(std::string_view name) {
+    if (name == "csv") {
+        return ExportFormat::CSV;
+    }
+    if (name == "tsv") {
+        return ExportFormat::TSV;
+    }
+    if (name == "jsonl") {
+        return ExportFormat::JSONL;
+    }
+    return std::nullopt;
+}
+
+Exporter::Exporter(std::string_view path, ExportFormat format, std::vector<std::string> columns)
+    : format(format),
+      columns(std::move(columns)),
+      ofs(std::string(path), std::ios::binary | std::ios::trunc),
+      out(ofs) {}
+
+std::expected<std::unique_ptr<Exporter>, std::string>
+    Exporter::open(std::string_view path, ExportFormat format, std::vector<std::string> columns) {
+    std::unique_ptr<Exporter> ex(new Exporter(path, format, std::move(columns)));
+    if (!ex->ofs) {
+        return std::unexpected(std::format("Cannot open `{}`", path));
+    }
+    if (format != ExportFormat::JSONL) {
+        auto &buf = ex->out.buffer();
+        for (size_t i = 0; i < ex->columns.size(); ++i) {
+            if (i > 0) {
+                buf += format == ExportFormat::CSV ? ',' : '\t';
+            }
+            ex->put_string(buf, ex->columns[i]);
+        }
+        buf += '\n';
+    }
+    return ex;
+}
+
+void Exporter::put_string(std::string &buf, std::string_view s) const {
+    switch (format) {
+        case ExportFormat::CSV:
+            if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+                buf += s;
+                return;
+            }
+            buf += '"';
+            for (char c: s) {
+                if (c == '"') {
+                    buf += '"';
+                }
+                buf += c;
+            }
+            buf += '"';
+            return;
+        case ExportFormat::TSV:
+            for (char c: s) {
+                switch (c) {
+                    case '\t': buf += "\\t"; break;
+                    case '\n': buf += "\\n"; break;
+                    case '\r': buf += "\\r"; break;
+                    case '\\': buf += "\\\\"; break;
+                    default: buf += c;
+                }
+            }
+            return;
+        case ExportFormat::JSONL:
+            buf += '"';
+            for (char c: s) {
+                switch (c) {
+                    case '"': buf += "\\\""; break;
+                    case '\\': buf += "\\\\"; break;
+                    case '\n': buf += "\\n"; break;
+                    case '\r': buf += "\\r"; break;
+                    case '\t': buf += "\\t"; break;
+                    default:
+                        if (uint8_t(c) < 0x20) {
+                            std::format_to(std::back_inserter(buf), "\\u{:04x}", int(c));
+                        } else {
+                            buf += c;
+                        }
+                }
+            }
+            buf += '"';
+            return;
+    }
+}
+
+void Exporter::put_value(std::string &buf, const Table::Value &v) const {
+    char num[32];
+    std::to_chars_result res{};
+    switch (v.type) {
+        case FieldType::INT:
+            res = std::to_chars(num, num + sizeof(num), *v.as_int());
+            break;
+        case FieldType::FLOAT: {
+            double d = *v.as_double();
+            if (format == ExportFormat::JSONL && !std::isfinite(d)) {
+                buf += "null";
+                return;
+            }
+            res = std::to_chars(num, num + sizeof(num), d);
+            break;
+        }
+        case FieldType::STRING:
+            put_string(buf, *v.as_string());
+            return;
+    }
+    buf.append(num, res.ptr);
+}
+
+void Exporter::write_row(std::span<const Table::Value> cells) {
+    auto &buf = out.buffer();
+    if (format == ExportFormat::JSONL) {
+        buf += '{';
+        for (size_t i = 0; i < cells.size(); ++i) {
+            if (i > 0) {
+                buf += ',';
+            }
+            put_string(buf, i < columns.size() ? std::string_view(columns[i]) : "");
+            buf += ':';
+            put_value(buf, cells[i]);
+        }
+        buf += "}\n";
+    } else {
+        for (size_t i = 0; i < cells.size(); ++i) {
+            if (i > 0) {
+                buf += format == ExportFormat::CSV ? ',' : '\t';
+            }
+            put_value(buf, cells[i]);
+        }
+        buf += '\n';
+    }
+    ++rows;
+    out.commit();
+}
+
+std::expected<size_t, std::string> Exporter::finish() {
+    if (!out.finish()) {
+        return std::unexpected<std::string>("Failed to write the export file");
+    }
+    return rows;
+}
+
+}  // namespace gpamgr::bulk
@@ -0,0 +1,292 @@
+#include "codec.h"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+
+namespace gpamgr::codec {
+namespace {
+// Block header: first value, base, bit width | DELTA_BLOCK
+constexpr size_t HEADER_WORDS = 3;
+constexpr uint64_t DELTA_BLOCK = 1 << 8;
+constexpr uint64_t RAW_DOUBLES = ~uint64_t(0);
+
+constexpr double POW10[MAX_DECIMALS + 1] = {1.0, 10.0, 100.0, 1000.0, 10000.0};
+
+void put_word(std::string &out, uint64_t w) {
+    out.append(reinterpret_cast<const char *>(&w), sizeof(w));
+}
+
+uint64_t load_word(const char *p, size_t i) {
+    uint64_t w;
+    std::memcpy(&w, p + i * sizeof(w), sizeof(w));
+    return w;
+}
+
+size_t packed_words(size_t n, unsigned width) {
+    return (n * width + 63) / 64;
+}
+
+void pack(std::string &out, std::span<const uint64_t> offs, unsigned width) {
+    std::vector<uint64_t> words(packed_words(offs.size(), width));
+    if (width > 0) {
+        for (size_t i = 0; i < offs.size(); ++i) {
+            size_t bit = i * width;
+            words[bit / 64] |= offs[i] << (bit % 64);
+            if (bit % 64 + width > 64) {
+                words[bit / 64 + 1] |= offs[i] >> (64 - bit % 64);
+            }
+        }
+    }
+    out.append(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint64_t));
+}
+
+void unpack(const char *words, unsigned width, std::span<uint64_t> out) {
+    if (width == 0) {
+        std::ranges::fill(out, 0);
+        return;
+    }
+    const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    for (size_t i = 0; i < out.size(); ++i) {
+        size_t bit = i * width;
+        uint64_t x = load_word(words, bit / 64) >> (bit % 64);
+        if (bit % 64 + width > 64) {
+            x |= load_word(words, bit / 64 + 1) << (64 - bit % 64);
+        }
+        out[i] = x & mask;
+    }
+}
+
+void put_block(std::string &out, std::span<const int64_t> v, std::vector<uint64_t> &offs) {
+    // Unsigned arithmetic, differences wrap instead of overflowing
+    auto mn = std::ranges::min(v);
+    uint64_t for_span = 0;
+    for (auto x: v) {
+        for_span = std::max(for_span, uint64_t(x) - uint64_t(mn));
+    }
+    int64_t dmin = 0;
+    uint64_t delta_span = 0;
+    if (v.size() > 1) {
+        dmin = std::numeric_limits<int64_t>::max();
+        for (size_t i = 1; i < v.size(); ++i) {
+            dmin = std::min(dmin, int64_t(uint64_t(v[i]) - uint64_t(v[i - 1])));
+        }
+        for (size_t i = 1; i < v.size(); ++i) {
+            auto d = uint64_t(v[i]) - uint64_t(v[i - 1]);
+            delta_span = std::max(delta_span, d - uint64_t(dmin));
+        }
+    }
+
+    unsigned for_width = std::bit_width(for_span);
+    unsigned delta_width = std::bit_width(delta_span);
+    offs.resize(v.size());
+    if (delta_width < for_width) {
+        offs[0] = 0;
+        for (size_t i = 1; i < v.size(); ++i) {
+            offs[i] = uint64_t(v[i]) - uint64_t(v[i - 1]) - uint64_t(dmin);
+        }
+        put_word(out, uint64_t(v[0]));
+        put_word(out, uint64_t(dmin));
+        put_word(out, delta_width | DELTA_BLOCK);
+        pack(out, offs, delta_width);
+        return;
+    }
+    for (size_t i = 0; i < v.size(); ++i) {
+        offs[i] = uint64_t(v[i]) - uint64_t(mn);
+    }
+    put_word(out, uint64_t(v[0]));
+    put_word(out, uint64_t(mn));
+    put_word(out, for_width);
+    pack(out, offs, for_width);
+}
+
+// Number of fraction digits every value fits in, nullopt when some value does not
+std::optional<unsigned> decimals_of(std::span<const double> values) {
+    for (unsigned e = 0; e <= MAX_DECIMALS; ++e) {
+        bool exact = std::ranges::all_of(values, [&](double v) {
+            if (!(std::abs(v) < 1e15)) {
+                return false;
+            }
+            double back = double(std::llround(v * POW10[e])) / POW10[e];
+            return std::bit_cast<uint64_t>(back) == std::bit_cast<uint64_t>(v);
+        });
+        if (exact) {
+            return e;
+        }
+    }
+    return std::nullopt;
+}
+}  // namespace
+
+void put_ints(std::string &out, std::span<const int64_t> values) {
+    std::vector<uint64_t> offs;
+    for (size_t b = 0; b < values.size(); b += BLOCK) {
+        put_block(out, values.subspan(b, std::min(BLOCK, values.size() - b)), offs);
+    }
+}
+
+std::optional<size_t> get_ints(std::string_view in, std::span<int64_t> out) {
+    size_t pos = 0;
+    uint64_t offs[BLOCK];
+    for (size_t b = 0; b < out.size(); b += BLOCK) {
+        const size_t n = std::min(BLOCK, out.size() - b);
+        if (in.size() - pos < HEADER_WORDS * sizeof(uint64_t)) {
+            return std::nullopt;
+        }
+        auto first = load_word(in.data() + pos, 0);
+        auto base = load_word(in.data() + pos, 1);
+        auto mode = load_word(in.data() + pos, 2);
+        pos += HEADER_WORDS * sizeof(uint64_t);
+        unsigned width = mode & 0xff;
+        if (width > 64 || (mode & ~(DELTA_BLOCK | 0xff)) != 0) {
+            return std::nullopt;
+        }
+        size_t bytes = packed_words(n, width) * sizeof(uint64_t);
+        if (in.size() - pos < bytes) {
+            return std::nullopt;
+        }
+        unpack(in.data() + pos, width, std::span(offs, n));
+        pos += bytes;
+
+        auto dst = out.subspan(b, n);
+        if (mode & DELTA_BLOCK) {
+            uint64_t acc = first;
+            dst[0] = int64_t(acc);
+            for (size_t i = 1; i < n; ++i) {
+                acc += base + offs[i];
+                dst[i] = int64_t(acc);
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                dst[i] = int64_t(base + offs[i]);
+            }
+        }
+    }
+    return pos;
+}
+
+void put_doubles(std::string &out, std::span<const double> values) {
+    auto decimals = decimals_of(values);
+    if (!decimals) {
+        put_word(out, RAW_DOUBLES);
+        out.append(reinterpret_cast<const char *>(values.data()), values.size_bytes());
+        return;
+    }
+    put_word(out, *decimals);
+    std::vector<int64_t> scaled(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        scaled[i] = std::llround(values[i] * POW10[*decimals]);
+    }
+    put_ints(out, scaled);
+}
+
+std::optional<size_t> get_doubles(std::string_view in, std::span<double> out) {
+    if (in.size() < sizeof(uint64_t)) {
+        return std::nullopt;
+    }
+    auto decimals = load_word(in.data(), 0);
+    in.remove_prefix(sizeof(uint64_t));
+    if (decimals == RAW_DOUBLES) {
+        if (in.size() < out.size_bytes()) {
+            return std::nullopt;
+        }
+        std::memcpy(out.data(), in.data(), out.size_bytes());
+        return sizeof(uint64_t) + out.size_bytes();
+    }
+    if (decimals > MAX_DECIMALS) {
+        return std::nullopt;
+    }
+    std::vector<int64_t> scaled(out.size());
+    auto used = get_ints(in, scaled);
+    if (!used) {
+        return std::nullopt;
+    }
+    const double scale = POW10[decimals];
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = double(scaled[i]) / scale;
+    }
+    return sizeof(uint64_t) + *used;
+}
+
+void put_strings(std::string &out, std::span<const std::string_view> values) {
+    std::vector<int64_t> prefix(values.size());
+    std::vector<int64_t> suffix(values.size());
+    std::string_view prev;
+    size_t suffix_bytes = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto s = values[i];
+        auto [p, _] = std::ranges::mismatch(s, prev);
+        prefix[i] = p - s.begin();
+        suffix[i] = int64_t(s.size()) - prefix[i];
+        suffix_bytes += suffix[i];
+        prev = s;
+    }
+    put_ints(out, prefix);
+    put_ints(out, suffix);
+    put_word(out, suffix_bytes);
+    for (size_t i = 0; i < values.size(); ++i) {
+        out.append(values[i].substr(prefix[i]));
+    }
+}
+
+std::optional<size_t> get_strings(std::string_view in,
+                                  size_t n,
+                                  std::vector<uint64_t> &offsets,
+                                  std::vector<uint32_t> &lengths,
+                                  std::string &heap) {
+    std::vector<int64_t> prefix(n);
+    std::vector<int64_t> suffix(n);
+    size_t pos = 0;
+    for (auto *lens: {&prefix, &suffix}) {
+        auto used = get_ints(in.substr(pos), *lens);
+        if (!used) {
+            return std::nullopt;
+        }
+        pos += *used;
+    }
+    if (in.size() - pos < sizeof(uint64_t)) {
+        return std::nullopt;
+    }
+    auto suffix_bytes = load_word(in.data() + pos, 0);
+    pos += sizeof(uint64_t);
+    if (in.size() - pos < suffix_bytes) {
+        return std::nullopt;
+    }
+    auto tail = in.substr(pos, suffix_bytes);
+
+    offsets.resize(n);
+    lengths.resize(n);
+    uint64_t total = 0;
+    uint64_t suffix_total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t p = prefix[i], s = suffix[i];
+        uint64_t len = p + s;
+        if (p > (i > 0 ? lengths[i - 1] : 0) || s > suffix_bytes || len > UINT32_MAX) {
+            return std::nullopt;
+        }
+        offsets[i] = total;
+        lengths[i] = uint32_t(len);
+        total += len;
+        suffix_total += s;
+    }
+    if (suffix_total != suffix_bytes) {
+        return std::nullopt;
+    }
+
+    // A shared prefix is copied from the previous string, which ends before this one starts
+    heap.resize(total);
+    size_t cursor = 0;
+    for (size_t i = 0; i < n; ++i) {
+        auto p = size_t(prefix[i]);
+        if (p > 0) {
+            std::memcpy(heap.data() + offsets[i], heap.data() + offsets[i - 1], p);
+        }
+        std::memcpy(heap.data() + offsets[i] + p, tail.data() + cursor, lengths[i] - p);
+        cursor += lengths[i] - p;
+    }
+    return pos + suffix_bytes;
+}
+
+}  // namespace gpamgr::codec
@@ -1,6 +1,7 @@
 #include "driver.h"
 
 #include "log.h"
+#include "bulk.h"
 #include "sql.h"
 #include "args.h"
 #include "misc.h"
@@ -20,7 +21,22 @@
 
 namespace gpamgr {
 
+utils::opt<bool> snapshot_reads("snapshot-reads",
+                                "Run SELECTs on table snapshots without holding off writers",
+                                false);
+
 CommandRet ScriptDriver::do_command(std::string_view cmd) {
+    std::unique_lock lock(tb_mutex);
+    auto ret = dispatch(cmd, lock);
+    if (!lock.owns_lock()) {
+        lock.lock();
+    }
+    auto_vacuum();
+    note_command();
+    return ret;
+}
+
+CommandRet ScriptDriver::dispatch(std::string_view cmd, std::unique_lock<std::mutex> &lock) {
     cmd = utils::trim(cmd);
     if (cmd.starts_with('.')) {
         // pseudo
@@ -32,7 +48,7 @@ CommandRet ScriptDriver::do_command(std::string_view cmd) {
     } else if (cmd.ends_with(';')) {
         // mini-sql
         logging::debug("Got mini-sql command `{}`", cmd);
-        return handle_sql(cmd);
+        return handle_sql(cmd, lock);
     } else {
         // err
         logging::debug("Illegal stmt `{}`", cmd);
@@ -70,6 +86,249 @@ CommandRet ScriptDriver::do_file(std::string_view path) {
     return {CommandStat::Continue, ""};
 }
 
+utils::opt<int> flush_every("flush-every",
+                            "Checkpoint dirty tables every N commands, 0 to disable",
+                            256);
+
+utils::opt<int> flush_interval_ms("flush-interval-ms",
+                                  "Checkpoint dirty tables every T milliseconds, 0 to disable",
+                                  30000);
+
+utils::opt<int> flush_memory_mb("flush-memory-mb",
+                                "Checkpoint once unflushed changes exceed this size, 0 to disable",
+                                64);
+
+void ScriptDriver::start_flusher() {
+    if (flusher.joinable()) {
+        return;
+    }
+    flusher_stop = false;
+    // Set before the thread exists so `.status` never sees a started flusher as stopped
+    flush_stat.running = true;
+    flusher = std::thread([this] { flusher_loop(); });
+}
+
+void ScriptDriver::stop_flusher() {
+    if (!flusher.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard lock(tb_mutex);
+        flusher_stop = true;
+    }
+    flush_cv.notify_all();
+    flusher.join();
+    flush_stat.running = false;
+}
+
+void ScriptDriver::flush_tables() {
+    if (flusher.joinable()) {
+        // Already under `tb_mutex` when reached from a command
+        flush_requested = true;
+        flush_cv.notify_all();
+        return;
+    }
+    for (auto &[_, tb]: tb_pool) {
+        tb->flush();
+    }
+}
+
+std::expected<size_t, std::string> ScriptDriver::vacuum(std::string_view name) {
+    if (!name.empty()) {
+        auto it = tb_pool.find(std::string(name));
+        if (it == tb_pool.end()) {
+            return std::unexpected(std::format("Table `{}` is not in memory", name));
+        }
+        return it->second->vacuum();
+    }
+    size_t reclaimed = 0;
+    for (auto &[_, tb]: tb_pool) {
+        reclaimed += tb->vacuum();
+    }
+    return reclaimed;
+}
+
+std::expected<size_t, std::string> ScriptDriver::analyze(std::string_view name) {
+    if (!name.empty()) {
+        auto it = tb_pool.find(std::string(name));
+        if (it == tb_pool.end()) {
+            return std::unexpected(std::format("Table `{}` is not in memory", name));
+        }
+        it->second->analyze();
+        return 1;
+    }
+    for (auto &[_, tb]: tb_pool) {
+        tb->analyze();
+    }
+    return tb_pool.size();
+}
+
+std::expected<size_t, std::string> ScriptDriver::import_csv(std::string_view path,
+                                                           std::string_view name) {
+    Table *tb = curr_tbl;
+    if (!name.empty()) {
+        auto it = tb_pool.find(std::string(name));
+        if (it == tb_pool.end()) {
+            return std::unexpected(std::format("Table `{}` is not in memory", name));
+        }
+        tb = it->second.get();
+    }
+    if (!tb) {
+        return std::unexpected<std::string>("No table selected");
+    }
+    auto cells = bulk::read_csv(*tb, path);
+    if (!cells) {
+        return std::unexpected(cells.error());
+    }
+    return tb->insert_batch(*cells);
+}
+
+std::expected<size_t, std::string>
+    ScriptDriver::export_rows(std::string_view format, std::string_view path, std::string_view sql) {
+    auto fmt = bulk::export_format_of(format);
+    if (!fmt) {
+        return std::unexpected(std::format("Unknown export format `{}`", format));
+    }
+    if (!curr_tbl) {
+        return std::unexpected<std::string>("No table selected");
+    }
+
+    if (sql.empty()) {
+        std::vector<std::string> columns;
+        for (auto &f: curr_tbl->get_schema()) {
+            columns.push_back(f.name);
+        }
+        auto ex = bulk::Exporter::open(path, *fmt, std::move(columns));
+        if (!ex) {
+            return std::unexpected(ex.error());
+        }
+        curr_tbl->scan([&](const Table::Row &row) { (*ex)->write_row(row.content); });
+        return (*ex)->finish();
+    }
+
+    auto ctx = PlanBuildContext(*curr_tbl, table_view());
+    auto ret = ctx.append_sql(sql);
+    if (!ret.has_value()) {
+        std::string msg;
+        for (auto &e: ret.error()) {
+            msg += e.to_string();
+        }
+        return std::unexpected(std::move(msg));
+    }
+    if (ctx.columns().empty()) {
+        return std::unexpected<std::string>("Only the rows of a SELECT can be exported");
+    }
+    auto ex = bulk::Exporter::open(path, *fmt, ctx.columns());
+    if (!ex) {
+        return std::unexpected(ex.error());
+    }
+    ExecContext exec([&](RowView rv) { (*ex)->write_row(rv.cols); });
+    ctx.execute_with_ctx(exec);
+    if (exec.has_failed()) {
+        return std::unexpected(std::string(exec.error_msg()));
+    }
+    return (*ex)->finish();
+}
+
+void ScriptDriver::auto_vacuum() {
+    for (auto &[name, tb]: tb_pool) {
+        if (tb->needs_vacuum()) {
+            auto n = tb->vacuum();
+            logging::info("Compacted `{}`, {} dead slots released", name, n);
+        }
+    }
+}
+
+ScriptDriver::FlushState ScriptDriver::flush_state() {
+    std::lock_guard lock(tb_mutex);
+    return flush_stat;
+}
+
+// Called with `tb_mutex` held after every command
+void ScriptDriver::note_command() {
+    if (!flusher.joinable()) {
+        return;
+    }
+    ++stmts_since_flush;
+    bool due = *flush_every > 0 && stmts_since_flush >= size_t(*flush_every);
+    if (!due && *flush_memory_mb > 0) {
+        size_t pending = 0;
+        for (auto &[_, tb]: tb_pool) {
+            pending += tb->pending_log_bytes();
+        }
+        due = pending >= size_t(*flush_memory_mb) << 20;
+    }
+    if (due) {
+        flush_requested = true;
+        flush_cv.notify_all();
+    }
+}
+
+void ScriptDriver::flusher_loop() {
+    std::unique_lock lock(tb_mutex);
+    while (true) {
+        auto interval = std::chrono::milliseconds(std::max(*flush_interval_ms, 0));
+        auto woken = [&] {
+            return flusher_stop || flush_requested;
+        };
+        if (interval.count() > 0) {
+            flush_cv.wait_for(lock, interval, woken);
+        } else {
+            flush_cv.wait(lock, woken);
+        }
+        if (flusher_stop) {
+            // The rest is flushed by the destructor
+            break;
+        }
+        flush_requested = false;
+        stmts_since_flush = 0;
+        flush_round(lock);
+    }
+}
+
+void ScriptDriver::flush_round(std::unique_lock<std::mutex> &lock) {
+    ++flush_stat.rounds;
+    std::vector<Table *> dirty;
+    for (auto &[_, tb]: tb_pool) {
+        if (tb->is_dirty()) {
+            dirty.push_back(tb.get());
+        }
+    }
+    for (auto *tb: dirty) {
+        // Tables may be dropped while the lock is released
+        bool alive = std::ranges::any_of(tb_pool, [&](auto &kv) { return kv.second.get() == tb; });
+        if (!alive || !tb->is_dirty()) {
+            continue;
+        }
+        if (!tb->needs_checkpoint()) {
+            tb->flush();
+            ++flush_stat.appends;
+            continue;
+        }
+
+        // Pin a snapshot under the lock, serialize and write it without
+        auto image = tb->begin_checkpoint();
+        auto path = std::string(tb->get_file_path());
+        flush_stat.busy = tb->get_name();
+        lock.unlock();
+        auto res = image.write(path);
+        lock.lock();
+        flush_stat.busy.clear();
+
+        // `erase_table` retires a table with a checkpoint in flight, so `tb` is still valid
+        tb->finish_checkpoint(res.has_value());
+        if (res.has_value()) {
+            ++flush_stat.checkpoints;
+        } else {
+            ++flush_stat.failures;
+            flush_stat.last_error = res.error();
+            logging::warn("Background checkpoint of `{}` failed: {}", path, res.error());
+        }
+        std::erase_if(retired, [](auto &t) { return !t->checkpoint_running(); });
+    }
+    flush_stat.last_flush = std::chrono::steady_clock::now();
+}
+
 utils::opt<int> history_max_size("history-max-size",
                                  "Max line limit of interactive shell history",
                                  1000);
@@ -142,6 +401,81 @@ CommandRet pp_on_status(ScriptDriver &self, std::string_view args) {
     return CommandRet{CommandStat::Continue, ""};
 }
 
+CommandRet pp_on_flush(ScriptDriver &self, std::string_view args) {
+    self.flush_tables();
+    return CommandRet{CommandStat::Continue, ""};
+}
+
+CommandRet pp_on_vacuum(ScriptDriver &self, std::string_view args) {
+    auto table = utils::trim(args);
+    auto ret = self.vacuum(table);
+    if (!ret) {
+        return CommandRet{CommandStat::Error, ret.error()};
+    }
+    return CommandRet{CommandStat::Continue, std::format("{} dead slots released", *ret)};
+}
+
+CommandRet pp_on_analyze(ScriptDriver &self, std::string_view args) {
+    auto table = utils::trim(args);
+    auto ret = self.analyze(table);
+    if (!ret) {
+        return CommandRet{CommandStat::Error, ret.error()};
+    }
+    // Print the statistics of the named table, or of the current one
+    const Table *tbl = nullptr;
+    if (!table.empty()) {
+        tbl = self.table_view().at(std::string(table));
+    } else if (auto curr = self.curr_table()) {
+        tbl = *curr;
+    }
+    if (tbl) {
+        tbl->dump_stats(std::cout);
+    }
+    return CommandRet{CommandStat::Continue, std::format("{} tables analyzed", *ret)};
+}
+
+CommandRet pp_on_import(ScriptDriver &self, std::string_view args) {
+    args = utils::trim(args);
+    auto pos = args.find_first_of(" \t");
+    auto path = args.substr(0, pos);
+    auto table = pos == utils::svnpos ? std::string_view{} : utils::trim(args.substr(pos));
+    if (path.empty()) {
+        return CommandRet{CommandStat::Error, "Usage: .import <csv> [table]"};
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto ret = self.import_csv(path, table);
+    if (!ret) {
+        return CommandRet{CommandStat::Error, ret.error()};
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    return CommandRet{CommandStat::Continue, std::format("{} rows imported in {} ms", *ret, ms.count())};
+}
+
+CommandRet pp_on_export(ScriptDriver &self, std::string_view args) {
+    auto next_word = [&] {
+        args = utils::ltrim(args);
+        auto pos = std::min(args.find_first_of(" \t"), args.size());
+        auto word = args.substr(0, pos);
+        args.remove_prefix(pos);
+        return word;
+    };
+    auto format = next_word();
+    auto path = next_word();
+    if (path.empty()) {
+        return CommandRet{CommandStat::Error, "Usage: .export <csv|tsv|jsonl> <file> [sql]"};
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto ret = self.export_rows(format, path, utils::trim(args));
+    if (!ret) {
+        return CommandRet{CommandStat::Error, ret.error()};
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    return CommandRet{CommandStat::Continue,
+                      std::format("{} rows exported in {} ms", *ret, ms.count())};
+}
+
 CommandRet pp_on_help(ScriptDriver &, std::string_view args) {
     std::stringstream ss;
     const auto &reg = pseudo_registry();
@@ -213,6 +547,7 @@ CommandRet pp_on_explain(ScriptDriver &self, std::string_view args) {
         return CommandRet{CommandStat::Error, "No table selected"};
     }
     auto ctx = PlanBuildContext(*curr_tbl.value(), self.table_view());
+    ctx.read_snapshots(snapshot_reads);
     auto sql = utils::trim(args);
     auto lexed = lex(sql);
     if (!lexed.has_value()) {
@@ -249,21 +584,45 @@ CommandRet pp_on_explain(ScriptDriver &self, std::string_view args) {
 
 std::expected<Table::SchemaDesc, std::string> parse_schema(std::string_view sv);
 
+std::optional<Table::StorageMode> parse_storage_mode(std::string_view sv) {
+    if (sv == "row" || sv == "ROW") {
+        return Table::StorageMode::ROW;
+    }
+    if (sv == "column" || sv == "columnar" || sv == "COLUMN" || sv == "COLUMNAR") {
+        return Table::StorageMode::COLUMN;
+    }
+    return std::nullopt;
+}
+
 CommandRet pp_on_create(ScriptDriver &self, std::string_view args) {
     args = utils::trim(args);
 
     auto space = args.find(' ');
     if (space == std::string_view::npos) {
-        return {CommandStat::Error, "Usage: .create <table_name> <schema>"};
+        return {CommandStat::Error, "Usage: .create <table_name> [row|column] <schema>"};
     }
 
     auto name = utils::trim(args.substr(0, space));
     auto schema_part = utils::trim(args.substr(space + 1));
 
+    // optional storage mode before the field list
+    auto storage = Table::StorageMode::ROW;
+    if (auto blank = schema_part.find_first_of(utils::BLANK_CHARS); blank != utils::svnpos) {
+        if (auto mode = parse_storage_mode(schema_part.substr(0, blank))) {
+            storage = *mode;
+            schema_part = utils::trim(schema_part.substr(blank + 1));
+        }
+    }
+
     auto schema = parse_schema(schema_part);
     if (!schema) {
         return {CommandStat::Error, std::format("Create table failed: {}", schema.error())};
     }
+    schema->storage = storage;
+    if (storage != Table::StorageMode::COLUMN &&
+        std::ranges::any_of(schema->fields, [](auto &f) { return f.dict; })) {
+        return {CommandStat::Error, "Create table failed: `dict` fields need COLUMN storage"};
+    }
 
     auto tbl = self.create_table(name, std::move(*schema));
     if (!tbl) {
@@ -338,6 +697,7 @@ std::expected<Table::SchemaDesc, std::string> parse_schema(std::string_view sv)
         }
 
         bool is_primary = false;
+        bool dict = false;
         if (!modifiers.empty()) {
             // normalize to lower-case for comparison
             std::string mod;
@@ -352,12 +712,21 @@ std::expected<Table::SchemaDesc, std::string> parse_schema(std::string_view sv)
                 }
                 is_primary = true;
                 has_primary = true;
+            } else if (mod == "dict") {
+                if (*type != Table::FieldType::STRING) {
+                    return std::unexpected(
+                        std::format("Dictionary encoding needs a STRING field, `{}` is not", name));
+                }
+                dict = true;
             } else {
                 return std::unexpected(std::format("Unknown field modifier `{}`", modifiers));
             }
         }
 
-        schema.fields.push_back({std::string(name), *type, is_primary});
+        schema.fields.push_back({.name = std::string(name),
+                                 .type = *type,
+                                 .is_primary = is_primary,
+                                 .dict = dict});
 
         if (comma == std::string_view::npos)
             break;
@@ -380,17 +749,22 @@ std::expected<Table::SchemaDesc, std::string> parse_schema(std::string_view sv)
 const ScriptDriver::PseudoMap &pseudo_registry() {
     // clang-format off
     const static ScriptDriver::PseudoMap table = {
-        { ".quit",     { ".quit -- Quit interactive shell",               pp_on_quit    } },
-        { ".debug",    { ".debug -- Debug print driver status",           pp_on_debug   } },
-        { ".status",   { ".status -- Print driver status",                pp_on_status  } },
-        { ".help",     { ".help -- Print help message",                   pp_on_help    } },
-        { ".sql-doc",  { ".sql-doc -- Print document of mini-sql",        pp_on_sql_doc } },
-        { ".load",     { ".load <path/to/table> -- load table from file", pp_on_load    } },
-        { ".use",      { ".use <table> -- use a table",                   pp_on_use     } },
-        { ".schema",   { ".schema -- Display schema of current table",    pp_on_schema  } },
-        { ".explain",  { ".explain <sql stmt> -- Explain an sql command", pp_on_explain } },
-        { ".create",   { ".create <name> <schema> -- create a new table", pp_on_create  } },
-        { ".drop",     { ".drop <name> -- Drop a table in memory",        pp_on_drop    } },
+        { ".quit",    { ".quit -- Quit interactive shell",                            pp_on_quit    } },
+        { ".debug",   { ".debug -- Debug print driver status",                        pp_on_debug   } },
+        { ".status",  { ".status -- Print driver status",                             pp_on_status  } },
+        { ".help",    { ".help -- Print help message",                                pp_on_help    } },
+        { ".sql-doc", { ".sql-doc -- Print document of mini-sql",                     pp_on_sql_doc } },
+        { ".load",    { ".load <path/to/table> -- load table from file",              pp_on_load    } },
+        { ".use",     { ".use <table> -- use a table",                                pp_on_use     } },
+        { ".schema",  { ".schema -- Display schema of current table",                 pp_on_schema  } },
+        { ".explain", { ".explain <sql stmt> -- Explain an sql command",              pp_on_explain } },
+        { ".create",  { ".create <name> [row|column] <schema> -- create a new table", pp_on_create  } },
+        { ".drop",    { ".drop <name> -- Drop a table in memory",                     pp_on_drop    } },
+        { ".flush",   { ".flush -- Write changes of every table to disk",             pp_on_flush   } },
+        { ".vacuum",  { ".vacuum [table] -- Release the dead slots of tables",        pp_on_vacuum  } },
+        { ".analyze", { ".analyze [table] -- Collect column statistics of tables",    pp_on_analyze } },
+        { ".import",  { ".import <csv> [table] -- Append the rows of a csv file",      pp_on_import  } },
+        { ".export",  { ".export <csv|tsv|jsonl> <file> [sql] -- Write rows to a file", pp_on_export  } },
     };
     // clang-format on
     return table;
@@ -409,12 +783,13 @@ CommandRet ScriptDriver::handle_pseudo(std::string_view cmd) {
     return it->second.handler(*this, args);
 }
 
-CommandRet ScriptDriver::handle_sql(std::string_view cmd) {
+CommandRet ScriptDriver::handle_sql(std::string_view cmd, std::unique_lock<std::mutex> &lock) {
     if (!curr_tbl) {
         logging::debug("No table selected");
         return CommandRet{CommandStat::Error, "No table selected"};
     }
     auto ctx = PlanBuildContext(*curr_tbl, table_view());
+    ctx.read_snapshots(snapshot_reads);
     auto ret = ctx.append_sql(cmd);
     if (!ret.has_value()) {
         logging::debug("Cannot append sql");
@@ -434,6 +809,10 @@ CommandRet ScriptDriver::handle_sql(std::string_view cmd) {
         std::cout << '\n';
     };
     exec_ctx = exec_ctx.with_consumer(printer);
+    if (snapshot_reads && ctx.read_only()) {
+        // Every row comes from pinned snapshots, writers may go on meanwhile
+        lock.unlock();
+    }
     logging::debug("Execution Begin");
     ctx.execute_with_ctx(exec_ctx);
     logging::debug("Execution Ends");
@@ -476,13 +855,7 @@ std::expected<Table *, std::string> ScriptDriver::create_table(std::string_view
         return std::unexpected("Table already exists");
     }
     auto tbl = std::make_unique<Table>(name, std::string(name) + ".gpa");
-    tbl->schema = std::move(desc).fields;
-    const auto N = tbl->schema.size();
-    for (uint64_t i = 0; i < N; ++i) {
-        if (tbl->schema[i].is_primary) {
-            tbl->primary_field = i;
-        }
-    }
+    tbl->init_schema(std::move(desc));
     tbl->dirty = true;
     Table *raw = tbl.get();
     tb_pool.emplace(std::move(key), std::move(tbl));
@@ -530,6 +903,10 @@ std::optional<std::string> ScriptDriver::erase_table(std::string_view name) {
     it->second->flush();
     // std::filesystem::remove(it->second->file_path());
 
+    if (it->second->checkpoint_running()) {
+        // Finished and released by the flusher
+        retired.push_back(std::move(it->second));
+    }
     tb_pool.erase(it);
     return std::nullopt;
 }
@@ -540,6 +917,8 @@ bool ScriptDriver::has_table(std::string_view name) const {
 }
 
 ScriptDriver::~ScriptDriver() {
+    stop_flusher();
+    retired.clear();
     for (auto &tb: tb_pool) {
         tb.second->flush();
     }
@@ -558,13 +937,35 @@ void ScriptDriver::debug_dump() {
         auto cb = [&tb](const Table::Row &row) -> void {
             tb->dump_row(row.id);
         };
-        tb->scan(cb);
+        tb->scan(cb, Table::ScanOrder::Insertion);
     }
 }
 
 void ScriptDriver::dump_status() {
     std::cout << utils::StyledText::format("Table count: {}", tb_pool.size()).yellow().bold()
               << '\n';
+    if (flush_stat.running) {
+        auto since = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - flush_stat.last_flush);
+        std::cout << utils::StyledText::format(
+                         "Flusher: {} rounds, {} checkpoints, {} appends, {} failures{}",
+                         flush_stat.rounds,
+                         flush_stat.checkpoints,
+                         flush_stat.appends,
+                         flush_stat.failures,
+                         flush_stat.rounds ? std::format(", last {}ms ago", since.count()) : "")
+                         .yellow()
+                         .bold()
+                  << '\n';
+        if (!flush_stat.last_error.empty()) {
+            std::cout << utils::StyledText::format("Last flush error: {}", flush_stat.last_error)
+                             .red()
+                             .bold()
+                      << '\n';
+        }
+    } else {
+        std::cout << utils::StyledText("Flusher: stopped").yellow().bold() << '\n';
+    }
     if (!curr_tbl) {
         std::cout << utils::StyledText("[No current table]\n").bold();
     }
@@ -574,6 +975,75 @@ void ScriptDriver::dump_status() {
             std::cout << utils::StyledText(" CURR").bold().magenta();
         }
         std::cout << '\n';
+        std::cout << utils::StyledText::format("Storage: {}{}",
+                                               Table::storage_mode_as_string(tb->storage_mode()),
+                                               tb->is_mapped() ? " (mapped)" : "")
+                         .magenta()
+                         .bold()
+                  << '\n';
+        std::cout << utils::StyledText::format("Slots: {} live, {} dead",
+                                               tb->alive_rows(),
+                                               tb->dead_slots())
+                         .magenta()
+                         .bold()
+                  << '\n';
+        auto &dir = tb->rowid_directory();
+        std::cout << utils::StyledText::format("Rowid directory: {} rows, {} pages, {} bytes",
+                                               dir.size(),
+                                               dir.page_count(),
+                                               dir.memory_bytes())
+                         .magenta()
+                         .bold()
+                  << '\n';
+        for (auto &f: tb->get_schema()) {
+            if (f.indexed) {
+                auto *idx = tb->ordered_index(*tb->field_index(f.name));
+                std::cout << utils::StyledText::format("Index on `{}`: {} entries, {} nodes",
+                                                       f.name,
+                                                       idx->size(),
+                                                       idx->node_count())
+                                 .magenta()
+                                 .bold()
+                          << '\n';
+            }
+            if (f.hashed) {
+                auto *idx = tb->hash_index(*tb->field_index(f.name));
+                std::cout << utils::StyledText::format("Hash index on `{}`: {} entries, {} slots",
+                                                       f.name,
+                                                       idx->size(),
+                                                       idx->capacity())
+                                 .magenta()
+                                 .bold()
+                          << '\n';
+            }
+            if (f.dict) {
+                auto &col = tb->column(*tb->field_index(f.name));
+                std::cout << utils::StyledText::format("Dictionary on `{}`: {} entries",
+                                                       f.name,
+                                                       col.dict_size())
+                                 .magenta()
+                                 .bold()
+                          << '\n';
+            }
+            if (f.trigram) {
+                auto *idx = tb->trigram_index(*tb->field_index(f.name));
+                std::cout << utils::StyledText::format(
+                                 "Trigram index on `{}`: {} entries, {} trigrams",
+                                 f.name,
+                                 idx->size(),
+                                 idx->gram_count())
+                                 .magenta()
+                                 .bold()
+                          << '\n';
+            }
+        }
+        std::cout << utils::StyledText::format("Write-ahead log: {} bytes{}{}",
+                                               tb->wal_size(),
+                                               tb->is_dirty() ? ", dirty" : "",
+                                               tb->checkpoint_running() ? ", checkpointing" : "")
+                         .magenta()
+                         .bold()
+                  << '\n';
         std::cout << utils::StyledText("Schema:").magenta().bold() << '\n';
         tb->dump_schema(std::cout);
         std::cout << '\n';
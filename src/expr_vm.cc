@@ -0,0 +1,116 @@
+#include "expr_vm.h"
+
+#include "misc.h"
+
+#include <cmath>
+
+namespace gpamgr {
+namespace {
+std::string_view view_of(const ExprProgram::Reg &r) {
+    return {r.s.data, r.s.size};
+}
+
+void set_view(ExprProgram::Reg &r, std::string_view s) {
+    r.s.data = s.data();
+    r.s.size = s.size();
+}
+}  // namespace
+
+ExprProgram::Error ExprProgram::run(std::span<const Value> cols, Reg *r) const {
+    const Insn *base = code.data();
+    const Insn *end = base + code.size();
+    for (const Insn *pc = base; pc < end; ++pc) {
+        auto &x = r[pc->a];
+        auto &y = r[pc->b];
+        auto &d = r[pc->dst];
+        switch (pc->op) {
+            case Op::ColI: d.i = *cols[pc->imm].as_int(); break;
+            case Op::ColF: d.d = *cols[pc->imm].as_double(); break;
+            case Op::ColS: set_view(d, *cols[pc->imm].as_string()); break;
+            case Op::ConstI: d.i = *consts[pc->imm].as_int(); break;
+            case Op::ConstF: d.d = *consts[pc->imm].as_double(); break;
+            case Op::ConstS: set_view(d, *consts[pc->imm].as_string()); break;
+            case Op::IntToFloat: d.d = double(x.i); break;
+
+            // Wrap around instead of overflowing
+            case Op::AddI: d.i = int64_t(uint64_t(x.i) + uint64_t(y.i)); break;
+            case Op::SubI: d.i = int64_t(uint64_t(x.i) - uint64_t(y.i)); break;
+            case Op::MulI: d.i = int64_t(uint64_t(x.i) * uint64_t(y.i)); break;
+            case Op::DivI:
+                if (y.i == 0) {
+                    return Error::DivisionByZero;
+                }
+                d.i = x.i / y.i;
+                break;
+            case Op::AddF: d.d = x.d + y.d; break;
+            case Op::SubF: d.d = x.d - y.d; break;
+            case Op::MulF: d.d = x.d * y.d; break;
+            case Op::DivF:
+                if (y.d == 0) {
+                    return Error::DivisionByZero;
+                }
+                d.d = x.d / y.d;
+                break;
+            case Op::NegI: d.i = int64_t(0 - uint64_t(x.i)); break;
+            case Op::NegF: d.d = -x.d; break;
+
+            case Op::EqI: d.b = x.i == y.i; break;
+            case Op::NeI: d.b = x.i != y.i; break;
+            case Op::LtI: d.b = x.i < y.i; break;
+            case Op::LeI: d.b = x.i <= y.i; break;
+            case Op::GtI: d.b = x.i > y.i; break;
+            case Op::GeI: d.b = x.i >= y.i; break;
+            case Op::EqF: d.b = std::abs(x.d - y.d) < EPS; break;
+            case Op::NeF: d.b = !(std::abs(x.d - y.d) < EPS); break;
+            case Op::LtF: d.b = x.d < y.d; break;
+            case Op::LeF: d.b = x.d <= y.d; break;
+            case Op::GtF: d.b = x.d > y.d; break;
+            case Op::GeF: d.b = x.d >= y.d; break;
+            case Op::EqS: d.b = view_of(x) == view_of(y); break;
+            case Op::NeS: d.b = view_of(x) != view_of(y); break;
+            case Op::LtS: d.b = view_of(x) < view_of(y); break;
+            case Op::LeS: d.b = view_of(x) <= view_of(y); break;
+            case Op::GtS: d.b = view_of(x) > view_of(y); break;
+            case Op::GeS: d.b = view_of(x) >= view_of(y); break;
+            case Op::Like: d.b = utils::strlike(view_of(x), view_of(y)); break;
+
+            // The loop increment lands on `imm`
+            case Op::JumpIfFalse:
+                if (!x.b) {
+                    pc = base + pc->imm - 1;
+                }
+                break;
+            case Op::JumpIfTrue:
+                if (x.b) {
+                    pc = base + pc->imm - 1;
+                }
+                break;
+        }
+    }
+    return Error::None;
+}
+
+std::expected<Table::Value, ExprProgram::Error>
+    ExprProgram::value(std::span<const Value> cols) const {
+    Reg regs[MAX_REGS];
+    if (auto err = run(cols, regs); err != Error::None) {
+        return std::unexpected(err);
+    }
+    auto &r = regs[result];
+    switch (result_type) {
+        case FieldType::INT: return Value(r.i);
+        case FieldType::FLOAT: return Value(r.d);
+        case FieldType::STRING: return Value(view_of(r));
+    }
+    std::abort();
+}
+
+std::string_view ExprProgram::error_message(Error err) {
+    switch (err) {
+        case Error::None: return "";
+        case Error::DivisionByZero: return "Division by zero";
+    }
+    std::abort();
+}
+
+}  // namespace gpamgr
@@ -1,7 +1,16 @@
 #include "misc.h"
 
+#include <fstream>
+#include <filesystem>
 #include <string_view>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 namespace utils {
 std::string_view ltrim(std::string_view sv, std::string_view chars) noexcept {
     size_t start = sv.find_first_not_of(chars);
@@ -135,4 +144,210 @@ bool strlike(std::string_view s, std::string_view p) {
 
     return p_idx == p.size();
 }
+
+BlockReader::BlockReader(std::istream &is, size_t block_size)
+    : is(is), block_size(block_size), worker([this] { read_loop(); }) {}
+
+BlockReader::~BlockReader() {
+    {
+        std::lock_guard lock(mu);
+        stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+void BlockReader::read_loop() {
+    while (true) {
+        std::string block(block_size, '\0');
+        is.read(block.data(), std::streamsize(block.size()));
+        block.resize(size_t(is.gcount()));
+        bool more = is.good();
+
+        std::unique_lock lock(mu);
+        cv.wait(lock, [&] { return stop || ready.size() < READ_AHEAD; });
+        if (stop) {
+            return;
+        }
+        if (!block.empty()) {
+            ready.push_back(std::move(block));
+        }
+        eof = !more;
+        cv.notify_all();
+        if (eof) {
+            return;
+        }
+    }
+}
+
+bool BlockReader::fill() {
+    std::string block;
+    {
+        std::unique_lock lock(mu);
+        cv.wait(lock, [&] { return !ready.empty() || eof; });
+        if (ready.empty()) {
+            return false;
+        }
+        block = std::move(ready.front());
+        ready.pop_front();
+    }
+    cv.notify_all();
+    if (pos == buf.size()) {
+        buf = std::move(block);
+    } else {
+        buf.erase(0, pos);
+        buf += block;
+    }
+    pos = 0;
+    return true;
+}
+
+BlockWriter::BlockWriter(std::ostream &os, size_t block_size)
+    : os(os), block_size(block_size), worker([this] { write_loop(); }) {
+    buf.reserve(block_size);
+}
+
+BlockWriter::~BlockWriter() {
+    finish();
+}
+
+void BlockWriter::write_loop() {
+    while (true) {
+        std::string block;
+        {
+            std::unique_lock lock(mu);
+            cv.wait(lock, [&] { return done || !pending.empty(); });
+            if (pending.empty()) {
+                return;
+            }
+            block = std::move(pending.front());
+            pending.pop_front();
+        }
+        cv.notify_all();
+        os.write(block.data(), std::streamsize(block.size()));
+    }
+}
+
+void BlockWriter::hand_off() {
+    {
+        std::unique_lock lock(mu);
+        cv.wait(lock, [&] { return pending.size() < WRITE_BEHIND; });
+        pending.push_back(std::move(buf));
+    }
+    cv.notify_all();
+    buf = std::string();
+    buf.reserve(block_size);
+}
+
+bool BlockWriter::finish() {
+    if (worker.joinable()) {
+        if (!buf.empty()) {
+            hand_off();
+        }
+        {
+            std::lock_guard lock(mu);
+            done = true;
+        }
+        cv.notify_all();
+        worker.join();
+        os.flush();
+    }
+    return os.good();
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (base && buffer.empty()) {
+        munmap(const_cast<char *>(base), length);
+    }
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::from_buffer(std::string bytes) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->buffer = std::move(bytes);
+    file->length = file->buffer.size();
+    file->base = file->buffer.empty() ? nullptr : file->buffer.data();
+    return file;
+}
+
+std::expected<std::shared_ptr<const MappedFile>, std::string>
+    MappedFile::open(std::string_view path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#ifndef _WIN32
+    int fd = ::open(std::string(path).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::unexpected(std::format("Cannot open `{}`", path));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return std::unexpected(std::format("Cannot stat `{}`", path));
+    }
+    file->length = st.st_size;
+    if (file->length != 0) {
+        void *p = mmap(nullptr, file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return std::unexpected(std::format("Cannot map `{}`", path));
+        }
+        file->base = static_cast<const char *>(p);
+    }
+    close(fd);
+#else
+    std::ifstream ifs(std::string(path), std::ios::binary);
+    if (!ifs) {
+        return std::unexpected(std::format("Cannot open `{}`", path));
+    }
+    file->buffer.assign(std::istreambuf_iterator<char>(ifs), {});
+    file->base = file->buffer.data();
+    file->length = file->buffer.size();
+#endif
+    return file;
+}
+
+std::expected<void, std::string> replace_file(std::string_view tmp, std::string_view path) {
+#ifndef _WIN32
+    auto sync = [](const std::string &p, int flags) {
+        int fd = ::open(p.c_str(), flags);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    };
+    std::string from(tmp), to(path);
+    if (!sync(from, O_RDONLY)) {
+        return std::unexpected(std::format("Cannot sync `{}`", tmp));
+    }
+    if (::rename(from.c_str(), to.c_str()) != 0) {
+        return std::unexpected(std::format("Cannot rename `{}` to `{}`", tmp, path));
+    }
+    // Persist the directory entry as well
+    auto dir = std::filesystem::path(to).parent_path();
+    sync(dir.empty() ? std::string(".") : dir.string(), O_RDONLY | O_DIRECTORY);
+#else
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        return std::unexpected(std::format("Cannot rename `{}` to `{}`", tmp, path));
+    }
+#endif
+    return {};
+}
+
+std::expected<void, std::string> write_file_durable(std::string_view path,
+                                                   std::function<void(std::ostream &)> fill) {
+    auto tmp = std::string(path) + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        fill(ofs);
+        ofs.flush();
+        if (!ofs.good()) {
+            return std::unexpected(std::format("Cannot write `{}`", tmp));
+        }
+    }
+    return replace_file(tmp, path);
+}
 }  // namespace utils
@@ -0,0 +1,415 @@
+#include "simd.h"
+
+#include <bit>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GPAMGR_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define GPAMGR_X86_SIMD 0
+#endif
+
+namespace gpamgr::simd {
+namespace {
+template <CmpOp op, typename T>
+void compare_scalar(const T *in, size_t n, T c, uint64_t *bits) {
+    for (size_t w = 0; w < bitmap_words(n); ++w) {
+        const size_t m = std::min<size_t>(64, n - w * 64);
+        uint64_t word = 0;
+        for (size_t j = 0; j < m; ++j) {
+            word |= uint64_t(compare_as<op>(in[w * 64 + j], c)) << j;
+        }
+        bits[w] = word;
+    }
+}
+
+// Identity of MIN and MAX for `T`
+template <typename T>
+constexpr T highest() {
+    return std::numeric_limits<T>::max();
+}
+
+template <typename T>
+constexpr T lowest() {
+    return std::numeric_limits<T>::lowest();
+}
+
+// Merge the partial results of one call into `t`, extremes only when a value was seen
+template <typename T>
+void merge(Totals &t, double sum, T mn, T mx, size_t count) {
+    t.sum += sum;
+    if (count > 0) {
+        t.min = std::min(t.min, double(mn));
+        t.max = std::max(t.max, double(mx));
+        t.count += count;
+    }
+}
+
+// Values of word `w` to fold, a partial last word has its missing bits clear
+template <bool MASKED>
+uint64_t fold_word(const uint64_t *bits, size_t w, size_t n) {
+    uint64_t word = MASKED ? bits[w] : ~uint64_t(0);
+    if (n - w * 64 < 64) {
+        word &= (uint64_t(1) << (n - w * 64)) - 1;
+    }
+    return word;
+}
+
+template <bool MASKED, typename T>
+void reduce_scalar(const T *in, size_t n, const uint64_t *bits, Totals &t) {
+    // Four independent chains, so the loop is not bound by the latency of one add. Integer
+    // sums wrap instead of overflowing.
+    using Sum = std::conditional_t<std::is_integral_v<T>, uint64_t, double>;
+    Sum sum[4] = {};
+    auto flush = [&] {
+        if constexpr (std::is_integral_v<T>) {
+            return double(int64_t(sum[0] + sum[1] + sum[2] + sum[3]));
+        } else {
+            return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+        }
+    };
+    T mn[4] = {highest<T>(), highest<T>(), highest<T>(), highest<T>()};
+    T mx[4] = {lowest<T>(), lowest<T>(), lowest<T>(), lowest<T>()};
+    double total = 0;
+    size_t count = 0;
+    for (size_t w = 0; w < bitmap_words(n); ++w) {
+        const uint64_t word = fold_word<MASKED>(bits, w, n);
+        count += std::popcount(word);
+        const size_t m = std::min<size_t>(64, n - w * 64);
+        for (size_t j = 0; word != 0 && j < m; ++j) {
+            const bool on = (word >> j) & 1;
+            const T x = in[w * 64 + j];
+            sum[j % 4] += on ? Sum(x) : Sum(0);
+            mn[j % 4] = std::min(mn[j % 4], on ? x : highest<T>());
+            mx[j % 4] = std::max(mx[j % 4], on ? x : lowest<T>());
+        }
+        if ((w + 1) % (REDUCE_BLOCK / 64) == 0) {
+            total += flush();
+            std::ranges::fill(sum, Sum(0));
+        }
+    }
+    total += flush();
+    merge(t,
+          total,
+          std::min(std::min(mn[0], mn[1]), std::min(mn[2], mn[3])),
+          std::max(std::max(mx[0], mx[1]), std::max(mx[2], mx[3])),
+          count);
+}
+
+#if GPAMGR_X86_SIMD
+// The vector loops fill whole words, the scalar loop finishes the last partial one
+
+template <CmpOp op>
+__attribute__((target("avx2"))) void
+    compare_avx2(const double *in, size_t n, double c, uint64_t *bits) {
+    const __m256d vc = _mm256_set1_pd(c);
+    const __m256d eps = _mm256_set1_pd(ExprProgram::EPS);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 4) {
+            __m256d x = _mm256_loadu_pd(in + w * 64 + j);
+            __m256d m;
+            if constexpr (op == CmpOp::Eq || op == CmpOp::Ne) {
+                __m256d diff = _mm256_andnot_pd(sign, _mm256_sub_pd(x, vc));
+                m = op == CmpOp::Eq ? _mm256_cmp_pd(diff, eps, _CMP_LT_OQ)
+                                    : _mm256_cmp_pd(diff, eps, _CMP_NLT_UQ);
+            } else if constexpr (op == CmpOp::Lt) {
+                m = _mm256_cmp_pd(x, vc, _CMP_LT_OQ);
+            } else if constexpr (op == CmpOp::Le) {
+                m = _mm256_cmp_pd(x, vc, _CMP_LE_OQ);
+            } else if constexpr (op == CmpOp::Gt) {
+                m = _mm256_cmp_pd(x, vc, _CMP_GT_OQ);
+            } else {
+                m = _mm256_cmp_pd(x, vc, _CMP_GE_OQ);
+            }
+            word |= uint64_t(_mm256_movemask_pd(m)) << j;
+        }
+        bits[w] = word;
+    }
+    compare_scalar<op>(in + full * 64, n - full * 64, c, bits + full);
+}
+
+template <CmpOp op>
+__attribute__((target("avx2"))) void
+    compare_avx2(const int64_t *in, size_t n, int64_t c, uint64_t *bits) {
+    // Only `==` and `>` exist, the other operators swap or negate them
+    constexpr bool negate = op == CmpOp::Ne || op == CmpOp::Le || op == CmpOp::Ge;
+    const __m256i vc = _mm256_set1_epi64x(c);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + w * 64 + j));
+            __m256i m;
+            if constexpr (op == CmpOp::Eq || op == CmpOp::Ne) {
+                m = _mm256_cmpeq_epi64(x, vc);
+            } else if constexpr (op == CmpOp::Gt || op == CmpOp::Le) {
+                m = _mm256_cmpgt_epi64(x, vc);
+            } else {
+                m = _mm256_cmpgt_epi64(vc, x);
+            }
+            unsigned bits4 = _mm256_movemask_pd(_mm256_castsi256_pd(m));
+            word |= uint64_t(negate ? bits4 ^ 0xf : bits4) << j;
+        }
+        bits[w] = word;
+    }
+    compare_scalar<op>(in + full * 64, n - full * 64, c, bits + full);
+}
+
+template <CmpOp op>
+__attribute__((target("sse4.2"))) void
+    compare_sse42(const double *in, size_t n, double c, uint64_t *bits) {
+    const __m128d vc = _mm_set1_pd(c);
+    const __m128d eps = _mm_set1_pd(ExprProgram::EPS);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 2) {
+            __m128d x = _mm_loadu_pd(in + w * 64 + j);
+            __m128d m;
+            if constexpr (op == CmpOp::Eq || op == CmpOp::Ne) {
+                __m128d diff = _mm_andnot_pd(sign, _mm_sub_pd(x, vc));
+                m = op == CmpOp::Eq ? _mm_cmplt_pd(diff, eps) : _mm_cmpnlt_pd(diff, eps);
+            } else if constexpr (op == CmpOp::Lt) {
+                m = _mm_cmplt_pd(x, vc);
+            } else if constexpr (op == CmpOp::Le) {
+                m = _mm_cmple_pd(x, vc);
+            } else if constexpr (op == CmpOp::Gt) {
+                m = _mm_cmpgt_pd(x, vc);
+            } else {
+                m = _mm_cmpge_pd(x, vc);
+            }
+            word |= uint64_t(_mm_movemask_pd(m)) << j;
+        }
+        bits[w] = word;
+    }
+    compare_scalar<op>(in + full * 64, n - full * 64, c, bits + full);
+}
+
+template <CmpOp op>
+__attribute__((target("sse4.2"))) void
+    compare_sse42(const int64_t *in, size_t n, int64_t c, uint64_t *bits) {
+    constexpr bool negate = op == CmpOp::Ne || op == CmpOp::Le || op == CmpOp::Ge;
+    const __m128i vc = _mm_set1_epi64x(c);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 2) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + w * 64 + j));
+            __m128i m;
+            if constexpr (op == CmpOp::Eq || op == CmpOp::Ne) {
+                m = _mm_cmpeq_epi64(x, vc);
+            } else if constexpr (op == CmpOp::Gt || op == CmpOp::Le) {
+                m = _mm_cmpgt_epi64(x, vc);
+            } else {
+                m = _mm_cmpgt_epi64(vc, x);
+            }
+            unsigned bits2 = _mm_movemask_pd(_mm_castsi128_pd(m));
+            word |= uint64_t(negate ? bits2 ^ 0x3 : bits2) << j;
+        }
+        bits[w] = word;
+    }
+    compare_scalar<op>(in + full * 64, n - full * 64, c, bits + full);
+}
+
+// All ones in the lanes whose bit is set in the low 4 bits of `b`
+__attribute__((target("avx2"))) inline __m256i lane_mask(uint64_t b) {
+    const __m256i lane = _mm256_set_epi64x(8, 4, 2, 1);
+    return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(int64_t(b & 0xf)), lane), lane);
+}
+
+__attribute__((target("avx2"))) inline double sum_lanes(__m256i v) {
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), v);
+    return double(int64_t(uint64_t(lanes[0]) + uint64_t(lanes[1]) + uint64_t(lanes[2]) +
+                          uint64_t(lanes[3])));
+}
+
+// Two sums, minimums and maximums of 4 lanes each
+template <bool MASKED>
+__attribute__((target("avx2"))) void
+    reduce_avx2(const double *in, size_t n, const uint64_t *bits, Totals &t) {
+    const __m256d hi = _mm256_set1_pd(highest<double>());
+    const __m256d lo = _mm256_set1_pd(lowest<double>());
+    __m256d sum[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+    __m256d mn[2] = {hi, hi};
+    __m256d mx[2] = {lo, lo};
+    size_t count = 0;
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        const uint64_t word = MASKED ? bits[w] : ~uint64_t(0);
+        if (word == 0) {
+            continue;
+        }
+        count += std::popcount(word);
+        const double *p = in + w * 64;
+        for (size_t j = 0; j < 64; j += 4) {
+            const size_t k = (j / 4) % 2;
+            __m256d x = _mm256_loadu_pd(p + j);
+            if (MASKED && word != ~uint64_t(0)) {
+                __m256d m = _mm256_castsi256_pd(lane_mask(word >> j));
+                sum[k] = _mm256_add_pd(sum[k], _mm256_and_pd(m, x));
+                mn[k] = _mm256_min_pd(mn[k], _mm256_blendv_pd(hi, x, m));
+                mx[k] = _mm256_max_pd(mx[k], _mm256_blendv_pd(lo, x, m));
+            } else {
+                sum[k] = _mm256_add_pd(sum[k], x);
+                mn[k] = _mm256_min_pd(mn[k], x);
+                mx[k] = _mm256_max_pd(mx[k], x);
+            }
+        }
+    }
+    alignas(32) double s[4], a[4], b[4];
+    _mm256_store_pd(s, _mm256_add_pd(sum[0], sum[1]));
+    _mm256_store_pd(a, _mm256_min_pd(mn[0], mn[1]));
+    _mm256_store_pd(b, _mm256_max_pd(mx[0], mx[1]));
+    merge(t,
+          (s[0] + s[1]) + (s[2] + s[3]),
+          std::min(std::min(a[0], a[1]), std::min(a[2], a[3])),
+          std::max(std::max(b[0], b[1]), std::max(b[2], b[3])),
+          count);
+    reduce_scalar<MASKED>(in + full * 64, n - full * 64, MASKED ? bits + full : bits, t);
+}
+
+template <bool MASKED>
+__attribute__((target("avx2"))) void
+    reduce_avx2(const int64_t *in, size_t n, const uint64_t *bits, Totals &t) {
+    const __m256i hi = _mm256_set1_epi64x(highest<int64_t>());
+    const __m256i lo = _mm256_set1_epi64x(lowest<int64_t>());
+    __m256i sum[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    __m256i mn[2] = {hi, hi};
+    __m256i mx[2] = {lo, lo};
+    double total = 0;
+    size_t count = 0;
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        const uint64_t word = MASKED ? bits[w] : ~uint64_t(0);
+        if (word != 0) {
+            count += std::popcount(word);
+            const int64_t *p = in + w * 64;
+            for (size_t j = 0; j < 64; j += 4) {
+                const size_t k = (j / 4) % 2;
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + j));
+                __m256i x_mn = x, x_mx = x;
+                if (MASKED && word != ~uint64_t(0)) {
+                    __m256i m = lane_mask(word >> j);
+                    x = _mm256_and_si256(m, x);
+                    x_mn = _mm256_blendv_epi8(hi, x_mn, m);
+                    x_mx = _mm256_blendv_epi8(lo, x_mx, m);
+                }
+                // No 64-bit min / max before AVX-512, pick with a compare
+                sum[k] = _mm256_add_epi64(sum[k], x);
+                mn[k] = _mm256_blendv_epi8(mn[k], x_mn, _mm256_cmpgt_epi64(mn[k], x_mn));
+                mx[k] = _mm256_blendv_epi8(mx[k], x_mx, _mm256_cmpgt_epi64(x_mx, mx[k]));
+            }
+        }
+        if ((w + 1) % (REDUCE_BLOCK / 64) == 0) {
+            total += sum_lanes(_mm256_add_epi64(sum[0], sum[1]));
+            sum[0] = sum[1] = _mm256_setzero_si256();
+        }
+    }
+    total += sum_lanes(_mm256_add_epi64(sum[0], sum[1]));
+    alignas(32) int64_t lanes[4];
+    int64_t a = highest<int64_t>(), b = lowest<int64_t>();
+    for (size_t k = 0; k < 2; ++k) {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), mn[k]);
+        a = std::min({a, lanes[0], lanes[1], lanes[2], lanes[3]});
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), mx[k]);
+        b = std::max({b, lanes[0], lanes[1], lanes[2], lanes[3]});
+    }
+    merge(t, total, a, b, count);
+    reduce_scalar<MASKED>(in + full * 64, n - full * 64, MASKED ? bits + full : bits, t);
+}
+#endif
+
+// Only an AVX2 version, SSE4.2 machines take the scalar loop
+template <bool MASKED, typename T>
+void reduce_on(Isa isa, std::span<const T> in, const uint64_t *bits, Totals &t) {
+#if GPAMGR_X86_SIMD
+    if (isa == Isa::AVX2) {
+        return reduce_avx2<MASKED>(in.data(), in.size(), bits, t);
+    }
+#endif
+    reduce_scalar<MASKED>(in.data(), in.size(), bits, t);
+}
+
+template <CmpOp op, typename T>
+void compare_on(Isa isa, const T *in, size_t n, T c, uint64_t *bits) {
+#if GPAMGR_X86_SIMD
+    switch (isa) {
+        case Isa::AVX2: return compare_avx2<op>(in, n, c, bits);
+        case Isa::SSE42: return compare_sse42<op>(in, n, c, bits);
+        case Isa::Scalar: break;
+    }
+#endif
+    compare_scalar<op>(in, n, c, bits);
+}
+
+template <typename T>
+void compare_any(Isa isa, std::span<const T> in, CmpOp op, T c, uint64_t *bits) {
+    switch (op) {
+        case CmpOp::Eq: return compare_on<CmpOp::Eq>(isa, in.data(), in.size(), c, bits);
+        case CmpOp::Ne: return compare_on<CmpOp::Ne>(isa, in.data(), in.size(), c, bits);
+        case CmpOp::Lt: return compare_on<CmpOp::Lt>(isa, in.data(), in.size(), c, bits);
+        case CmpOp::Le: return compare_on<CmpOp::Le>(isa, in.data(), in.size(), c, bits);
+        case CmpOp::Gt: return compare_on<CmpOp::Gt>(isa, in.data(), in.size(), c, bits);
+        case CmpOp::Ge: return compare_on<CmpOp::Ge>(isa, in.data(), in.size(), c, bits);
+    }
+}
+
+Isa detect_isa() {
+#if GPAMGR_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Isa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return Isa::SSE42;
+    }
+#endif
+    return Isa::Scalar;
+}
+}  // namespace
+
+Isa best_isa() {
+    static const Isa isa = detect_isa();
+    return isa;
+}
+
+std::string_view isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return "scalar";
+        case Isa::SSE42: return "sse4.2";
+        case Isa::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+void compare(std::span<const double> in, CmpOp op, double c, uint64_t *bits, Isa isa) {
+    compare_any(std::min(isa, best_isa()), in, op, c, bits);
+}
+
+void compare(std::span<const int64_t> in, CmpOp op, int64_t c, uint64_t *bits, Isa isa) {
+    compare_any(std::min(isa, best_isa()), in, op, c, bits);
+}
+
+void reduce(std::span<const double> in, Totals &t, Isa isa) {
+    reduce_on<false>(std::min(isa, best_isa()), in, nullptr, t);
+}
+
+void reduce(std::span<const double> in, const uint64_t *bits, Totals &t, Isa isa) {
+    reduce_on<true>(std::min(isa, best_isa()), in, bits, t);
+}
+
+void reduce(std::span<const int64_t> in, Totals &t, Isa isa) {
+    reduce_on<false>(std::min(isa, best_isa()), in, nullptr, t);
+}
+
+void reduce(std::span<const int64_t> in, const uint64_t *bits, Totals &t, Isa isa) {
+    reduce_on<true>(std::min(isa, best_isa()), in, bits, t);
+}
+
+}  // namespace gpamgr::simd
@@ -49,6 +49,14 @@ TokenType keyword(std::string_view s) {
         return tk_asc;
     } else if (s == "desc") {
         return tk_desc;
+    } else if (s == "create") {
+        return tk_create;
+    } else if (s == "index") {
+        return tk_index;
+    } else if (s == "on") {
+        return tk_on;
+    } else if (s == "using") {
+        return tk_using;
     }
     return tk_identifier;
 }
@@ -329,11 +337,12 @@ public:
             case TokenType::tk_insert: return parse_insert_stmt();
             case TokenType::tk_update: return parse_update_stmt();
             case TokenType::tk_delete: return parse_delete_stmt();
+            case TokenType::tk_create: return parse_create_index_stmt();
             default:
-                return std::unexpected(
-                    raise_error("Expected a keyword among `SELECT`, `INSERT`, `UPDATE`, `DELETE`",
-                                current_tk->B,
-                                current_tk->E));
+                return std::unexpected(raise_error(
+                    "Expected a keyword among `SELECT`, `INSERT`, `UPDATE`, `DELETE`, `CREATE`",
+                    current_tk->B,
+                    current_tk->E));
         }
     }
 
@@ -665,6 +674,79 @@ private:
         return ctx.make_stmt<DeleteStmt>(table, cond, B, E);
     }
 
+    /// create_index_stmt
+    ///     ::= CREATE INDEX ON identifier "(" identifier ")"
+    ///         [ USING identifier ]
+    ///         ;
+    std::expected<Stmt *, utils::Diagnostic> parse_create_index_stmt() {
+        auto create_kw = current_tk;
+        size_t B = create_kw->B;
+        consume();  // consume CREATE
+
+        if (!consume_if(TokenType::tk_index)) {
+            return std::unexpected(
+                raise_error("Expect keyword `index` after `create`", create_kw->E, create_kw->E));
+        }
+        if (!consume_if(TokenType::tk_on)) {
+            return std::unexpected(
+                raise_error("Expect keyword `on` after `index`", current_tk->B, current_tk->E));
+        }
+
+        // table name
+        if (current_tk->ty != TokenType::tk_identifier) {
+            return std::unexpected(
+                raise_error("Expect table name after `on`", current_tk->B, current_tk->E));
+        }
+        auto *table =
+            ctx.make_expr<IdentifierExpr>(utils::slice(source, current_tk->B, current_tk->E),
+                                          current_tk->B,
+                                          current_tk->E);
+        consume();
+
+        // "(" column ")"
+        if (!consume_if(TokenType::tk_lparen)) {
+            return std::unexpected(
+                raise_error("Expect '(' after table name", current_tk->B, current_tk->E));
+        }
+        if (current_tk->ty != TokenType::tk_identifier) {
+            return std::unexpected(
+                raise_error("Expect column name in index", current_tk->B, current_tk->E));
+        }
+        auto *column =
+            ctx.make_expr<IdentifierExpr>(utils::slice(source, current_tk->B, current_tk->E),
+                                          current_tk->B,
+                                          current_tk->E);
+        consume();
+        if (!consume_if(TokenType::tk_rparen)) {
+            return std::unexpected(
+                raise_error("Expect ')' after column name", current_tk->B, current_tk->E));
+        }
+
+        // optional "using" method
+        const IdentifierExpr *method = nullptr;
+        if (consume_if(TokenType::tk_using)) {
+            if (current_tk->ty != TokenType::tk_identifier) {
+                return std::unexpected(
+                    raise_error("Expect index method after `using`", current_tk->B, current_tk->E));
+            }
+            method =
+                ctx.make_expr<IdentifierExpr>(utils::slice(source, current_tk->B, current_tk->E),
+                                              current_tk->B,
+                                              current_tk->E);
+            consume();
+        }
+
+        // ending semicolon
+        if (!consume_if(TokenType::tk_semi)) {
+            auto last_tk = current_tk - 1;
+            return std::unexpected(
+                raise_warn("Expect `;` at end of CREATE INDEX statement", last_tk->E, last_tk->E));
+        }
+        size_t E = (current_tk - 1)->E;
+
+        return ctx.make_stmt<CreateIndexStmt>(table, column, method, B, E);
+    }
+
     std::expected<Expr *, utils::Diagnostic> parse_primary() {
         switch (current_tk->ty) {
             case TokenType::tk_identifier: {
@@ -1,32 +1,92 @@
 #include "table.h"
 
+#include "args.h"
 #include "log.h"
 #include "misc.h"
+#include "codec.h"
 
 #include <fstream>
+#include <sstream>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <filesystem>
 #include <vector>
+#include <algorithm>
+#include <unordered_set>
 
 namespace gpamgr {
+utils::opt<int> wal_checkpoint_kb("wal-checkpoint-kb",
+                                  "Rewrite a table file once its write-ahead log exceeds this size",
+                                  16384);
+
+utils::opt<int> vacuum_dead_percent("vacuum-dead-percent",
+                                    "Compact a table once this share of its slots is dead, 0 to disable",
+                                    50);
+
+utils::opt<bool> compress_tables("compress-tables",
+                                 "Write every table file packed, see `Table::is_packed`",
+                                 false);
+
 namespace {
 constexpr const char MAGIC_BYTES[] = "GPATBL\0";
 constexpr auto MAGIC_SIZE = sizeof(MAGIC_BYTES);
-constexpr uint32_t VERSION = 1;
+// v1 is only read, tables are always written as v2
+constexpr uint32_t VERSION_V1 = 1;
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t VERSION_PACKED = 3;
+constexpr const char FOOTER_MAGIC[] = "GPAEND\0";
+constexpr const char WAL_MAGIC[] = "GPAWAL\0";
+// WAL_MAGIC, then the checkpoint generation of the table file the log applies to
+constexpr size_t WAL_HEADER = sizeof(WAL_MAGIC) + sizeof(uint64_t);
+constexpr size_t ALIGN = 8;
+
+// Per-field flag byte, files written before COLUMN mode only ever stored 0/1
+constexpr uint8_t FIELD_PRIMARY = 1 << 0;
+constexpr uint8_t FIELD_COLUMNAR = 1 << 1;
+constexpr uint8_t FIELD_INDEXED = 1 << 2;
+constexpr uint8_t FIELD_HASHED = 1 << 3;
+constexpr uint8_t FIELD_TRIGRAM = 1 << 4;
+constexpr uint8_t FIELD_DICT = 1 << 5;
 
 namespace fs = std::filesystem;
 
-// Binary format:
+// Binary format v1 (read only, also used for the header of an empty table):
 // MAGIC_BYTES
 // VERSION
 // Metadata:
 //   - field_count
 //   - alive_count
 //   - next_rowid
-void write_empty_header(std::ofstream &ofs) {
+// Schema: name_len, name, type, flags (FIELD_PRIMARY | FIELD_COLUMNAR | FIELD_INDEXED |
+//                                      FIELD_HASHED | FIELD_TRIGRAM | FIELD_DICT)
+// Rows: id, cells
+//
+// Binary format v2, laid out to be mapped and queried in place. Every section starts
+// on an `ALIGN` boundary:
+// MAGIC_BYTES, VERSION, padding
+// Sections: rowids (u64[n], ascending), then per field either i64[n] / f64[n], or for
+//           STRING offsets (u64[n]), lengths (u32[n]) and the string heap, or for
+//           dictionary STRING codes (u32[n]), entry offsets (u64[d + 1]) and the entry heap,
+//           numeric fields follow with their zone map ((min, max)[ceil(n / ZONE_ROWS)]).
+//           Last the statistics: per field rows (u64), distinct (u64), bucket count (u32),
+//           then unless rows is 0 min, max and the bucket bounds as write-ahead log cells
+// Footer:   field_count, row_count, next_rowid, rowid section offset
+//           per field: name_len, name, type, flags, then 4 section words
+//           (INT/FLOAT: data, zone map, zone count, 0; STRING: offsets, lengths, heap,
+//            heap_size; dictionary STRING: codes, entry offsets, heap, d)
+//           statistics offset, 0 when the table was never analyzed (missing in older files)
+//           checkpoint generation, bumped by every rewrite (missing in older files, read as 0)
+// Trailer:  footer offset (u64), FOOTER_MAGIC
+//
+// Packed files (VERSION_PACKED) share the v2 layout, only the data sections differ and are
+// encoded through `codec`: rowids, INT fields and dictionary codes by `put_ints`, FLOAT
+// fields by `put_doubles`, and STRING fields by `put_strings` in one section (section
+// words: strings, 0, 0, heap_size). Zone maps, dictionary entries and statistics are stored
+// as in v2. Loading decodes them into the image of a v2 file.
+void write_empty_header(std::ostream &ofs) {
     ofs.write(MAGIC_BYTES, MAGIC_SIZE);
-    uint32_t version = VERSION;
+    uint32_t version = VERSION_V1;
     ofs.write(reinterpret_cast<char *>(&version), sizeof(version));
     uint64_t field_count = 0;
     ofs.write(reinterpret_cast<char *>(&field_count), sizeof(field_count));
@@ -47,6 +107,288 @@ void touch_file(fs::path file_path) {
         write_empty_header(ofs);
     }
 }
+
+// Appends to `ofs` while tracking the offset, sections are padded to `ALIGN`
+struct SectionWriter {
+    std::ostream &ofs;
+    uint64_t pos = 0;
+
+    void put(const void *p, size_t n) {
+        ofs.write(static_cast<const char *>(p), n);
+        pos += n;
+    }
+
+    template <typename T>
+    void put(const T &v) {
+        put(&v, sizeof(T));
+    }
+
+    uint64_t align() {
+        constexpr char zeros[ALIGN] = {};
+        if (auto rem = pos % ALIGN) {
+            put(zeros, ALIGN - rem);
+        }
+        return pos;
+    }
+};
+
+// Bounds checked reads from a mapped file
+struct SectionReader {
+    const char *base;
+    size_t size;
+    uint64_t pos = 0;
+    bool ok = true;
+
+    template <typename T>
+    T get() {
+        T v{};
+        if (pos + sizeof(T) > size) {
+            ok = false;
+            return v;
+        }
+        std::memcpy(&v, base + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    std::string_view bytes(uint64_t off, uint64_t n) {
+        if (off > size || n > size - off) {
+            ok = false;
+            return {};
+        }
+        return std::string_view(base + off, n);
+    }
+
+    template <typename T>
+    std::span<const T> array(uint64_t off, uint64_t n) {
+        if (off % alignof(T) != 0 || n > size / sizeof(T)) {
+            ok = false;
+            return {};
+        }
+        auto raw = bytes(off, n * sizeof(T));
+        return {reinterpret_cast<const T *>(raw.data()), ok ? n : 0};
+    }
+};
+
+template <typename T>
+void wal_put(std::string &buf, const T &v) {
+    buf.append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+void wal_put_value(std::string &buf, const Table::Value &v) {
+    switch (v.type) {
+        case Table::FieldType::INT: wal_put(buf, *v.as_int()); break;
+        case Table::FieldType::FLOAT: wal_put(buf, *v.as_double()); break;
+        case Table::FieldType::STRING: {
+            auto s = *v.as_string();
+            wal_put(buf, static_cast<uint32_t>(s.size()));
+            buf.append(s);
+            break;
+        }
+    }
+}
+
+std::optional<Table::Value> wal_get_value(SectionReader &rd, Table::FieldType type) {
+    switch (type) {
+        case Table::FieldType::INT: {
+            auto x = rd.get<int64_t>();
+            return rd.ok ? std::optional(Table::Value(x)) : std::nullopt;
+        }
+        case Table::FieldType::FLOAT: {
+            auto d = rd.get<double>();
+            return rd.ok ? std::optional(Table::Value(d)) : std::nullopt;
+        }
+        case Table::FieldType::STRING: {
+            auto len = rd.get<uint32_t>();
+            auto s = rd.bytes(rd.pos, len);
+            rd.pos += len;
+            return rd.ok ? std::optional(Table::Value(s)) : std::nullopt;
+        }
+    }
+    return std::nullopt;
+}
+
+// Footer entry of one field, `name` points into the file or the schema it was written from
+struct FooterField {
+    std::string_view name;
+    int32_t type = 0;
+    uint8_t flags = 0;
+    uint64_t sec[4] = {};
+};
+
+struct Footer {
+    uint64_t row_count = 0;
+    uint64_t next_rowid = 0;
+    uint64_t rowids = 0;
+    uint64_t stats = 0;
+    uint64_t generation = 0;
+    // Where the footer itself starts, filled in by `get_footer`
+    uint64_t offset = 0;
+    std::vector<FooterField> fields;
+};
+
+void put_footer(SectionWriter &w, const Footer &f) {
+    const uint64_t footer_off = w.align();
+    w.put(uint64_t(f.fields.size()));
+    w.put(f.row_count);
+    w.put(f.next_rowid);
+    w.put(f.rowids);
+    for (auto &field: f.fields) {
+        w.put(uint32_t(field.name.size()));
+        w.put(field.name.data(), field.name.size());
+        w.put(field.type);
+        w.put(field.flags);
+        w.put(field.sec, sizeof(field.sec));
+    }
+    w.put(f.stats);
+    w.put(f.generation);
+    w.put(footer_off);
+    w.put(FOOTER_MAGIC, sizeof(FOOTER_MAGIC));
+}
+
+std::expected<Footer, std::string> get_footer(SectionReader &rd) {
+    const auto trailer = sizeof(uint64_t) + sizeof(FOOTER_MAGIC);
+    if (rd.size < MAGIC_SIZE + sizeof(uint32_t) + trailer) {
+        return std::unexpected("Truncated table file");
+    }
+    rd.pos = rd.size - trailer;
+    Footer f;
+    f.offset = rd.get<uint64_t>();
+    if (rd.bytes(rd.pos, sizeof(FOOTER_MAGIC)) !=
+        std::string_view(FOOTER_MAGIC, sizeof(FOOTER_MAGIC))) {
+        return std::unexpected("Invalid table footer");
+    }
+
+    rd.pos = f.offset;
+    auto field_count = rd.get<uint64_t>();
+    f.row_count = rd.get<uint64_t>();
+    f.next_rowid = rd.get<uint64_t>();
+    f.rowids = rd.get<uint64_t>();
+    logging::trace("Mapped `{}` fields and `{}` rows", field_count, f.row_count);
+    if (!rd.ok || field_count == 0 || field_count > rd.size) {
+        return std::unexpected("Invalid table footer");
+    }
+    f.fields.resize(field_count);
+    for (auto &field: f.fields) {
+        auto name_len = rd.get<uint32_t>();
+        field.name = rd.bytes(rd.pos, name_len);
+        rd.pos += name_len;
+        field.type = rd.get<int32_t>();
+        field.flags = rd.get<uint8_t>();
+        for (auto &word: field.sec) {
+            word = rd.get<uint64_t>();
+        }
+    }
+    // Files written before statistics were kept end the footer here
+    if (rd.pos + sizeof(uint64_t) <= rd.size - trailer) {
+        f.stats = rd.get<uint64_t>();
+    }
+    if (rd.pos + sizeof(uint64_t) <= rd.size - trailer) {
+        f.generation = rd.get<uint64_t>();
+    }
+    if (!rd.ok) {
+        return std::unexpected("Invalid table footer");
+    }
+    return f;
+}
+
+// Decode a packed file into the image of a v2 file
+std::expected<std::string, std::string> unpack_file(const utils::MappedFile &file) {
+    SectionReader rd{file.data(), file.size()};
+    auto footer = get_footer(rd);
+    if (!footer) {
+        return std::unexpected(footer.error());
+    }
+    const uint64_t n = footer->row_count;
+    // Every block of a packed section takes a header of a few words
+    if (n / codec::BLOCK > file.size() / 16) {
+        return std::unexpected("Invalid table footer");
+    }
+
+    std::ostringstream os;
+    SectionWriter w{os};
+    w.put(MAGIC_BYTES, MAGIC_SIZE);
+    w.put(VERSION);
+
+    auto packed = [&](uint64_t off) {
+        return off <= file.size() ? std::string_view(file.data() + off, file.size() - off)
+                                  : std::string_view{};
+    };
+    // Sections stored as they are, returns the new offset
+    auto copy = [&](uint64_t off, uint64_t len) {
+        auto bytes = rd.bytes(off, len);
+        auto at = w.align();
+        w.put(bytes.data(), bytes.size());
+        return at;
+    };
+
+    std::vector<int64_t> ints(n);
+    if (!codec::get_ints(packed(footer->rowids), ints)) {
+        return std::unexpected("Corrupted rowids");
+    }
+    footer->rowids = w.align();
+    w.put(ints.data(), n * sizeof(int64_t));
+
+    for (auto &field: footer->fields) {
+        auto &sec = field.sec;
+        bool ok = true;
+        switch (static_cast<Table::FieldType>(field.type)) {
+            case Table::FieldType::INT:
+                ok = codec::get_ints(packed(sec[0]), ints).has_value();
+                sec[0] = w.align();
+                w.put(ints.data(), n * sizeof(int64_t));
+                sec[1] = copy(sec[1], sec[2] * 2 * sizeof(int64_t));
+                break;
+            case Table::FieldType::FLOAT: {
+                std::vector<double> floats(n);
+                ok = codec::get_doubles(packed(sec[0]), floats).has_value();
+                sec[0] = w.align();
+                w.put(floats.data(), n * sizeof(double));
+                sec[1] = copy(sec[1], sec[2] * 2 * sizeof(double));
+                break;
+            }
+            case Table::FieldType::STRING: {
+                if (field.flags & FIELD_DICT) {
+                    ok = codec::get_ints(packed(sec[0]), ints).has_value();
+                    std::vector<uint32_t> codes(ints.begin(), ints.end());
+                    sec[0] = w.align();
+                    w.put(codes.data(), n * sizeof(uint32_t));
+                    auto entries = rd.array<uint64_t>(sec[1], sec[3] + 1);
+                    if (!rd.ok || entries.empty()) {
+                        return std::unexpected("Corrupted dictionary");
+                    }
+                    sec[1] = copy(sec[1], entries.size_bytes());
+                    sec[2] = copy(sec[2], entries.back());
+                    break;
+                }
+                std::vector<uint64_t> offsets;
+                std::vector<uint32_t> lengths;
+                std::string heap;
+                ok = codec::get_strings(packed(sec[0]), n, offsets, lengths, heap).has_value();
+                sec[0] = w.align();
+                w.put(offsets.data(), offsets.size() * sizeof(uint64_t));
+                sec[1] = w.align();
+                w.put(lengths.data(), lengths.size() * sizeof(uint32_t));
+                sec[2] = w.align();
+                w.put(heap.data(), heap.size());
+                sec[3] = heap.size();
+                break;
+            }
+            default: return std::unexpected("Unknown field type");
+        }
+        if (!ok || !rd.ok) {
+            return std::unexpected(std::format("Corrupted column `{}`", field.name));
+        }
+    }
+    if (footer->stats != 0) {
+        if (footer->stats > footer->offset) {
+            return std::unexpected("Corrupted column statistics");
+        }
+        footer->stats = copy(footer->stats, footer->offset - footer->stats);
+    }
+    put_footer(w, *footer);
+    return std::move(os).str();
+}
 }  // namespace
 
 std::expected<Table, std::string> Table::create(std::string_view tb_name, std::ifstream &ifs) {
@@ -69,10 +411,773 @@ std::expected<Table, std::string> Table::create(std::string_view tb_name,
     if (auto res = tb.parse_from_file(); !res.has_value()) {
         return std::unexpected(res.error());
     }
+    tb.wal_base_valid = true;
+    if (auto res = tb.replay_wal(); !res.has_value()) {
+        return std::unexpected(res.error());
+    }
     return tb;
 }
 
+size_t Table::Column::size() const {
+    if (mapped) {
+        switch (type) {
+            case FieldType::INT: return mapped->ints.size();
+            case FieldType::FLOAT: return mapped->floats.size();
+            case FieldType::STRING: return dict ? mapped->codes.size() : mapped->offsets.size();
+        }
+    }
+    switch (type) {
+        case FieldType::INT: return ints.size();
+        case FieldType::FLOAT: return floats.size();
+        case FieldType::STRING: return dict ? codes.size() : offsets.size();
+    }
+    std::abort();
+}
+
+void Table::Column::reserve(size_t n) {
+    switch (type) {
+        case FieldType::INT: ints.reserve(n); break;
+        case FieldType::FLOAT: floats.reserve(n); break;
+        case FieldType::STRING:
+            if (dict) {
+                codes.reserve(n);
+            } else {
+                offsets.reserve(n);
+                lengths.reserve(n);
+            }
+            break;
+    }
+}
+
+uint32_t Table::Column::encode(std::string_view s) {
+    auto [it, fresh] = dict_codes.try_emplace(std::string(s), uint32_t(offsets.size() - 1));
+    if (fresh) {
+        heap.append(s);
+        offsets.push_back(heap.size());
+    }
+    return it->second;
+}
+
+void Table::Column::push_back(const Value &v) {
+    switch (type) {
+        case FieldType::INT: ints.push_back(0); break;
+        case FieldType::FLOAT: floats.push_back(0); break;
+        case FieldType::STRING:
+            if (dict) {
+                codes.push_back(encode(*v.as_string()));
+                return;
+            }
+            offsets.push_back(heap.size());
+            lengths.push_back(0);
+            break;
+    }
+    set(size() - 1, v);
+}
+
+void Table::Column::set(size_t slot, const Value &v) {
+    switch (type) {
+        case FieldType::INT: ints[slot] = *v.as_int(); break;
+        case FieldType::FLOAT: floats[slot] = *v.as_double(); break;
+        case FieldType::STRING: {
+            auto s = *v.as_string();
+            if (dict) {
+                codes[slot] = encode(s);
+                break;
+            }
+            // Overwrite in place when it fits, otherwise append to the heap
+            if (s.size() > lengths[slot]) {
+                offsets[slot] = heap.size();
+                heap.append(s);
+            } else {
+                std::memcpy(heap.data() + offsets[slot], s.data(), s.size());
+            }
+            lengths[slot] = s.size();
+            break;
+        }
+    }
+}
+
+Table::Value Table::Column::get(size_t slot) const {
+    switch (type) {
+        case FieldType::INT: return Value(int_data()[slot]);
+        case FieldType::FLOAT: return Value(float_data()[slot]);
+        case FieldType::STRING: return Value(str(slot));
+    }
+    std::abort();
+}
+
+void Table::Column::materialize() {
+    if (!mapped) {
+        return;
+    }
+    ints.assign(mapped->ints.begin(), mapped->ints.end());
+    floats.assign(mapped->floats.begin(), mapped->floats.end());
+    offsets.assign(mapped->offsets.begin(), mapped->offsets.end());
+    lengths.assign(mapped->lengths.begin(), mapped->lengths.end());
+    heap.assign(mapped->heap);
+    codes.assign(mapped->codes.begin(), mapped->codes.end());
+    mapped.reset();
+    if (dict) {
+        dict_codes.clear();
+        for (uint32_t c = 0; c < dict_size(); ++c) {
+            dict_codes.emplace(std::string(dict_entry(c)), c);
+        }
+    }
+}
+
+void Table::RowDirectory::set(RowId id, size_t slot) {
+    auto p = id >> PAGE_BITS;
+    if (p >= pages.size()) {
+        pages.resize(p + 1);
+    }
+    auto &page = pages[p];
+    if (page.slots.empty()) {
+        page.slots.assign(PAGE_SIZE, npos);
+    }
+    auto &entry = page.slots[id & (PAGE_SIZE - 1)];
+    if (entry == npos) {
+        ++page.live;
+        ++count;
+    }
+    entry = slot;
+}
+
+void Table::RowDirectory::erase(RowId id) {
+    auto p = id >> PAGE_BITS;
+    if (p >= pages.size() || pages[p].slots.empty()) {
+        return;
+    }
+    auto &page = pages[p];
+    auto &entry = page.slots[id & (PAGE_SIZE - 1)];
+    if (entry == npos) {
+        return;
+    }
+    entry = npos;
+    --count;
+    if (--page.live == 0) {
+        page.slots.clear();
+        page.slots.shrink_to_fit();
+    }
+}
+
+void Table::RowDirectory::clear() {
+    pages.clear();
+    count = 0;
+}
+
+size_t Table::RowDirectory::page_count() const {
+    return std::count_if(pages.begin(), pages.end(), [](const Page &p) {
+        return !p.slots.empty();
+    });
+}
+
+size_t Table::RowDirectory::memory_bytes() const {
+    return pages.capacity() * sizeof(Page) + page_count() * PAGE_SIZE * sizeof(size_t);
+}
+
+void Table::OrderedIndex::clear() {
+    nodes.clear();
+    root = NIL;
+    count = 0;
+}
+
+uint32_t Table::OrderedIndex::first_leaf() const {
+    uint32_t n = root;
+    while (!nodes[n].leaf) {
+        n = nodes[n].children.front();
+    }
+    return n;
+}
+
+uint32_t Table::OrderedIndex::last_leaf() const {
+    uint32_t n = root;
+    while (!nodes[n].leaf) {
+        n = nodes[n].children.back();
+    }
+    return n;
+}
+
+std::pair<uint32_t, size_t> Table::OrderedIndex::seek(const Entry &e, bool after) const {
+    uint32_t n = root;
+    while (!nodes[n].leaf) {
+        auto &keys = nodes[n].keys;
+        auto i = std::upper_bound(keys.begin(), keys.end(), e, less) - keys.begin();
+        n = nodes[n].children[i];
+    }
+    auto &keys = nodes[n].keys;
+    auto it = after ? std::upper_bound(keys.begin(), keys.end(), e, less)
+                    : std::lower_bound(keys.begin(), keys.end(), e, less);
+    return {n, size_t(it - keys.begin())};
+}
+
+std::optional<std::pair<Table::OrderedIndex::Entry, uint32_t>>
+    Table::OrderedIndex::insert_into(uint32_t n, const Entry &e) {
+    if (nodes[n].leaf) {
+        auto &keys = nodes[n].keys;
+        keys.insert(std::upper_bound(keys.begin(), keys.end(), e, less), e);
+        if (keys.size() <= FANOUT) {
+            return std::nullopt;
+        }
+        // Split the leaf in half and link the new right sibling
+        uint32_t r = nodes.size();
+        nodes.emplace_back();
+        auto &left = nodes[n];
+        auto &right = nodes[r];
+        auto half = left.keys.size() / 2;
+        right.keys.reserve(FANOUT + 1);
+        right.keys.assign(left.keys.begin() + half, left.keys.end());
+        left.keys.resize(half);
+        right.prev = n;
+        right.next = left.next;
+        if (left.next != NIL) {
+            nodes[left.next].prev = r;
+        }
+        left.next = r;
+        return std::pair{right.keys.front(), r};
+    }
+
+    auto i = std::upper_bound(nodes[n].keys.begin(), nodes[n].keys.end(), e, less) -
+             nodes[n].keys.begin();
+    auto split = insert_into(nodes[n].children[i], e);
+    if (!split) {
+        return std::nullopt;
+    }
+    auto &node = nodes[n];
+    node.keys.insert(node.keys.begin() + i, std::move(split->first));
+    node.children.insert(node.children.begin() + i + 1, split->second);
+    if (node.keys.size() <= FANOUT) {
+        return std::nullopt;
+    }
+    // Push the middle separator up
+    uint32_t r = nodes.size();
+    nodes.emplace_back();
+    auto &left = nodes[n];
+    auto &right = nodes[r];
+    auto mid = left.keys.size() / 2;
+    Entry sep = left.keys[mid];
+    right.leaf = false;
+    right.keys.assign(left.keys.begin() + mid + 1, left.keys.end());
+    right.children.assign(left.children.begin() + mid + 1, left.children.end());
+    left.keys.resize(mid);
+    left.children.resize(mid + 1);
+    return std::pair{std::move(sep), r};
+}
+
+void Table::OrderedIndex::insert(const Value &key, RowId id) {
+    if (root == NIL) {
+        root = nodes.size();
+        nodes.emplace_back();
+        nodes[root].keys.reserve(FANOUT + 1);
+    }
+    if (auto split = insert_into(root, Entry{key, id})) {
+        uint32_t r = nodes.size();
+        nodes.emplace_back();
+        auto &top = nodes[r];
+        top.leaf = false;
+        top.keys.push_back(std::move(split->first));
+        top.children = {root, split->second};
+        root = r;
+    }
+    ++count;
+}
+
+void Table::OrderedIndex::erase(const Value &key, RowId id) {
+    if (root == NIL) {
+        return;
+    }
+    Entry e{key, id};
+    auto [leaf, pos] = seek(e, false);
+    auto &keys = nodes[leaf].keys;
+    if (pos < keys.size() && keys[pos].id == id && keys[pos].key.compare(key) == 0) {
+        keys.erase(keys.begin() + pos);
+        --count;
+    }
+}
+
+uint64_t Table::HashIndex::hash_of(const Value &key) {
+    // `std::hash` is the identity for integers, mix the bits before masking
+    uint64_t h = key.hash();
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void Table::HashIndex::rehash(size_t cap) {
+    auto old = std::move(slots);
+    slots.assign(cap, Slot{});
+    tombstones = 0;
+    size_t mask = cap - 1;
+    for (auto &s: old) {
+        if (s.id == EMPTY || s.id == TOMBSTONE) {
+            continue;
+        }
+        size_t i = s.hash & mask;
+        while (slots[i].id != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = s;
+    }
+}
+
+void Table::HashIndex::insert(const Value &key, RowId id) {
+    // Keep used slots, tombstones included, under 70% so probes stay short
+    if ((count + tombstones + 1) * 10 > slots.size() * 7) {
+        size_t cap = std::max<size_t>(16, slots.size());
+        while ((count + 1) * 10 > cap * 5) {
+            cap *= 2;
+        }
+        rehash(cap);
+    }
+    uint64_t h = hash_of(key);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while (slots[i].id != EMPTY && slots[i].id != TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (slots[i].id == TOMBSTONE) {
+        --tombstones;
+    }
+    slots[i] = Slot{h, id};
+    ++count;
+}
+
+void Table::HashIndex::erase(const Value &key, RowId id) {
+    if (count == 0) {
+        return;
+    }
+    uint64_t h = hash_of(key);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; slots[i].id != EMPTY; i = (i + 1) & mask) {
+        if (slots[i].id == id && slots[i].hash == h) {
+            slots[i].id = TOMBSTONE;
+            ++tombstones;
+            --count;
+            return;
+        }
+    }
+}
+
+void Table::HashIndex::clear() {
+    slots.clear();
+    count = 0;
+    tombstones = 0;
+}
+
+std::vector<Table::TrigramIndex::Gram> Table::TrigramIndex::grams_of(std::string_view s) {
+    std::vector<Gram> out;
+    if (s.size() < 3) {
+        return out;
+    }
+    out.reserve(s.size() - 2);
+    for (size_t i = 0; i + 3 <= s.size(); ++i) {
+        out.push_back(Gram(uint8_t(s[i])) << 16 | Gram(uint8_t(s[i + 1])) << 8 |
+                      Gram(uint8_t(s[i + 2])));
+    }
+    std::ranges::sort(out);
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+std::vector<Table::TrigramIndex::Gram> Table::TrigramIndex::pattern_grams(std::string_view pattern) {
+    // `%` and `_` end a literal run. An escape and the byte after it end it too, `strlike`
+    // may match them either way.
+    std::vector<Gram> out;
+    size_t begin = 0;
+    auto flush_run = [&](size_t end) {
+        auto grams = grams_of(pattern.substr(begin, end - begin));
+        out.insert(out.end(), grams.begin(), grams.end());
+    };
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '%' || c == '_' || c == '\\') {
+            flush_run(i);
+            if (c == '\\') {
+                ++i;
+            }
+            begin = i + 1;
+        }
+    }
+    if (begin < pattern.size()) {
+        flush_run(pattern.size());
+    }
+    std::ranges::sort(out);
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+void Table::TrigramIndex::insert(const Value &key, RowId id) {
+    for (auto g: grams_of(*key.as_string())) {
+        auto &ids = postings[g];
+        // New rows come with the largest rowid, only updates land in the middle
+        if (ids.empty() || ids.back() < id) {
+            ids.push_back(id);
+        } else {
+            ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+        }
+    }
+    ++count;
+}
+
+void Table::TrigramIndex::erase(const Value &key, RowId id) {
+    for (auto g: grams_of(*key.as_string())) {
+        auto it = postings.find(g);
+        if (it == postings.end()) {
+            continue;
+        }
+        auto &ids = it->second;
+        auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+        if (pos != ids.end() && *pos == id) {
+            ids.erase(pos);
+        }
+        if (ids.empty()) {
+            postings.erase(it);
+        }
+    }
+    --count;
+}
+
+void Table::TrigramIndex::clear() {
+    postings.clear();
+    count = 0;
+}
+
+std::vector<RowId> Table::TrigramIndex::candidates(std::span<const Gram> grams) const {
+    std::vector<const std::vector<RowId> *> lists;
+    lists.reserve(grams.size());
+    for (auto g: grams) {
+        auto it = postings.find(g);
+        if (it == postings.end()) {
+            return {};
+        }
+        lists.push_back(&it->second);
+    }
+    // Start from the shortest list and probe the others
+    std::ranges::sort(lists, {}, [](auto *l) { return l->size(); });
+    std::vector<RowId> out = *lists.front();
+    for (size_t i = 1; i < lists.size() && !out.empty(); ++i) {
+        auto &l = *lists[i];
+        std::erase_if(out, [&](RowId id) { return !std::binary_search(l.begin(), l.end(), id); });
+    }
+    return out;
+}
+
+void Table::init_schema(SchemaDesc desc) {
+    schema = std::move(desc.fields);
+    storage = desc.storage;
+    primary_field = 0;
+    for (size_t i = 0; i < schema.size(); ++i) {
+        if (schema[i].is_primary) {
+            primary_field = i;
+            break;
+        }
+    }
+    columns.clear();
+    for (auto &f: schema) {
+        // Only COLUMN tables keep their strings out of the row cells
+        f.dict = f.dict && storage == StorageMode::COLUMN && f.type == FieldType::STRING;
+    }
+    if (storage == StorageMode::COLUMN) {
+        for (auto &f: schema) {
+            columns.emplace_back(f.type, f.dict);
+        }
+    }
+    zone_maps.assign(schema.size(), {});
+    stats.clear();
+    stats_pending = false;
+    reset_indexes();
+}
+
+void Table::reset_indexes() {
+    indexes_ready = true;
+    ordered_indexes.clear();
+    hash_indexes.clear();
+    trigram_indexes.clear();
+    for (size_t i = 0; i < schema.size(); ++i) {
+        if (schema[i].indexed) {
+            ordered_indexes.emplace_back(i);
+        }
+        if (schema[i].hashed) {
+            hash_indexes.emplace_back(i);
+        }
+        if (schema[i].trigram) {
+            trigram_indexes.emplace_back(i);
+        }
+    }
+}
+
+void Table::rebuild_indexes() {
+    reset_indexes();
+    if (ordered_indexes.empty() && hash_indexes.empty() && trigram_indexes.empty()) {
+        return;
+    }
+    scan([&](const Row &row) {
+        for (size_t i = 0; i < schema.size(); ++i) {
+            if (schema[i].has_index()) {
+                index_cell(i, row.content[i], row.id);
+            }
+        }
+    });
+}
+
+void Table::zone_cell(size_t slot, size_t col, const Value &v) {
+    if (schema[col].type == FieldType::STRING) {
+        return;
+    }
+    auto &zones = zone_maps[col];
+    if (slot / ZONE_ROWS >= zones.size()) {
+        zones.resize(slot / ZONE_ROWS + 1);
+    }
+    zones[slot / ZONE_ROWS].widen(v);
+}
+
+void Table::rebuild_zone_maps() {
+    static_assert(ZONE_ROWS % 64 == 0);
+    zone_maps.assign(schema.size(), {});
+    const size_t slots = mapping ? mapped_ids.size() : rows.size();
+    for (size_t col = 0; col < schema.size(); ++col) {
+        if (schema[col].type == FieldType::STRING) {
+            continue;
+        }
+        auto &zones = zone_maps[col];
+        zones.resize((slots + ZONE_ROWS - 1) / ZONE_ROWS);
+        for (size_t slot = 0; slot < slots; ++slot) {
+            if (slot_alive(slot)) {
+                zones[slot / ZONE_ROWS].widen(cell_at(slot, col));
+            }
+        }
+    }
+}
+
+double Table::ColumnStats::fraction_at_most(const Value &v) const {
+    if (bounds.empty() || v.compare(min) < 0) {
+        return 0.0;
+    }
+    if (v.compare(max) >= 0) {
+        return 1.0;
+    }
+    // Whole buckets below `v`, then half of the bucket it falls in
+    auto it = std::ranges::upper_bound(bounds, v, [](const Value &a, const Value &b) {
+        return a.compare(b) < 0;
+    });
+    return (double(it - bounds.begin()) + 0.5) / double(bounds.size());
+}
+
+void Table::analyze() {
+    collect_stats();
+    // Not covered by the write-ahead log, the next flush rewrites the file
+    dirty = true;
+    wal_base_valid = false;
+}
+
+void Table::collect_stats() const {
+    stats_pending = false;
+    stats.assign(schema.size(), {});
+    const size_t slots = mapping ? mapped_ids.size() : rows.size();
+    std::vector<Value> values;
+    for (size_t col = 0; col < schema.size(); ++col) {
+        values.clear();
+        values.reserve(alive_count);
+        for (size_t slot = 0; slot < slots; ++slot) {
+            if (slot_alive(slot)) {
+                values.push_back(cell_at(slot, col));
+            }
+        }
+        stats[col] = stats_of(values);
+    }
+    logging::debug("Analyzed `{}`: {} rows", tb_name, alive_count);
+}
+
+Table::ColumnStats Table::stats_of(std::vector<Value> &values) {
+    // HyperLogLog over 2^SKETCH_BITS registers, about 1.6% standard error
+    constexpr unsigned SKETCH_BITS = 12;
+    constexpr size_t REGISTERS = size_t(1) << SKETCH_BITS;
+
+    ColumnStats st;
+    st.rows = values.size();
+    if (values.empty()) {
+        return st;
+    }
+    std::vector<uint8_t> sketch(REGISTERS);
+    for (auto &v: values) {
+        uint64_t h = HashIndex::hash_of(v);
+        auto rank = uint8_t(std::countl_zero(h << SKETCH_BITS | 1) + 1);
+        auto &reg = sketch[h >> (64 - SKETCH_BITS)];
+        reg = std::max(reg, rank);
+    }
+    double sum = 0;
+    size_t zeros = 0;
+    for (auto reg: sketch) {
+        sum += std::ldexp(1.0, -reg);
+        zeros += reg == 0;
+    }
+    const double m = REGISTERS;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        // Small range correction, linear counting
+        estimate = m * std::log(m / double(zeros));
+    }
+    st.distinct = std::clamp<uint64_t>(std::llround(estimate), 1, st.rows);
+
+    std::ranges::sort(values, [](const Value &a, const Value &b) { return a.compare(b) < 0; });
+    st.min = values.front();
+    st.max = values.back();
+    const size_t buckets = std::min(HISTOGRAM_BUCKETS, values.size());
+    st.bounds.reserve(buckets);
+    for (size_t b = 1; b <= buckets; ++b) {
+        st.bounds.push_back(values[b * values.size() / buckets - 1]);
+    }
+    return st;
+}
+
+void Table::index_cell(size_t col, const Value &v, RowId id) {
+    for (auto &idx: ordered_indexes) {
+        if (idx.column() == col) {
+            idx.insert(v, id);
+        }
+    }
+    for (auto &idx: hash_indexes) {
+        if (idx.column() == col) {
+            idx.insert(v, id);
+        }
+    }
+    for (auto &idx: trigram_indexes) {
+        if (idx.column() == col) {
+            idx.insert(v, id);
+        }
+    }
+}
+
+void Table::unindex_cell(size_t col, const Value &v, RowId id) {
+    for (auto &idx: ordered_indexes) {
+        if (idx.column() == col) {
+            idx.erase(v, id);
+        }
+    }
+    for (auto &idx: hash_indexes) {
+        if (idx.column() == col) {
+            idx.erase(v, id);
+        }
+    }
+    for (auto &idx: trigram_indexes) {
+        if (idx.column() == col) {
+            idx.erase(v, id);
+        }
+    }
+}
+
+std::expected<void, std::string> Table::create_index(size_t col, IndexKind kind) {
+    if (col >= schema.size()) {
+        return std::unexpected(std::format("Column index `{}` out of range", col));
+    }
+    auto &f = schema[col];
+    auto fill = [&](auto &idx) {
+        // Still pending on a mapped table, `ensure_indexes` fills it with the others
+        if (indexes_ready) {
+            scan([&](const Row &row) { idx.insert(row.content[col], row.id); });
+        }
+    };
+    switch (kind) {
+        case IndexKind::Ordered:
+            if (f.indexed) {
+                return std::unexpected(std::format("Column `{}` is already indexed", f.name));
+            }
+            fill(ordered_indexes.emplace_back(col));
+            f.indexed = true;
+            break;
+        case IndexKind::Hash:
+            if (f.hashed) {
+                return std::unexpected(
+                    std::format("Column `{}` already has a hash index", f.name));
+            }
+            if (f.type == FieldType::FLOAT) {
+                return std::unexpected(
+                    std::format("Hash index on FLOAT column `{}` is not supported", f.name));
+            }
+            fill(hash_indexes.emplace_back(col));
+            f.hashed = true;
+            break;
+        case IndexKind::Trigram:
+            if (f.trigram) {
+                return std::unexpected(
+                    std::format("Column `{}` already has a trigram index", f.name));
+            }
+            if (f.type != FieldType::STRING) {
+                return std::unexpected(
+                    std::format("Trigram index needs a STRING column, `{}` is {}",
+                                f.name,
+                                field_ty_as_string(f.type)));
+            }
+            fill(trigram_indexes.emplace_back(col));
+            f.trigram = true;
+            break;
+    }
+    // The log cannot carry schema changes, the next flush rewrites the file
+    dirty = true;
+    wal_base_valid = false;
+    return {};
+}
+
+const std::vector<Table::Value> *Table::row_values(RowId id) const {
+    auto slot = slot_of(id);
+    if (slot == RowDirectory::npos) {
+        return nullptr;
+    }
+    return &values_at(slot);
+}
+
+void Table::load_row(size_t slot, Row &out) const {
+    if (mapping) {
+        out.id = mapped_ids[slot];
+        out.expired = false;
+        out.content.clear();
+        for (auto &c: columns) {
+            out.content.push_back(c.get(slot));
+        }
+        return;
+    }
+    const Row &r = rows[slot];
+    out.id = r.id;
+    out.expired = r.expired;
+    if (storage == StorageMode::ROW) {
+        out.content = r.content;
+        return;
+    }
+    out.content.clear();
+    for (auto &c: columns) {
+        out.content.push_back(c.get(slot));
+    }
+}
+
+void Table::store_row(size_t slot, std::span<const Value> values) {
+    if (storage == StorageMode::ROW) {
+        rows[slot].content.assign(values.begin(), values.end());
+        return;
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i].set(slot, values[i]);
+    }
+}
+
+Table::Value Table::cell_at(size_t slot, size_t col) const {
+    if (storage == StorageMode::ROW && !mapping) {
+        return rows[slot].content[col];
+    }
+    return columns[col].get(slot);
+}
+
+const std::vector<Table::Value> &Table::values_at(size_t slot) const {
+    if (storage == StorageMode::ROW && !mapping) {
+        return rows[slot].content;
+    }
+    load_row(slot, cursor);
+    return cursor.content;
+}
+
 std::expected<RowId, std::string> Table::insert(std::span<const Table::Value> values) {
+    materialize();
     if (values.size() != schema.size()) {
         logging::error("Column count mismatch");
         return std::unexpected<std::string>("Column count mismatch");
@@ -90,157 +1195,662 @@ std::expected<RowId, std::string> Table::insert(std::span<const Table::Value> va
     size_t target_pos;
     Row row{
         .id = id,
-        .next = 0,
-        .prev = tail,
-        .content = std::vector<Value>(values.begin(), values.end()),
+        .content = {},
         .expired = false,
     };
+    if (storage == StorageMode::ROW) {
+        row.content.assign(values.begin(), values.end());
+    }
     if (!free_slots.empty()) {
         // Reuse idle slots
         target_pos = free_slots.back();
         free_slots.pop_back();
         logging::trace("Reuse physics_index `{}`", target_pos);
         rows[target_pos] = std::move(row);
+        if (storage == StorageMode::COLUMN) {
+            store_row(target_pos, values);
+        }
     } else {
         target_pos = rows.size();
         logging::trace("New physics_index `{}`", target_pos);
         rows.push_back(std::move(row));
+        for (size_t i = 0; i < columns.size(); ++i) {
+            columns[i].push_back(values[i]);
+        }
     }
 
-    // link
-    if (tail != 0) {
-        rows[rowid_index[tail]].next = id;
-    } else {
-        head = id;
-    }
-    tail = id;
-
     // insert to index
-    rowid_index[id] = target_pos;
+    mark_live(target_pos);
+    rowid_index.set(id, target_pos);
+    for (size_t i = 0; i < schema.size(); ++i) {
+        zone_cell(target_pos, i, values[i]);
+    }
     if (!schema.empty() && schema[primary_field].is_primary) {
-        primary_index[rows[target_pos].content[primary_field]] = id;
+        primary_index[values[primary_field]] = id;
+    }
+    for (size_t i = 0; i < schema.size(); ++i) {
+        if (schema[i].has_index()) {
+            index_cell(i, values[i], id);
+        }
     }
 
     // write flags
     dirty = true;
     ++alive_count;
+    wal_record(WalOp::Insert, id, values);
     return id;
 }
 
-void Table::scan(std::function<void(const Table::Row &)> cb) const {
-    RowId curr = head;
-    while (curr) {
-        const Row &r = rows.at(rowid_index.at(curr));
-        cb(r);
-        curr = r.next;
+std::expected<size_t, std::string> Table::insert_batch(std::span<const Value> cells) {
+    const size_t width = schema.size();
+    if (width == 0 || cells.size() % width != 0) {
+        return std::unexpected<std::string>("Column count mismatch");
+    }
+    const size_t n = cells.size() / width;
+    materialize();
+
+    const bool has_pk = schema[primary_field].is_primary;
+    if (has_pk) {
+        std::unordered_set<Value, ValueHash> seen;
+        seen.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            auto &key = cells[i * width + primary_field];
+            if (primary_index.contains(key) || !seen.insert(key).second) {
+                return std::unexpected(std::format("Primary key violation at row {}", i + 1));
+            }
+        }
+        primary_index.reserve(primary_index.size() + n);
+    }
+
+    rows.reserve(rows.size() + n);
+    for (auto &c: columns) {
+        c.reserve(c.size() + n);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        auto values = cells.subspan(i * width, width);
+        auto id = next_rowid++;
+        size_t slot = rows.size();
+        Row row{.id = id, .content = {}, .expired = false};
+        if (storage == StorageMode::ROW) {
+            row.content.assign(values.begin(), values.end());
+        }
+        rows.push_back(std::move(row));
+        for (size_t c = 0; c < columns.size(); ++c) {
+            columns[c].push_back(values[c]);
+        }
+        mark_live(slot);
+        rowid_index.set(id, slot);
+        for (size_t c = 0; c < width; ++c) {
+            zone_cell(slot, c, values[c]);
+        }
+        if (has_pk) {
+            primary_index.emplace(values[primary_field], id);
+        }
+        for (size_t c = 0; c < width; ++c) {
+            if (schema[c].has_index()) {
+                index_cell(c, values[c], id);
+            }
+        }
+    }
+    alive_count += n;
+    dirty = true;
+    wal_base_valid = false;
+    return n;
+}
+
+bool Table::needs_vacuum() const {
+    // Small tables are not worth a pass
+    constexpr size_t MIN_DEAD = 1024;
+    if (*vacuum_dead_percent <= 0 || free_slots.size() < MIN_DEAD) {
+        return false;
+    }
+    return free_slots.size() * 100 >= rows.size() * size_t(*vacuum_dead_percent);
+}
+
+size_t Table::vacuum() {
+    if (mapping || free_slots.empty()) {
+        return 0;
+    }
+    std::vector<size_t> live;
+    live.reserve(alive_count);
+    for_each_live([&](size_t slot) {
+        live.push_back(slot);
+        return true;
+    });
+
+    // Slots only move to the front, so `rows[slot]` is still untouched when it is moved.
+    // The rowid directory is patched for the moved rows only.
+    for (size_t i = 0; i < live.size(); ++i) {
+        if (live[i] != i) {
+            rows[i] = std::move(rows[live[i]]);
+            rowid_index.set(rows[i].id, i);
+        }
+    }
+    size_t reclaimed = rows.size() - live.size();
+    rows.resize(live.size());
+    rows.shrink_to_fit();
+    // Rebuilt columns also drop overwritten string bytes and unused dictionary entries
+    for (auto &c: columns) {
+        Column packed(c.type, c.dict);
+        packed.reserve(live.size());
+        for (auto slot: live) {
+            packed.push_back(c.get(slot));
+        }
+        c = std::move(packed);
+    }
+
+    free_slots.clear();
+    free_slots.shrink_to_fit();
+    drop_snapshot_chunks();
+    live_bits.assign((live.size() + 63) / 64, ~uint64_t(0));
+    if (live.size() % 64) {
+        live_bits.back() = (uint64_t(1) << (live.size() % 64)) - 1;
+    }
+    live_bits.shrink_to_fit();
+    rebuild_zone_maps();
+    logging::debug("Vacuumed `{}`: {} slots reclaimed", tb_name, reclaimed);
+    return reclaimed;
+}
+
+void Table::touch_slot(size_t slot) {
+    last_snapshot.reset();
+    if (slot / SNAPSHOT_CHUNK < snapshot_chunks.size()) {
+        snapshot_chunks[slot / SNAPSHOT_CHUNK].reset();
+    }
+}
+
+void Table::drop_snapshot_chunks() {
+    last_snapshot.reset();
+    snapshot_chunks.clear();
+}
+
+std::shared_ptr<const Table::Snapshot> Table::snapshot() {
+    if (last_snapshot) {
+        return last_snapshot;
+    }
+    const size_t slots = mapping ? mapped_ids.size() : rows.size();
+    snapshot_chunks.resize((slots + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK);
+    auto snap = std::make_shared<Snapshot>();
+    snap->chunks.reserve(snapshot_chunks.size());
+    size_t copied = 0;
+    for (size_t c = 0; c < snapshot_chunks.size(); ++c) {
+        auto &chunk = snapshot_chunks[c];
+        if (!chunk) {
+            auto fresh = std::make_shared<SnapshotChunk>();
+            const size_t end = std::min(slots, (c + 1) * SNAPSHOT_CHUNK);
+            for (size_t slot = c * SNAPSHOT_CHUNK; slot < end; ++slot) {
+                if (slot_alive(slot)) {
+                    load_row(slot, fresh->rows.emplace_back());
+                }
+            }
+            chunk = std::move(fresh);
+            ++copied;
+        }
+        snap->row_count += chunk->rows.size();
+        snap->chunks.push_back(chunk);
+    }
+    logging::debug("Snapshot of `{}`: {} of {} chunks copied",
+                   tb_name,
+                   copied,
+                   snapshot_chunks.size());
+    last_snapshot = std::move(snap);
+    return last_snapshot;
+}
+
+void Table::mark_live(size_t slot) {
+    touch_slot(slot);
+    if (slot / 64 >= live_bits.size()) {
+        live_bits.resize(slot / 64 + 1, 0);
+    }
+    live_bits[slot / 64] |= uint64_t(1) << (slot % 64);
+}
+
+void Table::mark_dead(size_t slot) {
+    touch_slot(slot);
+    live_bits[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+}
+
+void Table::scan(std::function<void(const Table::Row &)> cb, ScanOrder order) const {
+    Row scratch{};
+    if (mapping) {
+        // Slots of a mapped table are already in rowid order
+        for (size_t slot = 0; slot < mapped_ids.size(); ++slot) {
+            load_row(slot, scratch);
+            cb(scratch);
+        }
+        return;
+    }
+    auto visit = [&](size_t slot) {
+        if (storage == StorageMode::ROW) {
+            cb(rows[slot]);
+        } else {
+            load_row(slot, scratch);
+            cb(scratch);
+        }
+        return true;
+    };
+    if (order == ScanOrder::Insertion) {
+        rowid_index.for_each([&](RowId, size_t slot) { visit(slot); });
+        return;
+    }
+    for_each_live(visit);
+}
+
+void Table::scan_slots(std::function<bool(size_t)> keep,
+                       std::function<void(const Table::Row &)> cb) const {
+    Row scratch{};
+    auto visit = [&](size_t slot) {
+        if (!keep(slot)) {
+            return true;
+        }
+        if (storage == StorageMode::ROW && !mapping) {
+            cb(rows[slot]);
+        } else {
+            load_row(slot, scratch);
+            cb(scratch);
+        }
+        return true;
+    };
+    if (mapping) {
+        for (size_t slot = 0; slot < mapped_ids.size(); ++slot) {
+            visit(slot);
+        }
+        return;
     }
+    for_each_live(visit);
 }
 
 void Table::scan_mut(std::function<void(Row &)> cb) {
-    // index();
-    RowId curr = head;
-    while (curr) {
-        Row &r = rows[rowid_index[curr]];
-        RowId next = r.next;
-        cb(r);
-        curr = next;
-    }
+    materialize();
+    Row scratch{};
+    for_each_live([&](size_t slot) {
+        touch_slot(slot);
+        Row &r = storage == StorageMode::ROW ? rows[slot] : scratch;
+        if (storage == StorageMode::ROW) {
+            cb(r);
+        } else {
+            load_row(slot, scratch);
+            cb(scratch);
+            store_row(slot, scratch.content);
+        }
+        // Zones only widen, the old values of the slot are still covered
+        for (size_t col = 0; col < schema.size(); ++col) {
+            zone_cell(slot, col, r.content[col]);
+        }
+        return true;
+    });
     dirty = true;
+    wal_base_valid = false;
 }
 
 void Table::scan_struct(std::function<ScanAction(Row &)> cb) {
-    // index();
-    RowId curr = head;
-    while (curr != 0) {
-        auto it = rowid_index.find(curr);
-        if (it == rowid_index.end()) {
-            break;
+    // Rows are only read here, deletes run after the scan, so a mapped table is copied out by
+    // the first `erase_row` and not when nothing matches. `erase_row` also marks the chunks
+    // of the deleted slots.
+    std::vector<RowId> doomed;
+    Row scratch{};
+    auto visit = [&](size_t slot) {
+        Row *r = &scratch;
+        if (storage == StorageMode::ROW && !mapping) {
+            r = &rows[slot];
+        } else {
+            load_row(slot, scratch);
         }
-        Row &r = rows[it->second];
-        RowId next = r.next;
-        logging::debug("scan_struct visit row id={}, next={}", r.id, r.next);
-        auto action = cb(r);
+        logging::debug("scan_struct visit row id={}, slot={}", r->id, slot);
+        ScanAction action = cb(*r);
         if (action == ScanAction::Delete) {
-            auto _ = erase_row(curr);
+            doomed.push_back(r->id);
         }
-        if (action == ScanAction::Stop) {
-            break;
+        return action != ScanAction::Stop;
+    };
+    if (mapping) {
+        for (size_t slot = 0; slot < mapped_ids.size(); ++slot) {
+            if (!visit(slot)) {
+                break;
+            }
         }
-        curr = next;
+    } else {
+        for_each_live(visit);
+    }
+    for (auto id: doomed) {
+        auto _ = erase_row(id);
     }
-    dirty = true;
 }
 
 std::expected<Table::Row *, std::string> Table::find_by_id(const RowId id) {
-    // index();
-    auto it = rowid_index.find(id);
-    if (it == rowid_index.end()) {
+    auto slot = slot_of(id);
+    if (slot == RowDirectory::npos) {
         return std::unexpected<std::string>(std::format("Cannot find row with id {}", id));
     }
-    Row &r = rows[it->second];
+    if (storage == StorageMode::COLUMN || mapping) {
+        load_row(slot, cursor);
+        return &cursor;
+    }
+    Row &r = rows[slot];
     return &r;
 }
 
 std::expected<Table::Row *, std::string> Table::find_by_pk(const Value &value) {
-    // index();
     if (value != schema[primary_field].type) {
         return std::unexpected<std::string>("Type mismatch");
     }
+    ensure_primary_index();
     auto it = primary_index.find(value);
     if (it == primary_index.end()) {
         return std::unexpected<std::string>(std::format("Cannot find row"));
     }
-    auto idx = rowid_index.find(it->second);
-    if (idx == rowid_index.end()) {
+    auto slot = slot_of(it->second);
+    if (slot == RowDirectory::npos) {
         return std::unexpected<std::string>(std::format("Index ruined"));
     }
-    Row &r = rows[idx->second];
+    if (storage == StorageMode::COLUMN || mapping) {
+        load_row(slot, cursor);
+        return &cursor;
+    }
+    Row &r = rows[slot];
     return &r;
 }
 
 std::expected<void, std::string> Table::erase_row(RowId id) {
-    // index();
-    auto it = rowid_index.find(id);
-    if (it == rowid_index.end()) {
+    materialize();
+    auto physics_index = rowid_index.find(id);
+    if (physics_index == RowDirectory::npos) {
         return std::unexpected("Row not found");
     }
 
-    auto physics_index = it->second;
     Row &r = rows[physics_index];
     if (r.expired) {
         return {};
     }
 
-    // 1. unlink
-    if (r.prev) {
-        rows[rowid_index[r.prev]].next = r.next;
-    } else {
-        head = r.next;
-    }
-
-    if (r.next) {
-        rows[rowid_index[r.next]].prev = r.prev;
-    } else {
-        tail = r.prev;
-    }
-
-    // 2. index cleanup
+    // 1. index cleanup
     if (!schema.empty() && schema[primary_field].is_primary) {
-        primary_index.erase(r.content[primary_field]);
+        primary_index.erase(cell_at(physics_index, primary_field));
+    }
+    for (size_t i = 0; i < schema.size(); ++i) {
+        if (schema[i].has_index()) {
+            unindex_cell(i, cell_at(physics_index, i), id);
+        }
     }
     rowid_index.erase(id);
+    mark_dead(physics_index);
+
+    // A block left without live rows matches nothing
+    const size_t block = physics_index / ZONE_ROWS;
+    const size_t words = ZONE_ROWS / 64;
+    auto first = live_bits.begin() + block * words;
+    auto last = live_bits.begin() + std::min((block + 1) * words, live_bits.size());
+    if (std::all_of(first, last, [](uint64_t w) { return w == 0; })) {
+        for (auto &zones: zone_maps) {
+            if (block < zones.size()) {
+                zones[block] = Zone{};
+            }
+        }
+    }
 
-    // 3. add to free slots
+    // 2. add to free slots
     free_slots.push_back(physics_index);
     logging::trace("Add to free slot: `{}`", physics_index);
 
-    // 4. mark expired
+    // 3. mark expired, release cells
     r.expired = true;
+    r.content.clear();
+    r.content.shrink_to_fit();
     dirty = true;
     --alive_count;
+    wal_record(WalOp::Erase, id, {});
+    return {};
+}
+
+std::expected<void, std::string> Table::update(RowId id, size_t col, Value value) {
+    materialize();
+    auto slot = rowid_index.find(id);
+    if (slot == RowDirectory::npos) {
+        return std::unexpected("Row not found");
+    }
+    if (col >= schema.size()) {
+        return std::unexpected(std::format("Column index `{}` out of range", col));
+    }
+    if (!value.is(schema[col].type)) {
+        return std::unexpected(std::format("Type mismatch on column `{}` ({} <- {})",
+                                           schema[col].name,
+                                           field_ty_as_string(schema[col].type),
+                                           field_ty_as_string(value.type)));
+    }
+
+    if (col == primary_field && schema[primary_field].is_primary) {
+        auto old = cell_at(slot, col);
+        if (old == value) {
+            return {};
+        }
+        if (primary_index.contains(value)) {
+            return std::unexpected("Primary key violation");
+        }
+        primary_index.erase(old);
+        primary_index[value] = id;
+    }
+
+    if (schema[col].has_index()) {
+        unindex_cell(col, cell_at(slot, col), id);
+        index_cell(col, value, id);
+    }
+
+    wal_record(WalOp::Update, id, std::span(&value, 1), col);
+    touch_slot(slot);
+    zone_cell(slot, col, value);
+    if (storage == StorageMode::ROW) {
+        rows[slot].content[col] = std::move(value);
+    } else {
+        columns[col].set(slot, value);
+    }
+    dirty = true;
+    return {};
+}
+
+void Table::wal_record(WalOp op, RowId id, std::span<const Value> cells, uint32_t col) {
+    if (wal_replaying || file_on_disk.empty()) {
+        return;
+    }
+    auto start = wal_pending.size();
+    wal_put(wal_pending, uint32_t(0));
+    wal_put(wal_pending, op);
+    wal_put(wal_pending, id);
+    if (op == WalOp::Update) {
+        wal_put(wal_pending, col);
+    }
+    for (auto &v: cells) {
+        wal_put_value(wal_pending, v);
+    }
+    uint32_t len = wal_pending.size() - start - sizeof(uint32_t);
+    std::memcpy(wal_pending.data() + start, &len, sizeof(len));
+}
+
+std::expected<void, std::string> Table::wal_apply(std::string_view rec) {
+    SectionReader rd{rec.data(), rec.size()};
+    auto op = rd.get<WalOp>();
+    auto id = rd.get<RowId>();
+    if (!rd.ok) {
+        return std::unexpected("Truncated log record");
+    }
+    // The log carries the generation of its table file, so every record applies on top of the
+    // state left by the one before it. A record that does not is an error.
+    switch (op) {
+        case WalOp::Insert: {
+            std::vector<Value> cells;
+            cells.reserve(schema.size());
+            for (auto &f: schema) {
+                auto v = wal_get_value(rd, f.type);
+                if (!v) {
+                    return std::unexpected("Truncated log record");
+                }
+                cells.push_back(std::move(*v));
+            }
+            if (id < next_rowid) {
+                return std::unexpected("Log record does not follow the table file");
+            }
+            next_rowid = id;
+            if (auto res = insert(cells); !res.has_value()) {
+                return std::unexpected(res.error());
+            }
+            return {};
+        }
+        case WalOp::Erase: return erase_row(id);
+        case WalOp::Update: {
+            auto col = rd.get<uint32_t>();
+            if (!rd.ok || col >= schema.size()) {
+                return std::unexpected("Invalid log record");
+            }
+            auto v = wal_get_value(rd, schema[col].type);
+            if (!v) {
+                return std::unexpected("Truncated log record");
+            }
+            return update(id, col, std::move(*v));
+        }
+    }
+    return std::unexpected("Unknown log record");
+}
+
+std::expected<void, std::string> Table::replay_wal() {
+    std::ifstream ifs(wal_path(), std::ios::binary);
+    if (!ifs) {
+        return {};
+    }
+    std::string buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (schema.empty()) {
+        return std::unexpected("Write-ahead log found for a table without schema");
+    }
+    std::error_code ec;
+    if (buf.size() < WAL_HEADER) {
+        // Torn while the log was created, no record made it
+        fs::remove(wal_path(), ec);
+        return {};
+    }
+    if (std::string_view(buf).substr(0, sizeof(WAL_MAGIC)) !=
+        std::string_view(WAL_MAGIC, sizeof(WAL_MAGIC))) {
+        return std::unexpected("Invalid write-ahead log header");
+    }
+    uint64_t log_generation;
+    std::memcpy(&log_generation, buf.data() + sizeof(WAL_MAGIC), sizeof(log_generation));
+    if (log_generation != generation) {
+        // Left behind by a crash between the rewrite of the table file and the removal of
+        // the log, its records are part of the table file already
+        logging::warn("Ignoring stale write-ahead log of `{}`", file_on_disk);
+        fs::remove(wal_path(), ec);
+        return {};
+    }
+
+    wal_replaying = true;
+    size_t pos = WAL_HEADER;
+    size_t applied = 0;
+    while (pos + sizeof(uint32_t) <= buf.size()) {
+        uint32_t len;
+        std::memcpy(&len, buf.data() + pos, sizeof(len));
+        if (len > buf.size() - pos - sizeof(len)) {
+            break;
+        }
+        auto res = wal_apply(std::string_view(buf).substr(pos + sizeof(len), len));
+        if (!res.has_value()) {
+            wal_replaying = false;
+            return std::unexpected(
+                std::format("Bad write-ahead log record at offset {}: {}", pos, res.error()));
+        }
+        pos += sizeof(len) + len;
+        ++applied;
+    }
+    wal_replaying = false;
+    logging::debug("Replayed `{}` log records of `{}`", applied, file_on_disk);
+
+    wal_bytes = pos;
+    dirty = false;
+    if (pos != buf.size()) {
+        // Torn tail from an interrupted append, new records must not follow it
+        logging::warn("Dropping torn write-ahead log tail of `{}`", file_on_disk);
+        wal_base_valid = false;
+        dirty = true;
+    }
     return {};
 }
 
+bool Table::needs_checkpoint() const {
+    return file_on_disk.empty() || !wal_base_valid || !fs::exists(file_on_disk) ||
+           wal_size() > size_t(std::max(*wal_checkpoint_kb, 0)) * 1024;
+}
+
+void Table::flush() {
+    logging::trace("Flushing `{}`", file_on_disk);
+    if (!dirty || checkpoint_busy) {
+        return;
+    }
+    if (needs_checkpoint()) {
+        checkpoint();
+        return;
+    }
+    if (!wal_pending.empty()) {
+        // A new log starts with the generation of the table file it applies to
+        const bool fresh = wal_bytes == 0;
+        std::ofstream os(wal_path(), std::ios::binary | (fresh ? std::ios::trunc : std::ios::app));
+        if (fresh) {
+            os.write(WAL_MAGIC, sizeof(WAL_MAGIC));
+            os.write(reinterpret_cast<const char *>(&generation), sizeof(generation));
+        }
+        os.write(wal_pending.data(), wal_pending.size());
+        os.flush();
+        if (!os.good()) {
+            logging::warn("Cannot append to `{}`, rewriting the table", wal_path());
+            checkpoint();
+            return;
+        }
+        wal_bytes += (fresh ? WAL_HEADER : 0) + wal_pending.size();
+        wal_pending.clear();
+    }
+    dirty = false;
+}
+
+void Table::checkpoint() {
+    if (checkpoint_busy) {
+        return;
+    }
+    if (auto res = write_back_binary(); !res.has_value()) {
+        logging::error("Checkpoint of `{}` failed: {}", file_on_disk, res.error());
+        return;
+    }
+    ++generation;
+    wal_pending.clear();
+    dirty = false;
+    if (file_on_disk.empty()) {
+        return;
+    }
+    std::error_code ec;
+    fs::remove(wal_path(), ec);
+    wal_bytes = 0;
+    wal_base_valid = true;
+}
+
+Table::Image Table::begin_checkpoint() {
+    auto image = image_header();
+    image.rows = snapshot();
+    wal_pending.clear();
+    dirty = false;
+    checkpoint_busy = true;
+    return image;
+}
+
+void Table::finish_checkpoint(bool ok) {
+    checkpoint_busy = false;
+    if (!ok) {
+        // Records taken by the image are gone, only a full rewrite is consistent again
+        wal_base_valid = false;
+        dirty = true;
+        return;
+    }
+    ++generation;
+    std::error_code ec;
+    fs::remove(wal_path(), ec);
+    wal_bytes = 0;
+    wal_base_valid = true;
+    dirty = !wal_pending.empty();
+}
+
 std::expected<void, std::string> Table::parse_from_file() {
     std::ifstream ifs(file_on_disk, std::ios::binary);
     if (!ifs) {
@@ -261,7 +1871,29 @@ std::expected<void, std::string> Table::parse_from_file(std::ifstream &ifs) {
     // 2. Version
     uint32_t version;
     ifs.read(reinterpret_cast<char *>(&version), sizeof(version));
-    if (version != VERSION) {
+    if (version == VERSION || version == VERSION_PACKED) {
+        if (file_on_disk.empty()) {
+            return std::unexpected("A v2 table has to be opened from a file path");
+        }
+        auto file = utils::MappedFile::open(file_on_disk);
+        if (!file.has_value()) {
+            return std::unexpected(file.error());
+        }
+        if (version == VERSION) {
+            return parse_mapped(std::move(*file));
+        }
+        auto image = unpack_file(**file);
+        if (!image.has_value()) {
+            return std::unexpected(image.error());
+        }
+        logging::debug("Unpacked `{}`: {} bytes into {}", tb_name, (*file)->size(), image->size());
+        if (auto res = parse_mapped(utils::MappedFile::from_buffer(std::move(*image))); !res) {
+            return res;
+        }
+        packed = true;
+        return {};
+    }
+    if (version != VERSION_V1) {
         return std::unexpected("Unsupported version");
     }
 
@@ -284,8 +1916,8 @@ std::expected<void, std::string> Table::parse_from_file(std::ifstream &ifs) {
     }
 
     // 4. Schema
-    schema.clear();
-    schema.reserve(field_count);
+    SchemaDesc desc;
+    desc.fields.reserve(field_count);
     for (uint64_t i = 0; i < field_count; ++i) {
         Field f;
 
@@ -299,135 +1931,670 @@ std::expected<void, std::string> Table::parse_from_file(std::ifstream &ifs) {
         ifs.read(reinterpret_cast<char *>(&ty), sizeof(ty));
         f.type = static_cast<FieldType>(ty);
 
-        uint8_t is_pk;
-        ifs.read(reinterpret_cast<char *>(&is_pk), sizeof(is_pk));
-        f.is_primary = is_pk != 0;
-        if (f.is_primary) {
-            primary_field = i;
+        uint8_t flags;
+        ifs.read(reinterpret_cast<char *>(&flags), sizeof(flags));
+        f.is_primary = (flags & FIELD_PRIMARY) != 0;
+        f.indexed = (flags & FIELD_INDEXED) != 0;
+        f.hashed = (flags & FIELD_HASHED) != 0;
+        f.trigram = (flags & FIELD_TRIGRAM) != 0;
+        f.dict = (flags & FIELD_DICT) != 0;
+        if (flags & FIELD_COLUMNAR) {
+            desc.storage = StorageMode::COLUMN;
         }
 
-        schema.push_back(std::move(f));
+        desc.fields.push_back(std::move(f));
     }
+    init_schema(std::move(desc));
 
-    // 5. Rows
+    // 5. Rows, decoded from blocks the reader thread fetches ahead. A row cut by the end of
+    //    the buffer is decoded again once the next block is appended.
     rows.clear();
     free_slots.clear();
+    live_bits.clear();
     rows.reserve(alive_count);
+    for (auto &c: columns) {
+        c.reserve(alive_count);
+    }
+    utils::BlockReader blocks(ifs);
+    std::vector<Value> cells;
     for (uint64_t i = 0; i < alive_count; ++i) {
         Row r{};
+        while (true) {
+            auto buf = blocks.data();
+            SectionReader rd{buf.data(), buf.size()};
+            r.id = rd.get<RowId>();
+            cells.clear();
+            for (size_t c = 0; rd.ok && c < schema.size(); ++c) {
+                if (auto v = wal_get_value(rd, schema[c].type)) {
+                    cells.push_back(std::move(*v));
+                }
+            }
+            if (rd.ok) {
+                blocks.consume(rd.pos);
+                break;
+            }
+            if (!blocks.fill()) {
+                return std::unexpected(std::format("Table file truncated at row {}", i));
+            }
+        }
 
-        ifs.read(reinterpret_cast<char *>(&r.id), sizeof(r.id));
-        r.prev = r.next = 0;
-        r.expired = false;
-
-        r.content.reserve(schema.size());
-        for (auto &f: schema) {
-            r.content.push_back(Value::from_binary(f.type, ifs));
+        if (storage == StorageMode::ROW) {
+            r.content = std::move(cells);
+            cells = {};
+            cells.reserve(schema.size());
+        } else {
+            for (size_t c = 0; c < columns.size(); ++c) {
+                columns[c].push_back(cells[c]);
+            }
         }
 
+        mark_live(rows.size());
         rows.push_back(std::move(r));
     }
 
     set_flags();
     index();
-    rebuild_links();
+    rebuild_indexes();
+    rebuild_zone_maps();
+    stats_pending = true;
 
     return {};
 }
 
-void Table::write_back_binary(std::ofstream &ofs) {
+// Live rows of a materialized table in rowid order
+struct Table::LiveRows {
+    const Table &t;
+    std::vector<size_t> order;
+
+    explicit LiveRows(const Table &t) : t(t) {
+        order.reserve(t.alive_count);
+        t.rowid_index.for_each([&](RowId, size_t slot) { order.push_back(slot); });
+    }
+
+    size_t size() const {
+        return order.size();
+    }
+
+    RowId id(size_t i) const {
+        return t.rows[order[i]].id;
+    }
+
+    Value cell(size_t i, size_t col) const {
+        return t.cell_at(order[i], col);
+    }
+
+    std::string_view str(size_t i, size_t col) const {
+        if (t.storage == StorageMode::ROW) {
+            return *t.rows[order[i]].content[col].as_string();
+        }
+        return t.columns[col].str(order[i]);
+    }
+
+    // Dictionaries are written as they are in memory
+    const Column &dict(size_t col) const {
+        return t.columns[col];
+    }
+
+    uint32_t code(size_t i, size_t col) const {
+        return t.columns[col].codes[order[i]];
+    }
+};
+
+// Rows of a pinned snapshot in rowid order, dictionary columns are encoded again
+struct Table::PinnedRows {
+    std::vector<const Row *> order;
+    std::vector<Column> dicts;
+
+    PinnedRows(const Snapshot &snap, std::span<const Field> schema) {
+        order.reserve(snap.size());
+        snap.scan([&](const Row &r) { order.push_back(&r); });
+        std::ranges::sort(order, [](const Row *a, const Row *b) { return a->id < b->id; });
+        for (size_t col = 0; col < schema.size(); ++col) {
+            auto &c = dicts.emplace_back(schema[col].type, schema[col].dict);
+            if (!schema[col].dict) {
+                continue;
+            }
+            c.reserve(order.size());
+            for (auto *r: order) {
+                c.push_back(r->content[col]);
+            }
+        }
+    }
+
+    size_t size() const {
+        return order.size();
+    }
+
+    RowId id(size_t i) const {
+        return order[i]->id;
+    }
+
+    const Value &cell(size_t i, size_t col) const {
+        return order[i]->content[col];
+    }
+
+    std::string_view str(size_t i, size_t col) const {
+        return *order[i]->content[col].as_string();
+    }
+
+    const Column &dict(size_t col) const {
+        return dicts[col];
+    }
+
+    uint32_t code(size_t i, size_t col) const {
+        return dicts[col].codes[i];
+    }
+};
+
+Table::Image Table::image_header() const {
+    Image image;
+    image.schema = schema;
+    image.storage = storage;
+    image.pack = packed || compress_tables;
+    image.next_rowid = next_rowid;
+    // The file written from the image starts the next generation
+    image.generation = generation + 1;
+    image.stats = stats;
+    return image;
+}
+
+void Table::write_back_binary(std::ostream &ofs) {
+    // The mapping has to be dropped before the file is rewritten
+    materialize();
+    write_image(ofs, image_header(), LiveRows(*this));
+}
+
+template <typename Rows>
+void Table::write_image(std::ostream &ofs, const Image &h, const Rows &src) {
     if (!ofs.good()) {
-        logging::critical("Unknown error, cannot open file `{}`", file_on_disk);
+        logging::critical("Unknown error, cannot write the table file");
     }
+    auto &schema = h.schema;
     if (schema.empty()) {
         write_empty_header(ofs);
         logging::debug("Empty schema, writing an empty file");
         return;
     }
 
-    ofs.write(MAGIC_BYTES, MAGIC_SIZE);
+    const bool pack = h.pack;
+    SectionWriter w{ofs};
+    w.put(MAGIC_BYTES, MAGIC_SIZE);
+    w.put(pack ? VERSION_PACKED : VERSION);
+    const size_t n = src.size();
 
-    uint32_t version = VERSION;
-    ofs.write(reinterpret_cast<char *>(&version), sizeof(version));
-    uint64_t field_count = schema.size();
-    ofs.write(reinterpret_cast<char *>(&field_count), sizeof(field_count));
-    ofs.write(reinterpret_cast<char *>(&alive_count), sizeof(alive_count));
-    ofs.write(reinterpret_cast<char *>(&next_rowid), sizeof(next_rowid));
+    struct Sections {
+        uint64_t words[4] = {};
+    };
+    std::vector<Sections> sections(schema.size());
+
+    // Data of a packed file goes through `codec`
+    std::string encoded;
+    auto put_ints = [&](std::span<const int64_t> values) {
+        encoded.clear();
+        codec::put_ints(encoded, values);
+        w.put(encoded.data(), encoded.size());
+    };
 
-    for (auto &f: schema) {
-        uint32_t len = f.name.size();
-        ofs.write(reinterpret_cast<char *>(&len), sizeof(len));
-        ofs.write(f.name.data(), len);
+    const uint64_t rowid_off = w.align();
+    if (pack) {
+        std::vector<int64_t> ids;
+        ids.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            ids.push_back(int64_t(src.id(i)));
+        }
+        put_ints(ids);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            w.put(src.id(i));
+        }
+    }
 
-        int32_t ty = static_cast<int32_t>(f.type);
-        ofs.write(reinterpret_cast<char *>(&ty), sizeof(ty));
+    // Zone map of a numeric column in file order, `ZONE_ROWS` rows per (min, max) pair
+    auto put_zones = [&]<typename T>(const std::vector<T> &buf, uint64_t *sec) {
+        std::vector<T> bounds;
+        bounds.reserve((buf.size() + ZONE_ROWS - 1) / ZONE_ROWS * 2);
+        for (size_t b = 0; b < buf.size(); b += ZONE_ROWS) {
+            auto [lo, hi] = std::minmax_element(buf.begin() + b,
+                                                buf.begin() + std::min(b + ZONE_ROWS, buf.size()));
+            bounds.push_back(*lo);
+            bounds.push_back(*hi);
+        }
+        sec[1] = w.align();
+        w.put(bounds.data(), bounds.size() * sizeof(T));
+        sec[2] = bounds.size() / 2;
+    };
 
-        uint8_t pk = f.is_primary;
-        ofs.write(reinterpret_cast<char *>(&pk), sizeof(pk));
+    for (size_t col = 0; col < schema.size(); ++col) {
+        auto &sec = sections[col].words;
+        sec[0] = w.align();
+        switch (schema[col].type) {
+            case FieldType::INT: {
+                std::vector<int64_t> buf;
+                buf.reserve(n);
+                for (size_t i = 0; i < n; ++i) {
+                    buf.push_back(*src.cell(i, col).as_int());
+                }
+                if (pack) {
+                    put_ints(buf);
+                } else {
+                    w.put(buf.data(), buf.size() * sizeof(int64_t));
+                }
+                put_zones(buf, sec);
+                break;
+            }
+            case FieldType::FLOAT: {
+                std::vector<double> buf;
+                buf.reserve(n);
+                for (size_t i = 0; i < n; ++i) {
+                    buf.push_back(*src.cell(i, col).as_double());
+                }
+                if (pack) {
+                    encoded.clear();
+                    codec::put_doubles(encoded, buf);
+                    w.put(encoded.data(), encoded.size());
+                } else {
+                    w.put(buf.data(), buf.size() * sizeof(double));
+                }
+                put_zones(buf, sec);
+                break;
+            }
+            case FieldType::STRING: {
+                if (schema[col].dict) {
+                    // Codes in file order, then the dictionary
+                    auto &c = src.dict(col);
+                    std::vector<uint32_t> buf;
+                    buf.reserve(n);
+                    for (size_t i = 0; i < n; ++i) {
+                        buf.push_back(src.code(i, col));
+                    }
+                    if (pack) {
+                        put_ints(std::vector<int64_t>(buf.begin(), buf.end()));
+                    } else {
+                        w.put(buf.data(), buf.size() * sizeof(uint32_t));
+                    }
+                    sec[1] = w.align();
+                    w.put(c.offsets.data(), c.offsets.size() * sizeof(uint64_t));
+                    sec[2] = w.align();
+                    w.put(c.heap.data(), c.heap.size());
+                    sec[3] = c.dict_size();
+                    break;
+                }
+                if (pack) {
+                    std::vector<std::string_view> strs;
+                    strs.reserve(n);
+                    for (size_t i = 0; i < n; ++i) {
+                        strs.push_back(src.str(i, col));
+                    }
+                    encoded.clear();
+                    codec::put_strings(encoded, strs);
+                    w.put(encoded.data(), encoded.size());
+                    for (auto s: strs) {
+                        sec[3] += s.size();
+                    }
+                    break;
+                }
+                std::vector<uint64_t> offsets;
+                std::vector<uint32_t> lengths;
+                offsets.reserve(n);
+                lengths.reserve(n);
+                uint64_t heap_size = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    auto sv = src.str(i, col);
+                    offsets.push_back(heap_size);
+                    lengths.push_back(sv.size());
+                    heap_size += sv.size();
+                }
+                w.put(offsets.data(), offsets.size() * sizeof(uint64_t));
+                sec[1] = w.align();
+                w.put(lengths.data(), lengths.size() * sizeof(uint32_t));
+                sec[2] = w.align();
+                for (size_t i = 0; i < n; ++i) {
+                    auto sv = src.str(i, col);
+                    w.put(sv.data(), sv.size());
+                }
+                sec[3] = heap_size;
+                break;
+            }
+        }
     }
 
-    auto cb = [&](const Row &r) {
-        ofs.write(reinterpret_cast<const char *>(&r.id), sizeof(r.id));
-        for (size_t i = 0; i < schema.size(); ++i) {
-            r.content[i].dump_binary(ofs);
+    // Statistics as of the last analyze, `rows` tells how stale they are once reloaded
+    uint64_t stats_off = 0;
+    if (h.stats.size() == schema.size()) {
+        std::string buf;
+        for (auto &st: h.stats) {
+            wal_put(buf, st.rows);
+            wal_put(buf, st.distinct);
+            wal_put(buf, uint32_t(st.bounds.size()));
+            if (st.rows == 0) {
+                continue;
+            }
+            wal_put_value(buf, st.min);
+            wal_put_value(buf, st.max);
+            for (auto &v: st.bounds) {
+                wal_put_value(buf, v);
+            }
         }
+        stats_off = w.align();
+        w.put(buf.data(), buf.size());
+    }
+
+    Footer footer{
+        .row_count = n,
+        .next_rowid = h.next_rowid,
+        .rowids = rowid_off,
+        .stats = stats_off,
+        .generation = h.generation,
     };
-    scan(cb);
+    for (size_t col = 0; col < schema.size(); ++col) {
+        auto &f = schema[col];
+        uint8_t flags = f.is_primary ? FIELD_PRIMARY : 0;
+        if (h.storage == StorageMode::COLUMN) {
+            flags |= FIELD_COLUMNAR;
+        }
+        if (f.indexed) {
+            flags |= FIELD_INDEXED;
+        }
+        if (f.hashed) {
+            flags |= FIELD_HASHED;
+        }
+        if (f.trigram) {
+            flags |= FIELD_TRIGRAM;
+        }
+        if (f.dict) {
+            flags |= FIELD_DICT;
+        }
+        auto &entry = footer.fields.emplace_back(f.name, int32_t(f.type), flags);
+        std::ranges::copy(sections[col].words, entry.sec);
+    }
+    put_footer(w, footer);
 }
 
-void Table::write_back_binary() {
+std::expected<void, std::string> Table::write_back_binary() {
     if (file_on_disk.empty()) {
         logging::warn("This is table in memory, you should assign store path.");
-        return;
+        return {};
     }
+    materialize();
     logging::trace("Began to write back to file`{}`", file_on_disk);
     if (!std::filesystem::exists(file_on_disk)) {
         logging::warn("Cannot open data file`{}`, creating...", file_on_disk);
         touch_file(file_on_disk);
     }
-    std::ofstream os(file_on_disk, std::ios::binary);
-    write_back_binary(os);
+    // Written beside the table and renamed over it, a crash never leaves a half written file
+    return utils::write_file_durable(file_on_disk,
+                                     [&](std::ostream &os) { write_back_binary(os); });
+}
+
+std::expected<void, std::string> Table::Image::write(std::string_view path) const {
+    PinnedRows src(*rows, schema);
+    return utils::write_file_durable(path, [&](std::ostream &os) { write_image(os, *this, src); });
 }
 
-void Table::rebuild_links() {
-    head = tail = 0;
-    RowId prev = 0;
+void Table::index() const {
+    primary_index.clear();
+    rowid_index.clear();
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row &r = rows[i];
 
-    for (auto &r: rows) {
-        if (r.expired)
+        if (r.expired) {
             continue;
+        }
 
-        r.prev = prev;
-        r.next = 0;
+        rowid_index.set(r.id, i);
 
-        if (prev) {
-            rows[rowid_index[prev]].next = r.id;
-        } else {
-            head = r.id;
+        if (!schema.empty() && schema[primary_field].is_primary) {
+            primary_index[cell_at(i, primary_field)] = r.id;
         }
+    }
+}
 
-        prev = r.id;
+std::expected<void, std::string>
+    Table::parse_mapped(std::shared_ptr<const utils::MappedFile> file) {
+    SectionReader rd{file->data(), file->size()};
+    auto footer = get_footer(rd);
+    if (!footer) {
+        return std::unexpected(footer.error());
     }
+    const size_t field_count = footer->fields.size();
+    const uint64_t row_count = footer->row_count;
+    next_rowid = footer->next_rowid;
+    generation = footer->generation;
+
+    SchemaDesc desc;
+    std::vector<Column::Mapped> views(field_count);
+    // Offset and count of the zone map of each numeric column
+    std::vector<std::pair<uint64_t, uint64_t>> zone_secs(field_count);
+    desc.fields.reserve(field_count);
+    for (uint64_t i = 0; i < field_count; ++i) {
+        Field f;
+        f.name = footer->fields[i].name;
+        f.type = static_cast<FieldType>(footer->fields[i].type);
+        auto flags = footer->fields[i].flags;
+        auto &sec = footer->fields[i].sec;
+        f.is_primary = (flags & FIELD_PRIMARY) != 0;
+        f.indexed = (flags & FIELD_INDEXED) != 0;
+        f.hashed = (flags & FIELD_HASHED) != 0;
+        f.trigram = (flags & FIELD_TRIGRAM) != 0;
+        f.dict = (flags & FIELD_DICT) != 0;
+        if (flags & FIELD_COLUMNAR) {
+            desc.storage = StorageMode::COLUMN;
+        }
 
-    tail = prev;
-}
+        auto &v = views[i];
+        zone_secs[i] = {sec[1], sec[2]};
+        switch (f.type) {
+            case FieldType::INT: v.ints = rd.array<int64_t>(sec[0], row_count); break;
+            case FieldType::FLOAT: v.floats = rd.array<double>(sec[0], row_count); break;
+            case FieldType::STRING:
+                if (f.dict) {
+                    v.codes = rd.array<uint32_t>(sec[0], row_count);
+                    v.offsets = rd.array<uint64_t>(sec[1], sec[3] + 1);
+                    if (!rd.ok || v.offsets.empty() || v.offsets.size() != sec[3] + 1) {
+                        return std::unexpected("Corrupted dictionary");
+                    }
+                    v.heap = rd.bytes(sec[2], v.offsets.back());
+                    break;
+                }
+                v.offsets = rd.array<uint64_t>(sec[0], row_count);
+                v.lengths = rd.array<uint32_t>(sec[1], row_count);
+                v.heap = rd.bytes(sec[2], sec[3]);
+                break;
+            default: return std::unexpected("Unknown field type");
+        }
+        desc.fields.push_back(std::move(f));
+    }
+    const uint64_t stats_off = footer->stats;
+    auto ids = rd.array<RowId>(footer->rowids, row_count);
+    if (!rd.ok) {
+        return std::unexpected("Corrupted table file");
+    }
 
-void Table::index() const {
-    primary_index.clear();
+    // The sections fit in the file, now check them against each other once, so neither
+    // the column accessors nor the rowid directory can be led out of bounds later
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] >= next_rowid || (i > 0 && ids[i] <= ids[i - 1])) {
+            return std::unexpected("Corrupted table file");
+        }
+    }
+    for (size_t i = 0; i < field_count; ++i) {
+        auto &v = views[i];
+        if (desc.fields[i].type != FieldType::STRING) {
+            continue;
+        }
+        if (desc.fields[i].dict) {
+            const uint64_t entries = v.offsets.size() - 1;
+            bool ok = v.offsets.front() == 0 && std::ranges::is_sorted(v.offsets) &&
+                      std::ranges::all_of(v.codes, [&](uint32_t c) { return c < entries; });
+            if (!ok) {
+                return std::unexpected("Corrupted table file");
+            }
+            continue;
+        }
+        for (size_t r = 0; r < row_count; ++r) {
+            if (v.offsets[r] > v.heap.size() || v.lengths[r] > v.heap.size() - v.offsets[r]) {
+                return std::unexpected("Corrupted table file");
+            }
+        }
+    }
+
+    // Every column is mapped regardless of the storage mode, `materialize()` moves the
+    // cells into `rows` for ROW tables
+    init_schema(std::move(desc));
+    columns.clear();
+    for (size_t i = 0; i < schema.size(); ++i) {
+        columns.emplace_back(schema[i].type, schema[i].dict);
+        columns.back().mapped = views[i];
+    }
+    rows.clear();
+    free_slots.clear();
+    live_bits.clear();
     rowid_index.clear();
-    for (size_t i = 0; i < rows.size(); ++i) {
-        const Row &r = rows[i];
+    primary_index.clear();
+    mapped_ids = ids;
+    mapping = std::move(file);
+    alive_count = row_count;
+    dirty = false;
+    // `init_schema` left the secondary indexes empty, they are filled on first use
+    indexes_ready = false;
+
+    // Files written before zone maps were kept get them rebuilt
+    const uint64_t blocks = (row_count + ZONE_ROWS - 1) / ZONE_ROWS;
+    for (size_t col = 0; col < schema.size(); ++col) {
+        auto [off, count] = zone_secs[col];
+        if (schema[col].type == FieldType::STRING) {
+            continue;
+        }
+        if (count != blocks || (blocks > 0 && off == 0)) {
+            rebuild_zone_maps();
+            break;
+        }
+        auto &zones = zone_maps[col];
+        zones.resize(blocks);
+        auto load = [&]<typename T>(std::span<const T> bounds) {
+            for (size_t b = 0; b < bounds.size() / 2; ++b) {
+                zones[b] = Zone{.lo = Value(bounds[2 * b]),
+                                .hi = Value(bounds[2 * b + 1]),
+                                .empty = false};
+            }
+        };
+        if (schema[col].type == FieldType::INT) {
+            load(rd.array<int64_t>(off, 2 * blocks));
+        } else {
+            load(rd.array<double>(off, 2 * blocks));
+        }
+        if (!rd.ok) {
+            return std::unexpected("Corrupted zone map");
+        }
+    }
 
-        if (r.expired) {
+    if (stats_off == 0) {
+        // Analyzed on the first `column_stats()`, opening stays cheap
+        stats_pending = true;
+        return {};
+    }
+    rd.pos = stats_off;
+    stats.assign(schema.size(), {});
+    for (size_t col = 0; col < schema.size(); ++col) {
+        auto &st = stats[col];
+        st.rows = rd.get<uint64_t>();
+        st.distinct = rd.get<uint64_t>();
+        auto buckets = rd.get<uint32_t>();
+        if (!rd.ok || st.rows == 0) {
             continue;
         }
+        auto get_value = [&] {
+            auto v = wal_get_value(rd, schema[col].type);
+            return v ? std::move(*v) : Value{};
+        };
+        st.min = get_value();
+        st.max = get_value();
+        for (uint32_t b = 0; b < buckets && rd.ok; ++b) {
+            st.bounds.push_back(get_value());
+        }
+    }
+    if (!rd.ok) {
+        return std::unexpected("Corrupted column statistics");
+    }
+    return {};
+}
+
+void Table::materialize() {
+    if (!mapping) {
+        return;
+    }
+    logging::debug("Materializing mapped table `{}`", tb_name);
+    const size_t n = mapped_ids.size();
+    rows.clear();
+    rows.reserve(n);
+    live_bits.clear();
+    for (size_t slot = 0; slot < n; ++slot) {
+        Row r{.id = mapped_ids[slot], .content = {}, .expired = false};
+        if (storage == StorageMode::ROW) {
+            r.content.reserve(columns.size());
+            for (auto &c: columns) {
+                r.content.push_back(c.get(slot));
+            }
+        }
+        mark_live(slot);
+        rows.push_back(std::move(r));
+    }
+    if (storage == StorageMode::ROW) {
+        columns.clear();
+    } else {
+        for (auto &c: columns) {
+            c.materialize();
+        }
+    }
+    mapped_ids = {};
+    mapping.reset();
+    index();
+    // Writes keep the secondary indexes in step from now on
+    ensure_indexes();
+}
 
-        rowid_index[r.id] = i;
+void Table::ensure_primary_index() const {
+    if (!mapping || !primary_index.empty() || !schema[primary_field].is_primary) {
+        return;
+    }
+    auto &col = columns[primary_field];
+    primary_index.reserve(mapped_ids.size());
+    for (size_t slot = 0; slot < mapped_ids.size(); ++slot) {
+        primary_index[col.get(slot)] = mapped_ids[slot];
+    }
+}
 
-        if (!schema.empty() && schema[primary_field].is_primary) {
-            primary_index[r.content[primary_field]] = r.id;
+void Table::ensure_indexes() const {
+    if (indexes_ready) {
+        return;
+    }
+    indexes_ready = true;
+    if (ordered_indexes.empty() && hash_indexes.empty() && trigram_indexes.empty()) {
+        return;
+    }
+    scan([&](const Row &row) {
+        for (auto &idx: ordered_indexes) {
+            idx.insert(row.content[idx.column()], row.id);
         }
+        for (auto &idx: hash_indexes) {
+            idx.insert(row.content[idx.column()], row.id);
+        }
+        for (auto &idx: trigram_indexes) {
+            idx.insert(row.content[idx.column()], row.id);
+        }
+    });
+    logging::debug("Built the secondary indexes of `{}`", tb_name);
+}
+
+size_t Table::slot_of(RowId id) const {
+    if (!mapping) {
+        return rowid_index.find(id);
     }
+    auto it = std::lower_bound(mapped_ids.begin(), mapped_ids.end(), id);
+    if (it == mapped_ids.end() || *it != id) {
+        return RowDirectory::npos;
+    }
+    return it - mapped_ids.begin();
 }
 
 void Table::dump_schema() const {
@@ -455,11 +2622,30 @@ void Table::dump_schema(std::ostream &os) const {
     }
 }
 
+void Table::dump_stats(std::ostream &os) const {
+    for (size_t col = 0; col < schema.size(); ++col) {
+        os << utils::StyledText::format("{}: ", schema[col].name).cyan().bold();
+        auto *st = column_stats(col);
+        if (!st) {
+            os << "not analyzed\n";
+            continue;
+        }
+        os << std::format("{} rows, ~{} distinct", st->rows, st->distinct);
+        if (st->rows > 0) {
+            os << ", ";
+            st->min.display(os);
+            os << " .. ";
+            st->max.display(os);
+            os << std::format(", {} buckets", st->bounds.size());
+        }
+        os << '\n';
+    }
+}
+
 void Table::dump_row(RowId id) const {
     std::cout << id << '|';
-    if (auto it = rowid_index.find(id); it != rowid_index.end()) {
-        auto &row = rows[it->second];
-        for (auto &v: row.content) {
+    if (auto slot = slot_of(id); slot != RowDirectory::npos) {
+        for (auto &v: values_at(slot)) {
             v.display(std::cout);
             std::cout << '|';
         }
@@ -472,9 +2658,8 @@ void Table::dump_row(RowId id) const {
 
 void Table::dump_row(std::ostream &os, RowId id) const {
     os << id << '|';
-    if (auto it = rowid_index.find(id); it != rowid_index.end()) {
-        auto &row = rows[it->second];
-        for (auto &v: row.content) {
+    if (auto slot = slot_of(id); slot != RowDirectory::npos) {
+        for (auto &v: values_at(slot)) {
             v.display(os);
             os << '|';
         }
@@ -487,9 +2672,8 @@ void Table::dump_row(std::ostream &os, RowId id) const {
 
 void Table::dump_row(std::stringstream &ss, RowId id) const {
     ss << id << '|';
-    if (auto it = rowid_index.find(id); it != rowid_index.end()) {
-        auto &row = rows[it->second];
-        for (auto &v: row.content) {
+    if (auto slot = slot_of(id); slot != RowDirectory::npos) {
+        for (auto &v: values_at(slot)) {
             v.display(ss);
             ss << '|';
         }
@@ -0,0 +1,61 @@
+#include "codec.h"
+
+#include "test/test.h"
+
+#include <limits>
+
+namespace ut {
+suite<"Codec"> codec_test = [] {
+    using namespace gpamgr;
+
+    test("Ints") = [] {
+        // Sorted keys pack into a few bits, extremes take the full width
+        std::vector<int64_t> sorted(5000);
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            sorted[i] = 20240000 + int64_t(i);
+        }
+        std::vector<int64_t> extremes{std::numeric_limits<int64_t>::min(),
+                                      std::numeric_limits<int64_t>::max(),
+                                      0,
+                                      -1,
+                                      7};
+        for (auto *values: {&sorted, &extremes}) {
+            std::string buf;
+            codec::put_ints(buf, *values);
+            std::vector<int64_t> out(values->size());
+            expect(codec::get_ints(buf, out) == buf.size());
+            expect(out == *values);
+            expect(!codec::get_ints(std::string_view(buf).substr(0, buf.size() - 1), out));
+        }
+        std::string buf;
+        codec::put_ints(buf, sorted);
+        expect(buf.size() < 5 * 3 * sizeof(int64_t) + 5 * 8);
+    };
+
+    test("DoublesAndStrings") = [] {
+        std::vector<double> scores{59.5, 60.25, -0.75, 100.0, 0.0, 88.88};
+        std::vector<double> raw{0.1, 1.0 / 3.0, -0.0};
+        for (auto *values: {&scores, &raw}) {
+            std::string buf;
+            codec::put_doubles(buf, *values);
+            std::vector<double> out(values->size());
+            expect(codec::get_doubles(buf, out) == buf.size());
+            for (size_t i = 0; i < out.size(); ++i) {
+                expect(std::bit_cast<uint64_t>(out[i]) == std::bit_cast<uint64_t>((*values)[i]));
+            }
+        }
+
+        std::vector<std::string_view> names{"student-001", "student-002", "student-1", "", "s"};
+        std::string buf;
+        codec::put_strings(buf, names);
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> lengths;
+        std::string heap;
+        expect(codec::get_strings(buf, names.size(), offsets, lengths, heap) == buf.size());
+        expect(heap == "student-001student-002student-1s");
+        for (size_t i = 0; i < names.size(); ++i) {
+            expect(std::string_view(heap).substr(offsets[i], lengths[i]) == names[i]);
+        }
+    };
+};
+}  // namespace ut
@@ -2,6 +2,13 @@
 
 #include "test/test.h"
 
+#include <array>
+#include <tuple>
+#include <thread>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
 namespace ut {
 namespace {
 using namespace gpamgr;
@@ -210,5 +217,598 @@ suite<"ScriptDriver"> driver_test = [] {
             }
         }
     };
+
+    test("create columnar table and read") = [] {
+        {
+            ScriptDriver drv;
+            auto ret =
+                drv.do_command(".create col_rw column id:int primary key, name:str, score:float");
+            expect(ret.stat == CommandStat::Continue);
+            auto tb = drv.curr_table_mut().value();
+            expect(tb->storage_mode() == Table::StorageMode::COLUMN);
+            for (int64_t i = 1; i <= 3; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                     Table::Value{std::format("name-{}", i)},
+                                                     Table::Value{i * 1.5}};
+                expect(tb->insert(vec).has_value());
+            }
+            expect(tb->erase_row(2).has_value());
+        }
+        {
+            ScriptDriver drv;
+            auto t = drv.load_table("col_rw.gpa");
+            expect(t.has_value());
+            auto tb = t.value();
+            expect(tb->storage_mode() == Table::StorageMode::COLUMN);
+            expect(tb->alive_rows() == 2);
+            auto row = tb->find_by_pk(Table::Value{int64_t(3)});
+            expect(row.has_value());
+            if (row.has_value()) {
+                expect(*row.value()->content[1].as_string() == "name-3");
+            }
+            expect(!tb->find_by_pk(Table::Value{int64_t(2)}).has_value());
+        }
+    };
+
+    test("load_table: mapped v2 file") = [] {
+        {
+            ScriptDriver drv;
+            auto tb = drv.create_table("mapped_rw", make_schema()).value();
+            for (int64_t i = 1; i <= 100; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                     Table::Value{std::format("student-{:03}", i)},
+                                                     Table::Value{i * 0.5}};
+                expect(tb->insert(vec).has_value());
+            }
+            expect(tb->erase_row(50).has_value());
+            expect(tb->create_index(1).has_value());
+        }
+        ScriptDriver drv;
+        auto tb = drv.load_table("mapped_rw.gpa").value();
+        expect(tb->is_mapped());
+        expect(tb->alive_rows() == 99);
+        expect(tb->rows_physical_size() == 99);
+
+        double sum = 0;
+        RowId last = 0;
+        tb->scan([&](const Table::Row &r) {
+            expect(r.id > last);
+            last = r.id;
+            sum += *r.content[2].as_double();
+        });
+        expect(sum == (5050 - 50) * 0.5);
+        expect(tb->column(1).str(0) == "student-001");
+
+        // Zone maps are read back from the file
+        auto zones = tb->zone_map(2);
+        expect(zones.size() == 1 && !zones[0].empty);
+        if (zones.size() == 1) {
+            expect(*zones[0].lo.as_double() == 0.5 && *zones[0].hi.as_double() == 50.0);
+        }
+
+        // Point lookups are answered from the mapping
+        auto row = tb->find_by_pk(Table::Value{int64_t(77)});
+        expect(row.has_value());
+        if (row.has_value()) {
+            expect(*row.value()->content[1].as_string() == "student-077");
+        }
+        expect(!tb->find_by_id(50).has_value());
+        expect(tb->is_mapped());
+
+        // Secondary indexes are built on first use, still from the mapping
+        auto *idx = tb->ordered_index(1);
+        expect(idx != nullptr && idx->size() == 99);
+        expect(tb->is_mapped());
+
+        // A DELETE that matches nothing only reads the mapping
+        tb->scan_struct([](Table::Row &r) {
+            return r.id > 1000 ? Table::ScanAction::Delete : Table::ScanAction::Keep;
+        });
+        expect(tb->is_mapped());
+
+        // The first write copies the table out of the mapping
+        auto vec = std::vector<Table::Value>{Table::Value{int64_t(101)},
+                                             Table::Value{"late"},
+                                             Table::Value{1.0}};
+        expect(tb->insert(vec).has_value());
+        expect(!tb->is_mapped());
+        expect(tb->alive_rows() == 100);
+        expect(tb->find_by_pk(Table::Value{int64_t(99)}).has_value());
+        expect(!tb->find_by_pk(Table::Value{int64_t(50)}).has_value());
+        expect(tb->ordered_index(1)->size() == 100);
+    };
+
+    test("load_table: corrupted v2 file") = [] {
+        std::filesystem::remove("mapped_bad.gpa");
+        {
+            ScriptDriver drv;
+            auto tb = drv.create_table("mapped_bad", make_schema()).value();
+            const char *names[] = {"a", "bb", "ccc"};
+            for (int64_t i = 1; i <= 3; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                     Table::Value{names[i - 1]},
+                                                     Table::Value{1.0}};
+                expect(tb->insert(vec).has_value());
+            }
+        }
+        std::string image;
+        {
+            std::ifstream ifs("mapped_bad.gpa", std::ios::binary);
+            image.assign(std::istreambuf_iterator<char>(ifs), {});
+        }
+        // Overwrite the first occurrence of `from` in the file and try to load it
+        auto load_patched = [&](auto from, auto to) {
+            std::string bad = image;
+            auto at = bad.find({reinterpret_cast<const char *>(&from), sizeof(from)});
+            expect(at != std::string::npos);
+            if (at != std::string::npos) {
+                std::memcpy(bad.data() + at, &to, sizeof(to));
+            }
+            std::ofstream("mapped_bad.gpa", std::ios::binary | std::ios::trunc) << bad;
+            ScriptDriver drv;
+            return drv.load_table("mapped_bad.gpa");
+        };
+        using Ids = std::array<uint64_t, 3>;
+        using Lengths = std::array<uint32_t, 3>;
+        expect(load_patched(Ids{1, 2, 3}, Ids{1, 2, 3}).has_value());
+        // Rowids out of order, rowid past `next_rowid`, string past the heap
+        expect(!load_patched(Ids{1, 2, 3}, Ids{1, 1, 3}).has_value());
+        expect(!load_patched(Ids{1, 2, 3}, Ids{1, 2, 1ull << 60}).has_value());
+        expect(!load_patched(Lengths{1, 2, 3}, Lengths{1, 2, 4}).has_value());
+        std::filesystem::remove("mapped_bad.gpa");
+    };
+
+    test("load_table: column statistics") = [] {
+        {
+            ScriptDriver drv;
+            auto tb = drv.create_table("stats_rw", make_schema()).value();
+            for (int64_t i = 0; i < 10000; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                     Table::Value{std::format("s{}", i)},
+                                                     Table::Value{double(i % 100)}};
+                expect(tb->insert(vec).has_value());
+            }
+            expect(tb->column_stats(0) == nullptr);
+            expect(drv.analyze("stats_rw").value() == 1);
+            // Kept as analyzed, writing the file does not refresh them
+            auto vec = std::vector<Table::Value>{Table::Value{int64_t(10000)},
+                                                 Table::Value{"late"},
+                                                 Table::Value{0.0}};
+            expect(tb->insert(vec).has_value());
+            expect(tb->column_stats(2)->rows == 10000);
+        }
+        ScriptDriver drv;
+        auto tb = drv.load_table("stats_rw.gpa").value();
+        auto *score = tb->column_stats(2);
+        expect(score != nullptr);
+        if (score) {
+            expect(score->rows == 10000 && tb->alive_rows() == 10001);
+            expect(score->distinct >= 95 && score->distinct <= 105);
+            expect(*score->min.as_double() == 0.0 && *score->max.as_double() == 99.0);
+            expect(score->bounds.size() == Table::HISTOGRAM_BUCKETS);
+            auto below = score->fraction_at_most(Table::Value{49.5});
+            expect(below > 0.45 && below < 0.55);
+        }
+        auto *id = tb->column_stats(0);
+        expect(id && id->distinct > 9500 && id->distinct < 10500);
+        expect(*tb->column_stats(1)->max.as_string() == "s9999");
+
+        // A file saved without statistics is analyzed on the first lookup
+        auto plain = drv.load_table("mapped_rw.gpa").value();
+        auto *sid = plain->column_stats(0);
+        expect(sid != nullptr && sid->rows == plain->alive_rows());
+    };
+
+    test("load_table: packed file") = [] {
+        using FT = Table::FieldType;
+        Table::SchemaDesc desc{
+            .fields = {{.name = "sid", .type = FT::INT, .is_primary = true},
+                       {.name = "name", .type = FT::STRING},
+                       {.name = "major", .type = FT::STRING, .dict = true},
+                       {.name = "maths", .type = FT::FLOAT}},
+            .storage = Table::StorageMode::COLUMN,
+        };
+        size_t plain_size = 0;
+        for (bool pack: {false, true}) {
+            auto path = pack ? "packed_rw" : "unpacked_rw";
+            {
+                ScriptDriver drv;
+                auto tb = drv.create_table(path, desc).value();
+                tb->set_packed(pack);
+                for (int64_t i = 1; i <= 5000; ++i) {
+                    auto vec = std::vector<Table::Value>{Table::Value{20240000 + i},
+                                                         Table::Value{std::format("student-{}", i)},
+                                                         Table::Value{i % 3 ? "CS" : "Math"},
+                                                         Table::Value{double(i % 400) / 4}};
+                    expect(tb->insert(vec).has_value());
+                }
+                expect(tb->erase_row(10).has_value());
+            }
+            auto file_size = std::filesystem::file_size(std::format("{}.gpa", path));
+            if (!pack) {
+                plain_size = file_size;
+                continue;
+            }
+            expect(file_size * 3 < plain_size);
+
+            ScriptDriver drv;
+            auto tb = drv.load_table("packed_rw.gpa").value();
+            expect(tb->is_packed() && tb->is_mapped());
+            expect(tb->alive_rows() == 4999);
+            double sum = 0;
+            int64_t math = 0;
+            tb->scan([&](const Table::Row &r) {
+                sum += *r.content[3].as_double();
+                math += *r.content[2].as_string() == "Math";
+            });
+            expect(math == 1666);
+            expect(sum == 244425 - 2.5);
+            auto row = tb->find_by_pk(Table::Value{int64_t(20244321)});
+            expect(row && *row.value()->content[1].as_string() == "student-4321");
+            expect(!tb->find_by_pk(Table::Value{int64_t(20240010)}).has_value());
+            expect(tb->column_stats(0) != nullptr);
+        }
+    };
+
+    test("load_table: v1 file") = [] {
+        // GPATBL v1 with one INT primary key and one STRING field, `claimed` rows in the
+        // header and `rows` written. Spans more than one block of the loader.
+        auto write_v1 = [](const char *path, uint64_t claimed, int64_t rows) {
+            std::ofstream ofs(path, std::ios::binary);
+            auto put = [&](const auto &v) {
+                ofs.write(reinterpret_cast<const char *>(&v), sizeof(v));
+            };
+            ofs.write("GPATBL\0", 8);
+            put(uint32_t(1));
+            put(uint64_t(2));         // field_count
+            put(claimed);             // alive_count
+            put(uint64_t(rows + 1));  // next_rowid
+            for (auto [name, ty, flags]: {std::tuple{"id", 0, 1}, std::tuple{"name", 1, 0}}) {
+                put(uint32_t(std::strlen(name)));
+                ofs.write(name, std::strlen(name));
+                put(int32_t(ty));
+                put(uint8_t(flags));
+            }
+            for (int64_t id = 1; id <= rows; ++id) {
+                put(uint64_t(id));
+                Table::Value{id}.dump_binary(ofs);
+                Table::Value{std::format("legacy-{}", std::string(id % 37, 'x'))}.dump_binary(ofs);
+            }
+        };
+        write_v1("legacy.gpa", 60000, 60000);
+        write_v1("legacy_cut.gpa", 60001, 60000);
+
+        ScriptDriver drv;
+        auto tb = drv.load_table("legacy.gpa");
+        expect(tb.has_value());
+        if (tb.has_value()) {
+            expect(!tb.value()->is_mapped());
+            expect(tb.value()->alive_rows() == 60000);
+            for (int64_t id: {2, 59999}) {
+                auto row = tb.value()->find_by_pk(Table::Value{id});
+                expect(row.has_value());
+                if (row.has_value()) {
+                    expect(*row.value()->content[1].as_string() ==
+                           std::format("legacy-{}", std::string(id % 37, 'x')));
+                }
+            }
+        }
+        expect(!drv.load_table("legacy_cut.gpa").has_value());
+        std::filesystem::remove("legacy_cut.gpa");
+    };
+
+    test("load_table: dictionary column") = [] {
+        std::filesystem::remove("dict_rw.gpa");
+        std::filesystem::remove("dict_rw.gpa.wal");
+        {
+            ScriptDriver drv;
+            expect(drv.do_command(".create dict_row id:int primary key, major:str dict").stat ==
+                   CommandStat::Error);
+            auto ret = drv.do_command(".create dict_rw column id:int primary key, major:str dict");
+            expect(ret.stat == CommandStat::Continue);
+            auto tb = drv.curr_table_mut().value();
+            const char *majors[] = {"CS", "Math", "Physics"};
+            for (int64_t i = 1; i <= 300; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i}, Table::Value{majors[i % 3]}};
+                expect(tb->insert(vec).has_value());
+            }
+            expect(tb->update(3, 1, Table::Value{"History"}).has_value());
+            expect(tb->column(1).dict_size() == 4);
+        }
+        ScriptDriver drv;
+        auto tb = drv.load_table("dict_rw.gpa").value();
+        expect(tb->is_mapped());
+        expect(tb->get_schema()[1].dict);
+        expect(tb->column(1).dict_size() == 4);
+        expect(tb->column(1).str(2) == "History");
+        auto row = tb->find_by_pk(Table::Value{int64_t(4)});
+        expect(row.has_value() && *row.value()->content[1].as_string() == "Math");
+
+        // Writes after loading keep encoding against the same dictionary
+        auto vec = std::vector<Table::Value>{Table::Value{int64_t(301)}, Table::Value{"CS"}};
+        expect(tb->insert(vec).has_value());
+        expect(tb->column(1).dict_size() == 4);
+        expect(tb->column(1).str(300) == "CS");
+    };
+
+    test("checkpoint: pinned image") = [] {
+        std::filesystem::remove("pinned_rw.gpa");
+        std::filesystem::remove("pinned_rw.gpa.wal");
+        {
+            ScriptDriver drv;
+            auto ret = drv.do_command(".create pinned_rw column id:int primary key, major:str dict");
+            expect(ret.stat == CommandStat::Continue);
+            auto tb = drv.curr_table_mut().value();
+            const char *majors[] = {"CS", "Math", "Physics"};
+            for (int64_t i = 1; i <= 300; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i}, Table::Value{majors[i % 3]}};
+                expect(tb->insert(vec).has_value());
+            }
+            expect(tb->erase_row(7).has_value());
+
+            // Writes after `begin_checkpoint` are not part of the image
+            auto image = tb->begin_checkpoint();
+            expect(tb->update(8, 1, Table::Value{"History"}).has_value());
+            expect(tb->erase_row(9).has_value());
+            expect(image.write(tb->get_file_path()).has_value());
+            tb->finish_checkpoint(true);
+        }
+        std::filesystem::remove("pinned_rw.gpa.wal");
+        ScriptDriver drv;
+        auto tb = drv.load_table("pinned_rw.gpa").value();
+        expect(tb->alive_rows() == 299);
+        expect(tb->column(1).dict_size() == 3);
+        auto row = tb->find_by_pk(Table::Value{int64_t(8)});
+        expect(row.has_value() && *row.value()->content[1].as_string() == "Physics");
+        expect(tb->find_by_pk(Table::Value{int64_t(9)}).has_value());
+        expect(!tb->find_by_pk(Table::Value{int64_t(7)}).has_value());
+    };
+
+    test("import: csv file") = [] {
+        std::filesystem::remove("imp.gpa");
+        std::filesystem::remove("imp.gpa.wal");
+        {
+            std::ofstream ofs("imp.csv");
+            ofs << "id,name,score\r\n" << R"(1,"Doe, ""JD"" John",3.5)" << "\r\n\n";
+            for (int i = 2; i <= 40000; ++i) {
+                ofs << i << ",student_with_a_long_name_" << i << ", " << i * 0.5 << '\n';
+            }
+            std::ofstream bad("imp_bad.csv");
+            bad << "40001,a,1\n40002,b,oops\n";
+            std::ofstream dup("imp_dup.csv");
+            dup << "40001,a,1\n7,b,2\n";
+        }
+        {
+            ScriptDriver drv;
+            auto ret = drv.do_command(".create imp column id:int primary key, name:str, score:float");
+            expect(ret.stat == CommandStat::Continue);
+            expect(drv.do_command(".import imp.csv").stat == CommandStat::Continue);
+            auto tb = drv.curr_table_mut().value();
+            expect(tb->alive_rows() == 40000);
+            auto row = tb->find_by_pk(Table::Value{int64_t(1)});
+            expect(row.has_value() && *row.value()->content[1].as_string() == R"(Doe, "JD" John)");
+
+            auto err = drv.import_csv("imp_bad.csv", "imp");
+            expect(!err.has_value() && err.error().starts_with("Line 2:"));
+            expect(!drv.import_csv("imp_dup.csv").has_value());
+            expect(!drv.import_csv("imp.csv", "nope").has_value());
+            expect(tb->alive_rows() == 40000);
+        }
+        ScriptDriver drv;
+        auto tb = drv.load_table("imp.gpa").value();
+        expect(tb->alive_rows() == 40000);
+        auto row = tb->find_by_pk(Table::Value{int64_t(40000)});
+        expect(row.has_value() && *row.value()->content[2].as_double() == 20000.0);
+        std::filesystem::remove("imp.csv");
+        std::filesystem::remove("imp_bad.csv");
+        std::filesystem::remove("imp_dup.csv");
+    };
+
+    test("export: csv round trip and jsonl") = [] {
+        auto read_all = [](const char *path) {
+            std::ifstream ifs(path, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(ifs), {});
+        };
+        ScriptDriver drv;
+        auto ret = drv.do_command(".create exp_src id:int primary key, name:str, score:float");
+        expect(ret.stat == CommandStat::Continue);
+        auto src = drv.curr_table_mut().value();
+        for (int64_t i = 1; i <= 5000; ++i) {
+            auto name = i == 1 ? std::string("Doe, \"JD\"\ttab") : std::format("s{}", i);
+            auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                 Table::Value{std::string_view(name)},
+                                                 Table::Value{i * 0.25}};
+            expect(src->insert(vec).has_value());
+        }
+        expect(drv.do_command(".export csv exp.csv").stat == CommandStat::Continue);
+        expect(read_all("exp.csv").starts_with("id,name,score\n1,\"Doe, \"\"JD\"\"\ttab\",0.25\n"));
+
+        expect(drv.do_command(".create exp_dst id:int primary key, name:str, score:float").stat ==
+               CommandStat::Continue);
+        expect(drv.import_csv("exp.csv").value() == 5000);
+        auto row = drv.curr_table_mut().value()->find_by_pk(Table::Value{int64_t(1)});
+        expect(row.has_value() && *row.value()->content[1].as_string() == "Doe, \"JD\"\ttab");
+
+        auto n = drv.export_rows("jsonl", "exp.jsonl", "select name, id from exp_dst where id <= 2;");
+        expect(n.has_value() && *n == 2);
+        expect(read_all("exp.jsonl") ==
+               "{\"name\":\"Doe, \\\"JD\\\"\\ttab\",\"id\":1}\n{\"name\":\"s2\",\"id\":2}\n");
+        n = drv.export_rows("tsv", "exp.tsv", "select max(score) from exp_dst;");
+        expect(n.has_value() && read_all("exp.tsv") == "max(score)\n1250\n");
+
+        expect(!drv.export_rows("xml", "exp.xml").has_value());
+        expect(!drv.export_rows("csv", "exp.csv", "delete from exp_dst where id = 1;").has_value());
+        expect(drv.curr_table().value()->alive_rows() == 5000);
+        for (auto *p: {"exp.csv", "exp.jsonl", "exp.tsv"}) {
+            std::filesystem::remove(p);
+        }
+    };
+
+    test("export: csv round trip with line breaks") = [] {
+        // Large enough to be cut into several chunks, most cut points fall inside quotes
+        auto name_of = [](int64_t i) {
+            return i % 2 ? std::format("r{}\n{}\r\n\"end\"", i, std::string(1000, 'x'))
+                         : std::format("r{}", i);
+        };
+        ScriptDriver drv;
+        expect(drv.do_command(".create nl_src id:int primary key, name:str").stat ==
+               CommandStat::Continue);
+        auto src = drv.curr_table_mut().value();
+        for (int64_t i = 1; i <= 6000; ++i) {
+            auto name = name_of(i);
+            auto vec = std::vector<Table::Value>{Table::Value{i}, Table::Value{std::string_view(name)}};
+            expect(src->insert(vec).has_value());
+        }
+        expect(drv.do_command(".export csv nl.csv").stat == CommandStat::Continue);
+
+        expect(drv.do_command(".create nl_dst id:int primary key, name:str").stat ==
+               CommandStat::Continue);
+        expect(drv.import_csv("nl.csv").value() == 6000);
+        auto dst = drv.curr_table_mut().value();
+        bool same = true;
+        for (int64_t i = 1; i <= 6000; ++i) {
+            auto row = dst->find_by_pk(Table::Value{i});
+            same = same && row.has_value() && *row.value()->content[1].as_string() == name_of(i);
+        }
+        expect(same);
+
+        {
+            std::ofstream bad("nl_bad.csv");
+            bad << "1,a\n2,\"open\nfield\n";
+        }
+        auto err = drv.import_csv("nl_bad.csv");
+        expect(!err.has_value() && err.error().starts_with("Line 2:"));
+        std::filesystem::remove("nl.csv");
+        std::filesystem::remove("nl_bad.csv");
+    };
+
+    test("load_table: write-ahead log replay") = [] {
+        {
+            ScriptDriver drv;
+            auto tb = drv.create_table("wal_rw", make_schema()).value();
+            for (int64_t i = 1; i <= 10; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                     Table::Value{std::format("s{}", i)},
+                                                     Table::Value{i * 1.0}};
+                expect(tb->insert(vec).has_value());
+            }
+        }
+        expect(!std::filesystem::exists("wal_rw.gpa.wal"));
+        auto base_size = std::filesystem::file_size("wal_rw.gpa");
+        {
+            ScriptDriver drv;
+            auto tb = drv.load_table("wal_rw.gpa").value();
+            auto vec = std::vector<Table::Value>{Table::Value{int64_t(11)},
+                                                 Table::Value{"a rather long late name"},
+                                                 Table::Value{11.0}};
+            expect(tb->insert(vec).has_value());
+            expect(tb->erase_row(3).has_value());
+            expect(tb->update(5, 1, Table::Value{"five"}).has_value());
+            expect(tb->wal_size() > 0);
+        }
+        // Changes were appended to the log, the table file is left alone
+        expect(std::filesystem::exists("wal_rw.gpa.wal"));
+        expect(std::filesystem::file_size("wal_rw.gpa") == base_size);
+        {
+            // Torn tail from an interrupted append
+            std::ofstream ofs("wal_rw.gpa.wal", std::ios::binary | std::ios::app);
+            ofs.write("\x40\0\0\0\x01", 5);
+        }
+
+        ScriptDriver drv;
+        auto tb = drv.load_table("wal_rw.gpa").value();
+        expect(tb->alive_rows() == 10);
+        expect(!tb->find_by_id(3).has_value());
+        auto five = tb->find_by_pk(Table::Value{int64_t(5)});
+        expect(five.has_value() && *five.value()->content[1].as_string() == "five");
+        auto late = tb->find_by_id(11);
+        expect(late.has_value() &&
+               *late.value()->content[1].as_string() == "a rather long late name");
+
+        // New rowids continue after the replayed ones
+        auto vec = std::vector<Table::Value>{Table::Value{int64_t(12)},
+                                             Table::Value{"s12"},
+                                             Table::Value{12.0}};
+        expect(tb->insert(vec) == RowId(12));
+    };
+
+    test("load_table: stale write-ahead log") = [] {
+        std::filesystem::remove("wal_stale.gpa");
+        std::filesystem::remove("wal_stale.gpa.wal");
+        {
+            ScriptDriver drv;
+            auto tb = drv.create_table("wal_stale", make_schema()).value();
+            for (int64_t i = 1; i <= 5; ++i) {
+                auto vec = std::vector<Table::Value>{Table::Value{i},
+                                                     Table::Value{std::format("s{}", i)},
+                                                     Table::Value{i * 1.0}};
+                expect(tb->insert(vec).has_value());
+            }
+        }
+        {
+            ScriptDriver drv;
+            auto tb = drv.load_table("wal_stale.gpa").value();
+            auto vec = std::vector<Table::Value>{Table::Value{int64_t(6)},
+                                                 Table::Value{"s6"},
+                                                 Table::Value{6.0}};
+            expect(tb->insert(vec).has_value());
+            expect(tb->update(5, 1, Table::Value{"five"}).has_value());
+        }
+        std::filesystem::copy_file("wal_stale.gpa.wal", "wal_stale.old",
+                                   std::filesystem::copy_options::overwrite_existing);
+        {
+            ScriptDriver drv;
+            auto tb = drv.load_table("wal_stale.gpa").value();
+            expect(tb->update(5, 1, Table::Value{"FIVE"}).has_value());
+            tb->checkpoint();
+            expect(!std::filesystem::exists("wal_stale.gpa.wal"));
+        }
+        // A crash between the rewrite of the table file and the removal of its log
+        std::filesystem::rename("wal_stale.old", "wal_stale.gpa.wal");
+
+        ScriptDriver drv;
+        auto tb = drv.load_table("wal_stale.gpa");
+        expect(tb.has_value());
+        if (tb.has_value()) {
+            expect(tb.value()->alive_rows() == 6);
+            auto five = tb.value()->find_by_pk(Table::Value{int64_t(5)});
+            expect(five.has_value() && *five.value()->content[1].as_string() == "FIVE");
+        }
+        expect(!std::filesystem::exists("wal_stale.gpa.wal"));
+    };
+
+    test("flusher: background checkpoint") = [] {
+        std::filesystem::remove("bg_flush.gpa");
+        std::filesystem::remove("bg_flush.gpa.wal");
+        {
+            ScriptDriver drv;
+            drv.start_flusher();
+            auto ret = drv.do_command(".create bg_flush id:int primary key, name:str");
+            expect(ret.stat == CommandStat::Continue);
+            for (int i = 1; i <= 20; ++i) {
+                drv.do_command(std::format("insert into bg_flush values ({}, \"n{}\");", i, i));
+            }
+            drv.do_command(".flush");
+            for (int i = 0; i < 500 && drv.flush_state().checkpoints == 0; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            auto st = drv.flush_state();
+            expect(st.running);
+            expect(st.checkpoints == 1);
+            expect(st.failures == 0);
+            expect(std::filesystem::exists("bg_flush.gpa"));
+            expect(!std::filesystem::exists("bg_flush.gpa.tmp"));
+
+            // Later changes go to the log of the fresh image
+            drv.do_command("insert into bg_flush values (21, \"n21\");");
+        }
+        expect(std::filesystem::exists("bg_flush.gpa.wal"));
+        ScriptDriver drv;
+        auto tb = drv.load_table("bg_flush.gpa");
+        expect(tb.has_value());
+        if (tb.has_value()) {
+            expect(tb.value()->alive_rows() == 21);
+        }
+    };
 };
 }  // namespace ut
@@ -3,6 +3,446 @@
 #include "test/test.h"
 
 namespace ut {
+namespace {
+using namespace gpamgr;
+
+static std::vector<std::vector<Value>> run_sql(Table &tb, std::string_view sql) {
+    std::vector<std::vector<Value>> out;
+    TableView view{{"t", &tb}};
+    PlanBuildContext ctx(tb, view);
+    auto ret = ctx.append_sql(sql);
+    expect(ret.has_value());
+    ExecContext exec([&](RowView rv) { out.emplace_back(rv.cols.begin(), rv.cols.end()); });
+    ctx.execute_with_ctx(exec);
+    expect(!exec.has_failed());
+    return out;
+}
+
+static Table make_scores(Table::StorageMode storage) {
+    using FT = Table::FieldType;
+    auto tb = Table::create_in_memory({
+        .fields =
+            {
+                     {"sid", FT::INT, true},
+                     {"name", FT::STRING, false},
+                     {"maths", FT::FLOAT, false},
+                     },
+        .storage = storage,
+    });
+    for (int64_t i = 1; i <= 100; ++i) {
+        std::vector<Value> row{Value{i}, Value{std::format("s{}", i)}, Value{double(i)}};
+        auto _ = tb.insert(row);
+    }
+    return tb;
+}
+}  // namespace
+
 suite<"Executor"> all = [] {
+    using Storage = Table::StorageMode;
+
+    test("Aggregate") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            auto _ = tb.erase_row(100);
+
+            auto rows =
+                run_sql(tb, "select avg(maths), max(maths), min(maths), count(sid) from t;");
+            expect(rows.size() == 1);
+            if (rows.size() == 1) {
+                expect(*rows[0][0].as_double() == 50.0);
+                expect(*rows[0][1].as_double() == 99.0);
+                expect(*rows[0][2].as_double() == 1.0);
+                expect(*rows[0][3].as_int() == 99);
+            }
+        }
+    };
+
+    test("UpdateAndOrder") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "update t set maths = 1000 where sid <= 2;");
+
+            auto rows = run_sql(tb, "select sid from t where maths > 500 order by sid desc;");
+            expect(rows.size() == 2);
+            if (rows.size() == 2) {
+                expect(*rows[0][0].as_int() == 2);
+                expect(*rows[1][0].as_int() == 1);
+            }
+
+            // Every SET item reads the row as it was before the update
+            run_sql(tb, "update t set maths = 500 where sid = 5;");
+            run_sql(tb, "update t set sid = maths, maths = sid where sid = 5;");
+            auto swapped = run_sql(tb, "select maths from t where sid = 500;");
+            expect(swapped.size() == 1);
+            if (swapped.size() == 1) {
+                expect(*swapped[0][0].as_double() == 5.0);
+            }
+        }
+    };
+
+    test("IndexRangeScan") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "create index on t (maths);");
+            expect(tb.ordered_index(2) != nullptr);
+
+            // Maintained through update and delete
+            run_sql(tb, "update t set maths = 95.5 where sid = 3;");
+            run_sql(tb, "delete from t where sid = 97;");
+
+            auto rows = run_sql(tb, "select sid, maths from t where maths >= 95 and 99 > maths;");
+            std::vector<int64_t> sids;
+            for (auto &r: rows) {
+                sids.push_back(*r[0].as_int());
+            }
+            expect(sids == std::vector<int64_t>{95, 3, 96, 98});
+
+            rows = run_sql(tb, "select sid from t where maths <= 4 order by maths desc;");
+            sids.clear();
+            for (auto &r: rows) {
+                sids.push_back(*r[0].as_int());
+            }
+            expect(sids == std::vector<int64_t>{4, 2, 1});
+
+            rows = run_sql(tb, "select sid from t where maths = 50;");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 50);
+
+            // ORDER BY alone walks the index
+            rows = run_sql(tb, "select sid from t order by maths desc;");
+            expect(rows.size() == 99);
+            if (rows.size() == 99) {
+                expect(*rows[0][0].as_int() == 100);
+                expect(*rows[3][0].as_int() == 96);
+            }
+        }
+    };
+
+    test("PrefixLike") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "create index on t (name);");
+
+            // Range ['s1', 's2') with `_0` left to the filter
+            auto rows = run_sql(tb, "select sid from t where name like 's1_0' order by name;");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 100);
+
+            rows = run_sql(tb, "select sid from t where name like 's9%' order by name desc;");
+            std::vector<int64_t> sids;
+            for (auto &r: rows) {
+                sids.push_back(*r[0].as_int());
+            }
+            expect(sids == std::vector<int64_t>{99, 98, 97, 96, 95, 94, 93, 92, 91, 90, 9});
+
+            rows = run_sql(tb, "select sid from t where name like 's42';");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 42);
+        }
+    };
+
+    test("HashLookup") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "create index on t (name) using hash;");
+            expect(tb.hash_index(1) != nullptr);
+            expect(!tb.create_index(2, Table::IndexKind::Hash).has_value());
+
+            // Maintained through update and delete
+            run_sql(tb, "update t set name = 's7' where sid = 8;");
+            run_sql(tb, "delete from t where sid = 9;");
+            expect(tb.hash_index(1)->size() == 99);
+
+            auto rows = run_sql(tb, "select sid from t where 's7' = name;");
+            expect(rows.size() == 2);
+            if (rows.size() == 2) {
+                expect(*rows[0][0].as_int() == 7);
+                expect(*rows[1][0].as_int() == 8);
+            }
+            expect(run_sql(tb, "select sid from t where name = 's8';").empty());
+            expect(run_sql(tb, "select sid from t where name = 's9';").empty());
+
+            rows = run_sql(tb, "select sid from t where name = 's7' and sid > 7;");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 8);
+        }
+    };
+
+    test("DictionaryFilter") = [] {
+        using FT = Table::FieldType;
+        auto tb = Table::create_in_memory({
+            .fields = {{.name = "sid", .type = FT::INT, .is_primary = true},
+                       {.name = "major", .type = FT::STRING, .dict = true},
+                       {.name = "name", .type = FT::STRING}},
+            .storage = Storage::COLUMN,
+        });
+        const char *majors[] = {"CS", "Math", "Chemistry", "Physics"};
+        for (int64_t i = 1; i <= 100; ++i) {
+            std::vector<Value> row{Value{i}, Value{majors[i % 4]}, Value{std::format("s{}", i)}};
+            auto _ = tb.insert(row);
+        }
+        expect(tb.column(1).dict_size() == 4);
+
+        auto rows = run_sql(tb, "select sid from t where major = 'Math' and sid < 10;");
+        expect(rows.size() == 3);
+        rows = run_sql(tb, "select sid from t where 'CS' != major and major like '%h%';");
+        expect(rows.size() == 75);
+        // OR is left to the filter
+        rows = run_sql(tb, "select sid from t where major like 'P%' or sid = 1;");
+        expect(rows.size() == 26);
+
+        run_sql(tb, "update t set major = 'Art' where major = 'CS';");
+        expect(tb.column(1).dict_size() == 5);
+        expect(run_sql(tb, "select sid from t where major = 'CS';").empty());
+        expect(run_sql(tb, "select sid from t where major = 'Art';").size() == 25);
+
+        // ROW tables keep plain cells
+        auto row_tb = Table::create_in_memory({
+            .fields = {{.name = "sid", .type = FT::INT, .is_primary = true},
+                       {.name = "major", .type = FT::STRING, .dict = true}},
+        });
+        expect(!row_tb.get_schema()[1].dict);
+    };
+
+    test("SnapshotScan") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "create index on t (sid) using hash;");
+            auto snap = tb.snapshot();
+            expect(snap->size() == 100);
+            expect(tb.snapshot() == snap);
+
+            // Writers go on while the pinned version stays as it was
+            run_sql(tb, "update t set maths = 0 where sid <= 50;");
+            run_sql(tb, "delete from t where sid > 90;");
+            std::vector<Value> row{Value{int64_t(101)}, Value{"s101"}, Value{101.0}};
+            expect(tb.insert(row).has_value());
+            tb.vacuum();
+            double sum = 0;
+            snap->scan([&](const Table::Row &r) { sum += *r.content[2].as_double(); });
+            expect(snap->size() == 100 && sum == 5050.0);
+
+            std::vector<std::vector<Value>> out;
+            TableView view{{"t", &tb}};
+            PlanBuildContext ctx(tb, view);
+            ctx.read_snapshots(true);
+            expect(ctx.append_sql("select sid from t where sid = 101 or maths > 80;").has_value());
+            expect(ctx.read_only());
+            std::ostringstream plan;
+            ctx.explain(plan, false);
+            expect(plan.str().find("SnapshotScan(t, 91 rows)") != std::string::npos);
+            ExecContext exec([&](RowView rv) { out.emplace_back(rv.cols.begin(), rv.cols.end()); });
+            ctx.execute_with_ctx(exec);
+            expect(out.size() == 11);
+
+            // A SELECT behind a write of the same batch reads the live table
+            PlanBuildContext mixed(tb, view);
+            mixed.read_snapshots(true);
+            expect(mixed.append_sql("delete from t where sid = 101;").has_value());
+            expect(mixed.append_sql("select sid from t;").has_value());
+            expect(!mixed.read_only());
+            size_t rows = 0;
+            ExecContext count([&](RowView) { ++rows; });
+            mixed.execute_with_ctx(count);
+            expect(rows == 90);
+
+            // Statements copy only the chunks of the slots they write
+            for (int64_t i = 102; i <= 5000; ++i) {
+                std::vector<Value> row{Value{i}, Value{std::format("s{}", i)}, Value{double(i)}};
+                auto _ = tb.insert(row);
+            }
+            auto pinned = tb.snapshot();
+            run_sql(tb, "update t set maths = 1 where sid = 4500;");
+            run_sql(tb, "delete from t where sid = 4600;");
+            run_sql(tb, "update t set maths = 1 where sid > 9000;");
+            expect(tb.snapshot()->shared_chunks(*pinned) == 1);
+        }
+    };
+
+    test("ZoneMap") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            for (int64_t i = 101; i <= 3000; ++i) {
+                std::vector<Value> row{Value{i}, Value{std::format("s{}", i)}, Value{double(i)}};
+                auto _ = tb.insert(row);
+            }
+            auto zones = tb.zone_map(2);
+            expect(zones.size() == 3);
+            expect(*zones[1].lo.as_double() == 1025.0 && *zones[1].hi.as_double() == 2048.0);
+            expect(tb.zone_map(1).empty());
+
+            // Updates widen the zone, a block left without live rows is emptied
+            run_sql(tb, "update t set maths = 0 where sid = 2000;");
+            expect(*tb.zone_map(2)[1].lo.as_double() == 0.0);
+            run_sql(tb, "delete from t where sid > 2048;");
+            expect(tb.zone_map(2)[2].empty);
+
+            TableView view{{"t", &tb}};
+            PlanBuildContext ctx(tb, view);
+            expect(ctx.append_sql("select sid from t where maths >= 1500 and sid < 1600;"));
+            std::ostringstream plan;
+            ctx.explain(plan, false);
+            expect(plan.str().find("zones on maths, sid)") != std::string::npos);
+            size_t rows = 0;
+            ExecContext exec([&](RowView) { ++rows; });
+            ctx.execute_with_ctx(exec);
+            expect(rows == 100);
+
+            expect(run_sql(tb, "select sid from t where maths < 1;").size() == 1);
+            expect(run_sql(tb, "select sid from t where maths > 2048;").empty());
+
+            // In place edits widen the zones of the slots written back
+            tb.scan_mut([](Table::Row &r) {
+                if (*r.content[0].as_int() == 10) {
+                    r.content[2] = Value{-5.0};
+                }
+            });
+            expect(*tb.zone_map(2)[0].lo.as_double() == -5.0);
+        }
+    };
+
+    test("TrigramLike") = [] {
+        using Gram = Table::TrigramIndex::Gram;
+        auto gram = [](const char *s) {
+            return Gram(uint8_t(s[0])) << 16 | Gram(uint8_t(s[1])) << 8 | Gram(uint8_t(s[2]));
+        };
+        expect(Table::TrigramIndex::pattern_grams("%s1_%").empty());
+        expect(Table::TrigramIndex::pattern_grams("%abcd%x\\_yz") ==
+               std::vector<Gram>{gram("abc"), gram("bcd")});
+
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "create index on t (name) using trigram;");
+            expect(tb.trigram_index(1) != nullptr);
+            expect(!tb.create_index(0, Table::IndexKind::Trigram).has_value());
+
+            run_sql(tb, "update t set name = 'x42y' where sid = 1;");
+            run_sql(tb, "delete from t where sid = 42;");
+
+            auto rows = run_sql(tb, "select sid from t where name like '%x42%';");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 1);
+
+            // Candidates that hold the trigram but miss the pattern are filtered out
+            rows = run_sql(tb, "select sid from t where name like 's10_';");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 100);
+
+            // No trigram in the pattern, falls back to a scan
+            rows = run_sql(tb, "select sid from t where name like '%9';");
+            expect(rows.size() == 10);
+        }
+    };
+
+    test("Bytecode") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            TableView view{{"t", &tb}};
+
+            // Types are checked when the statement is planned
+            for (auto *sql: {"select sid from t where name > 5;",
+                             "select sid from t where maths like 'a%';",
+                             "update t set maths = (name + 1);"}) {
+                PlanBuildContext ctx(tb, view);
+                expect(!ctx.append_sql(sql).has_value());
+            }
+
+            run_sql(tb, "update t set maths = (-(sid * 2) / 4 + 0.5) where sid <= 3 or name = 's9';");
+            auto rows = run_sql(tb, "select sid, maths from t where maths < 0 or sid = 100;");
+            expect(rows.size() == 4);
+            if (rows.size() == 4) {
+                expect(*rows[0][1].as_double() == -0.5);
+                expect(*rows[2][1].as_double() == -3.5);
+                expect(*rows[3][0].as_int() == 100);
+            }
+            expect(run_sql(tb, "select sid from t where maths = 0.5;").size() == 1);
+
+            // The right side of OR is not evaluated once the left side holds
+            expect(run_sql(tb, "select sid from t where sid > 0 or sid / 0 = 1;").size() == 100);
+            PlanBuildContext ctx(tb, view);
+            expect(ctx.append_sql("select sid from t where maths / (sid - 50) > 1;").has_value());
+            ExecContext exec([](RowView) {});
+            ctx.execute_with_ctx(exec);
+            expect(exec.has_failed() && exec.error_msg() == "Division by zero");
+        }
+    };
+
+    test("CompareKernels") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            run_sql(tb, "update t set maths = 10.5 where sid > 90;");
+
+            TableView view{{"t", &tb}};
+            PlanBuildContext ctx(tb, view);
+            expect(ctx.append_sql("select sid from t where 60 > maths and sid >= maths and "
+                                  "name like 's9%';")
+                       .has_value());
+            std::ostringstream plan;
+            ctx.explain(plan, false);
+            expect(plan.str().find("Filter(maths < 60, sid >= maths)") != std::string::npos);
+            size_t rows = 0;
+            ExecContext exec([&](RowView) { ++rows; });
+            ctx.execute_with_ctx(exec);
+            expect(rows == 10);
+
+            // INT columns against FLOAT literals are widened, numbers within EPS are equal
+            expect(run_sql(tb, "select sid from t where sid < 3.5;").size() == 3);
+            expect(run_sql(tb, "select sid from t where maths = 10.5000000001;").size() == 10);
+            expect(run_sql(tb, "select sid from t where sid != maths;").size() == 10);
+            expect(run_sql(tb, "select sid from t where name >= 's95';").size() == 5);
+        }
+    };
+
+    test("BitmapFilter") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            TableView view{{"t", &tb}};
+            PlanBuildContext ctx(tb, view);
+            expect(ctx.append_sql("select sid from t where (maths < 10 or sid >= 95.5) and "
+                                  "30 > sid and name != 's1';")
+                       .has_value());
+            std::ostringstream plan;
+            ctx.explain(plan, false);
+            expect(plan.str().find("Filter((maths < 10 or sid >= 95.5), sid < 30, "
+                                   "name != 's1')") != std::string::npos);
+            std::vector<int64_t> sids;
+            ExecContext exec([&](RowView rv) { sids.push_back(*rv[0].as_int()); });
+            ctx.execute_with_ctx(exec);
+            expect(sids == std::vector<int64_t>{2, 3, 4, 5, 6, 7, 8, 9});
+
+            expect(run_sql(tb, "select sid from t where sid < 10 or sid > 95;").size() == 14);
+            expect(run_sql(tb, "select sid from t where maths = 50;").size() == 1);
+        }
+    };
+
+    test("Batches") = [] {
+        for (auto storage: {Storage::ROW, Storage::COLUMN}) {
+            auto tb = make_scores(storage);
+            for (int64_t i = 101; i <= 5000; ++i) {
+                std::vector<Value> row{Value{i}, Value{std::format("s{}", i)}, Value{double(i)}};
+                auto _ = tb.insert(row);
+            }
+
+            // Several scan batches, most of each filtered out, reordered across batches
+            auto rows = run_sql(tb, "select sid, maths from t where sid > 1000 and maths <= 3500 "
+                                    "order by maths desc;");
+            expect(rows.size() == 2500);
+            bool ordered = true;
+            for (size_t i = 0; i < rows.size(); ++i) {
+                ordered &= *rows[i][0].as_int() == 3500 - int64_t(i) &&
+                           *rows[i][1].as_double() == double(3500 - i);
+            }
+            expect(ordered);
+
+            rows = run_sql(tb, "select count(sid), max(maths) from t where sid <= 4000;");
+            expect(rows.size() == 1 && *rows[0][0].as_int() == 4000);
+            expect(rows.size() == 1 && *rows[0][1].as_double() == 4000.0);
+
+            size_t calls = 0, seen = 0;
+            TableView view{{"t", &tb}};
+            PlanBuildContext ctx(tb, view);
+            expect(ctx.append_sql("select name from t;").has_value());
+            ExecContext exec([&](RowBatch &batch) {
+                ++calls;
+                seen += batch.size();
+            });
+            ctx.execute_with_ctx(exec);
+            expect(seen == 5000 && calls == 5);
+        }
+    };
 };
-}
+}  // namespace ut
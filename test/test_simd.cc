@@ -0,0 +1,111 @@
+#include "simd.h"
+
+#include "test/test.h"
+
+#include <limits>
+
+namespace ut {
+suite<"Simd"> simd_test = [] {
+    using namespace gpamgr;
+    using simd::Isa;
+
+    // Every instruction set the CPU has must agree with the scalar kernel, including the
+    // partial last word and values around the EPS of `=`
+    test("Compare") = [] {
+        std::vector<double> doubles;
+        std::vector<int64_t> ints;
+        for (int i = 0; i < 203; ++i) {
+            doubles.push_back(i % 7 == 0 ? 60.0 + (i % 3 - 1) * 5e-7 : double(i % 120) - 0.5);
+            ints.push_back(i % 11 == 0 ? 60 : int64_t(i * 37 % 150) - 20);
+        }
+        doubles[5] = std::numeric_limits<double>::quiet_NaN();
+        doubles[6] = -0.0;
+        ints[7] = std::numeric_limits<int64_t>::min();
+        ints[8] = std::numeric_limits<int64_t>::max();
+
+        const size_t words = simd::bitmap_words(doubles.size());
+        bool same = true;
+        for (auto op: {CmpOp::Eq, CmpOp::Ne, CmpOp::Lt, CmpOp::Le, CmpOp::Gt, CmpOp::Ge}) {
+            std::vector<uint64_t> ref_d(words), ref_i(words);
+            simd::compare(doubles, op, 60.0, ref_d.data(), Isa::Scalar);
+            simd::compare(ints, op, int64_t(60), ref_i.data(), Isa::Scalar);
+            expect(ref_d.back() >> (doubles.size() % 64) == 0);
+            for (auto isa: {Isa::SSE42, Isa::AVX2}) {
+                std::vector<uint64_t> got_d(words), got_i(words);
+                simd::compare(doubles, op, 60.0, got_d.data(), isa);
+                simd::compare(ints, op, int64_t(60), got_i.data(), isa);
+                same &= got_d == ref_d && got_i == ref_i;
+            }
+        }
+        expect(same);
+
+        std::vector<uint64_t> lt(words), eq(words);
+        simd::compare(doubles, CmpOp::Lt, 60.0, lt.data());
+        simd::compare(doubles, CmpOp::Eq, 60.0, eq.data());
+        simd::or_bits(lt.data(), eq.data(), words);
+        std::vector<uint64_t> le(words);
+        simd::compare(doubles, CmpOp::Le, 60.0, le.data());
+        size_t lt_or_eq = 0, at_most = 0;
+        for (size_t w = 0; w < words; ++w) {
+            lt_or_eq += std::popcount(lt[w]);
+            at_most += std::popcount(le[w]);
+        }
+        // 60 +- 5e-7 is equal to 60 but only half of it is <= 60
+        expect(lt_or_eq > at_most);
+    };
+
+    test("Reduce") = [] {
+        // Halves add up exactly in any order, so every kernel must match the plain loop
+        const size_t n = 2500;
+        std::vector<double> doubles(n);
+        std::vector<int64_t> ints(n);
+        std::vector<uint64_t> bits(simd::bitmap_words(n));
+        for (size_t i = 0; i < n; ++i) {
+            doubles[i] = double(int64_t(i * 7919 % 1000) - 400) / 2;
+            ints[i] = int64_t(i * 104729 % 100000) - 30000;
+            if (i % 3 != 0 && i != 2000) {
+                bits[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+        ints[1] = int64_t(1) << 52;
+
+        auto plain = [&](auto &values, bool masked) {
+            simd::Totals t;
+            for (size_t i = 0; i < n; ++i) {
+                if (!masked || (bits[i / 64] >> (i % 64) & 1)) {
+                    t.sum += double(values[i]);
+                    t.min = std::min(t.min, double(values[i]));
+                    t.max = std::max(t.max, double(values[i]));
+                    t.count++;
+                }
+            }
+            return t;
+        };
+        auto same = [](const simd::Totals &a, const simd::Totals &b) {
+            return a.sum == b.sum && a.min == b.min && a.max == b.max && a.count == b.count;
+        };
+
+        bool ok = true;
+        for (auto isa: {Isa::Scalar, Isa::SSE42, Isa::AVX2}) {
+            for (bool masked: {false, true}) {
+                simd::Totals d, i;
+                if (masked) {
+                    simd::reduce(doubles, bits.data(), d, isa);
+                    simd::reduce(ints, bits.data(), i, isa);
+                } else {
+                    simd::reduce(doubles, d, isa);
+                    simd::reduce(ints, i, isa);
+                }
+                ok &= same(d, plain(doubles, masked)) && same(i, plain(ints, masked));
+            }
+        }
+        expect(ok);
+
+        // Nothing selected leaves the totals alone
+        simd::Totals t;
+        std::vector<uint64_t> none(bits.size());
+        simd::reduce(ints, none.data(), t);
+        expect(t.count == 0 && t.min == std::numeric_limits<double>::max() && t.sum == 0);
+    };
+};
+}  // namespace ut
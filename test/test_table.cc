@@ -2,6 +2,8 @@
 
 #include "test/test.h"
 
+#include <map>
+#include <algorithm>
 #include <cstdint>
 
 namespace ut {
@@ -19,6 +21,19 @@ static Table make_basic_table() {
     });
 }
 
+static Table make_column_table() {
+    using FT = Table::FieldType;
+    return Table::create_in_memory({
+        .fields =
+            {
+                     {"id", FT::INT, true},
+                     {"name", FT::STRING, false},
+                     {"score", FT::FLOAT, false},
+                     },
+        .storage = Table::StorageMode::COLUMN,
+    });
+}
+
 }  // namespace
 
 suite<"Table"> table = [] {
@@ -62,10 +77,10 @@ suite<"Table"> table = [] {
         {
             auto v1 = Table::Value::from_text(FT::STRING, R"STR("hello world")STR");
             expect(v1.has_value());
-            auto tmp = v1.value().get<std::string>();
+            auto tmp = v1.value().sget<std::string_view>();
             expect(tmp.has_value());
             if (tmp.has_value()) {
-                expect(tmp->get() == "hello world");
+                expect(*tmp == "hello world");
             }
         }
 
@@ -73,8 +88,7 @@ suite<"Table"> table = [] {
             // FLOAT: 114.514
             std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
 
-            Table::Value v;
-            v.inner = 114.514;
+            Table::Value v{114.514};
 
             v.dump_binary(ss);
 
@@ -92,8 +106,7 @@ suite<"Table"> table = [] {
             // FLOAT: pi
             std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
 
-            Table::Value v;
-            v.inner = 3.141592;
+            Table::Value v{3.141592};
 
             v.dump_binary(ss);
 
@@ -112,8 +125,7 @@ suite<"Table"> table = [] {
             // INT
             std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
 
-            Table::Value v;
-            v.inner = int64_t{114};
+            Table::Value v{int64_t{114}};
 
             v.dump_binary(ss);
 
@@ -131,22 +143,48 @@ suite<"Table"> table = [] {
             // STRING
             std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
 
-            Table::Value v;
-            v.inner = std::string("hello world");
+            Table::Value v{"hello world"};
 
             v.dump_binary(ss);
 
             ss.seekg(0);
 
             auto v2 = Table::Value::from_binary(FT::STRING, ss);
-            auto tmp = v2.get<std::string>();
+            auto tmp = v2.sget<std::string_view>();
             expect(tmp.has_value());
             if (tmp.has_value()) {
-                expect(tmp->get() == "hello world");
+                expect(*tmp == "hello world");
             }
         }
     };
 
+    test("CompactValue") = [&] {
+        expect(sizeof(Table::Value) == 16);
+
+        Table::Value small{"Li Wei"};
+        Table::Value large{"Maximilian Alexander von Humboldt"};
+        expect(small.is(Table::FieldType::STRING));
+        expect(*small.as_string() == "Li Wei");
+        expect(*large.as_string() == "Maximilian Alexander von Humboldt");
+        expect(small.as_int() == nullptr);
+
+        auto copied = large;
+        expect(copied == large);
+        auto moved = std::move(copied);
+        expect(*moved.as_string() == "Maximilian Alexander von Humboldt");
+
+        moved = small;
+        expect(moved == small);
+        expect(!(moved == Table::Value{int64_t(0)}));
+
+        std::vector<Table::Value> cells(3, large);
+        cells.push_back(Table::Value{1.5});
+        cells.erase(cells.begin());
+        expect(cells.size() == 3);
+        expect(*cells[1].as_string() == "Maximilian Alexander von Humboldt");
+        expect(*cells[2].as_double() == 1.5);
+    };
+
     test("SchemaDrivenRow") = [&] {
         Table::Field f1{"id", Table::FieldType::INT, true};
         Table::Field f2{"score", Table::FieldType::FLOAT, false};
@@ -315,5 +353,223 @@ suite<"Table"> table = [] {
         t.scan([&](const Table::Row &) { count++; });
         expect(count == 5);
     };
+
+    test("ColumnStorage") = [&] {
+        auto t = make_column_table();
+        expect(t.storage_mode() == Table::StorageMode::COLUMN);
+
+        std::vector<RowId> ids;
+        for (int64_t i = 1; i <= 5; ++i) {
+            std::vector<Value> data = {Value{i},
+                                       Value{std::format("student-{}", i)},
+                                       Value{double(i * 10)}};
+            auto res = t.insert(data);
+            expect(res.has_value());
+            ids.push_back(res.value());
+        }
+
+        expect(t.erase_row(ids[1]).has_value());
+        expect(t.erase_row(ids[3]).has_value());
+
+        std::vector<int64_t> seen;
+        t.scan([&](const Table::Row &r) {
+            expect(r.content.size() == 3);
+            seen.push_back(*r.content[0].as_int());
+        });
+        expect(seen == std::vector<int64_t>{1, 3, 5});
+
+        // Freed slot is reused and the columns stay aligned
+        std::vector<Value> data = {Value{int64_t(6)}, Value{"a much longer name"}, Value{60.0}};
+        expect(t.insert(data).has_value());
+        expect(t.rows_physical_size() == 5);
+
+        auto found = t.find_by_pk(Value{int64_t(6)});
+        expect(found.has_value());
+        if (found.has_value()) {
+            expect(*found.value()->content[1].as_string() == "a much longer name");
+            expect(float_eq(*found.value()->content[2].as_double(), 60.0));
+        }
+
+        auto &scores = t.column(2);
+        expect(scores.floats.size() == t.rows_physical_size());
+    };
+
+    test("OrderedIndex") = [&] {
+        Table::OrderedIndex idx(0);
+        std::multimap<int64_t, RowId> ref;
+        for (RowId id = 1; id <= 5000; ++id) {
+            int64_t key = (id * 7919) % 613;
+            idx.insert(Value{key}, id);
+            ref.emplace(key, id);
+        }
+        for (RowId id = 3; id <= 5000; id += 3) {
+            int64_t key = (id * 7919) % 613;
+            idx.erase(Value{key}, id);
+            std::erase_if(ref, [&](auto &kv) { return kv.second == id; });
+        }
+        expect(idx.size() == ref.size());
+        expect(idx.node_count() > 1);
+
+        using Bound = Table::OrderedIndex::Bound;
+        auto collect = [&](std::optional<Bound> lo, std::optional<Bound> hi, bool desc) {
+            std::vector<int64_t> keys;
+            idx.scan(lo, hi, desc, [&](const Value &k, RowId) {
+                keys.push_back(*k.as_int());
+                return true;
+            });
+            return keys;
+        };
+
+        auto all = collect(std::nullopt, std::nullopt, false);
+        expect(all.size() == ref.size());
+        expect(std::ranges::is_sorted(all));
+
+        // [100, 200) ascending and (100, 200] descending
+        auto asc = collect(Bound{Value{int64_t(100)}, true}, Bound{Value{int64_t(200)}, false}, false);
+        auto expect_asc = std::distance(ref.lower_bound(100), ref.lower_bound(200));
+        expect(asc.size() == size_t(expect_asc));
+        expect(asc.front() == 100 && asc.back() == 199);
+        auto desc = collect(Bound{Value{int64_t(100)}, false}, Bound{Value{int64_t(200)}, true}, true);
+        auto expect_desc = std::distance(ref.upper_bound(100), ref.upper_bound(200));
+        expect(desc.size() == size_t(expect_desc));
+        expect(desc.front() == 200 && desc.back() == 101);
+        expect(std::ranges::is_sorted(desc, std::greater{}));
+
+        // Keys compare by value across INT and FLOAT
+        auto ge = collect(Bound{Value{611.5}, true}, std::nullopt, false);
+        expect(ge.size() == ref.count(612));
+    };
+
+    test("RowDirectory") = [&] {
+        auto t = make_basic_table();
+        std::vector<RowId> ids;
+        for (int64_t i = 1; i <= 10000; ++i) {
+            std::vector<Value> data = {Value{i}, Value{0.0}};
+            ids.push_back(t.insert(data).value());
+        }
+
+        auto &dir = t.rowid_directory();
+        expect(dir.size() == 10000);
+        auto pages = dir.page_count();
+        auto bytes = dir.memory_bytes();
+
+        // Erasing every row of the first page releases it
+        for (auto id: ids) {
+            if (id >= 4096) {
+                break;
+            }
+            expect(t.erase_row(id).has_value());
+        }
+        expect(dir.page_count() == pages - 1);
+        expect(dir.memory_bytes() < bytes);
+        expect(!t.find_by_id(ids[0]).has_value());
+        expect(!t.erase_row(ids[0]).has_value());
+
+        auto found = t.find_by_id(ids.back());
+        expect(found.has_value());
+        if (found.has_value()) {
+            expect(*found.value()->content[0].as_int() == 10000);
+        }
+
+        size_t count = 0;
+        t.scan([&](const Table::Row &) { count++; });
+        expect(count == t.alive_rows());
+    };
+
+    test("ScanOrder") = [&] {
+        auto t = make_basic_table();
+        for (int64_t i = 1; i <= 6; ++i) {
+            std::vector<Value> data = {Value{i}, Value{0.0}};
+            expect(t.insert(data).has_value());
+        }
+        expect(t.erase_row(2).has_value());
+        std::vector<Value> data = {Value{int64_t(7)}, Value{0.0}};
+        expect(t.insert(data).has_value());
+        expect(t.slot_alive(1));
+
+        // The new row takes over the freed slot of row 2
+        std::vector<RowId> physical;
+        t.scan([&](const Table::Row &r) { physical.push_back(r.id); });
+        expect(physical == std::vector<RowId>{1, 7, 3, 4, 5, 6});
+
+        std::vector<RowId> inserted;
+        t.scan([&](const Table::Row &r) { inserted.push_back(r.id); },
+               Table::ScanOrder::Insertion);
+        expect(inserted == std::vector<RowId>{1, 3, 4, 5, 6, 7});
+
+        size_t visited = 0;
+        t.scan_struct([&](Table::Row &) {
+            return ++visited == 3 ? Table::ScanAction::Stop : Table::ScanAction::Keep;
+        });
+        expect(visited == 3);
+    };
+
+    test("UpdateCell") = [&] {
+        auto t = make_column_table();
+        for (int64_t i = 1; i <= 3; ++i) {
+            std::vector<Value> data = {Value{i}, Value{"x"}, Value{0.0}};
+            expect(t.insert(data).has_value());
+        }
+
+        expect(t.update(2, 1, Value{"renamed"}).has_value());
+        expect(t.update(2, 2, Value{int64_t(1)}).has_value() == false);
+        expect(!t.update(2, 0, Value{int64_t(3)}).has_value());
+        expect(t.update(2, 0, Value{int64_t(20)}).has_value());
+
+        expect(!t.find_by_pk(Value{int64_t(2)}).has_value());
+        auto found = t.find_by_pk(Value{int64_t(20)});
+        expect(found.has_value());
+        if (found.has_value()) {
+            expect(*found.value()->content[1].as_string() == "renamed");
+        }
+    };
+
+    test("Vacuum") = [&] {
+        auto t = make_column_table();
+        for (int64_t i = 1; i <= 3000; ++i) {
+            std::vector<Value> data = {Value{i}, Value{std::format("s{}", i)}, Value{double(i)}};
+            expect(t.insert(data).has_value());
+        }
+        for (RowId id = 1; id <= 3000; ++id) {
+            if (id % 3 != 0) {
+                expect(t.erase_row(id).has_value());
+            }
+        }
+        expect(t.update(3000, 1, Value{"a name that no longer fits"}).has_value());
+        expect(t.needs_vacuum());
+
+        expect(t.vacuum() == 2000);
+        expect(t.rows_physical_size() == 1000);
+        expect(t.dead_slots() == 0);
+        expect(!t.needs_vacuum());
+        expect(t.column(1).offsets.size() == 1000);
+
+        std::vector<int64_t> seen;
+        t.scan([&](const Table::Row &r) { seen.push_back(*r.content[0].as_int()); });
+        expect(seen.size() == 1000 && seen.front() == 3 && seen.back() == 3000);
+        auto found = t.find_by_id(3000);
+        expect(found.has_value() &&
+               *found.value()->content[1].as_string() == "a name that no longer fits");
+        expect(t.find_by_pk(Value{int64_t(1500)}).has_value());
+
+        // Slots after the packed rows are appended again
+        std::vector<Value> data = {Value{int64_t(3001)}, Value{"new"}, Value{1.0}};
+        expect(t.insert(data).has_value());
+        expect(t.rows_physical_size() == 1001);
+        expect(t.find_by_id(3001).has_value());
+
+        auto r = make_basic_table();
+        for (int64_t i = 1; i <= 10; ++i) {
+            std::vector<Value> row = {Value{i}, Value{double(i)}};
+            expect(r.insert(row).has_value());
+        }
+        expect(r.erase_row(1).has_value());
+        expect(r.erase_row(5).has_value());
+        expect(!r.needs_vacuum());
+        expect(r.vacuum() == 2);
+        expect(r.rows_physical_size() == 8);
+        auto ten = r.find_by_pk(Value{int64_t(10)});
+        expect(ten.has_value() && float_eq(*ten.value()->content[1].as_double(), 10.0));
+    };
 };
 }  // namespace ut
@@ -36,6 +36,9 @@ target("gpamgr_core", function()
 	add_files("src/*.cc")
 	add_packages("spdlog", { public = true })
 	add_packages("cpp-linenoise", { public = true })
+	if is_plat("linux") then
+		add_syslinks("pthread", { public = true })
+	end
 end)
 
 target("gpamgr", function()